@@ -0,0 +1,276 @@
+#define _POSIX_C_SOURCE 200809L // for open_memstream, fmemopen and sysconf
+#include "batch.h"
+#include "converter.h"
+#include "envelope.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <threads.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define BUFFERS_PER_WORKER 2 // one being encoded, and one read ahead ready for it
+
+// a buffer a file passes through on its way from being read to written
+typedef struct slot {
+    int file; // which file of the batch is in it
+    bool loaded; // false if the file couldn't be read
+    unsigned char *input; // the .pgm file as read, kept from one file to the next
+    size_t length, capacity;
+    char *output; // the .sk file to write, or NULL if the .pgm isn't valid
+    size_t outputLength;
+} slot;
+
+// the slots waiting for one stage of the pipeline, first in first out
+typedef struct queue {
+    int *slots;
+    int first, count, size;
+} queue;
+
+static struct pipeline {
+    mtx_t lock;
+    cnd_t changed; // broadcast whenever a slot moves, or a stage finishes
+    slot *slots;
+    queue empty, read, encoded;
+    // threads still able to put slots on each queue. the writer always gives
+    // back every slot, so there is always one for the empty queue
+    int writers, readers, workers;
+    char **files;
+    int count;
+    batchOptions *options;
+} pipeline;
+
+static void push(queue *q, int s) {
+    q->slots[(q->first + q->count++) % q->size] = s;
+}
+
+static int pop(queue *q) {
+    int s = q->slots[q->first];
+    q->first = (q->first + 1) % q->size;
+    q->count--;
+    return s;
+}
+
+// takes the next slot from a queue, waiting for one while any thread may
+// still put one there. returns -1 once none will come
+static int take(queue *q, int *producers) {
+    mtx_lock(&pipeline.lock);
+    while (q->count == 0 && *producers > 0) cnd_wait(&pipeline.changed, &pipeline.lock);
+    int s = (q->count > 0) ? pop(q) : -1;
+    mtx_unlock(&pipeline.lock);
+    return s;
+}
+
+// puts a slot on a queue for the next stage
+static void give(queue *q, int s) {
+    mtx_lock(&pipeline.lock);
+    push(q, s);
+    cnd_broadcast(&pipeline.changed);
+    mtx_unlock(&pipeline.lock);
+}
+
+// notes that a thread will put no more slots on a queue
+static void finish(int *producers) {
+    mtx_lock(&pipeline.lock);
+    (*producers)--;
+    cnd_broadcast(&pipeline.changed);
+    mtx_unlock(&pipeline.lock);
+}
+
+// reads a whole file into a slot's buffer, growing it if needed. returns
+// false if it can't be read
+static bool readFile(char filename[], slot *s) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    bool readable = fstat(fd, &info) == 0;
+    size_t size = readable ? (size_t) info.st_size : 0;
+    if (size > s->capacity) {
+        free(s->input);
+        s->input = malloc(size);
+        s->capacity = (s->input == NULL) ? 0 : size;
+        readable = s->input != NULL;
+    }
+    s->length = 0;
+    while (readable && s->length < size) {
+        ssize_t got = read(fd, s->input + s->length, size - s->length);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) readable = false;
+        else s->length += got;
+    }
+    close(fd);
+    return readable;
+}
+
+// writes a slot's .sk file beside its .pgm, returning false if it can't be
+static bool writeFile(slot *s) {
+    char *filein = pipeline.files[s->file];
+    char fileout[strlen(filein) + 1];
+    outputFiletype(filein, fileout, SK);
+    int fd = open(fileout, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool written = true;
+    for (size_t done = 0; written && done < s->outputLength; ) {
+        ssize_t put = write(fd, s->output + done, s->outputLength - done);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) written = false;
+        else done += put;
+    }
+    return close(fd) == 0 && written;
+}
+
+// encodes the .pgm file in a slot into a .sk file in memory
+static void encodeSlot(slot *s, batchOptions *o) {
+    s->output = NULL;
+    s->outputLength = 0;
+    if (!s->loaded || s->length == 0) return;
+    FILE *in = fmemopen(s->input, s->length, "rb");
+    int width, height;
+    bool valid = readPGMHeader(in, &width, &height)
+        && s->length - ftell(in) >= (size_t) width * height;
+    if (valid) {
+        FILE *out = open_memstream(&s->output, &s->outputLength);
+        // no other thread uses these streams, so take their locks once
+        // rather than for every byte
+        flockfile(in);
+        flockfile(out);
+        setDeadline(o->deadlineMs);
+        if (o->stripeHeight > 0) {
+            writePGMToSK(in, out, width, height, STRIPES, o->stripeHeight, USING_LINES, 0, false);
+        }
+        else writePGMToSK(in, out, width, height, o->method, STRIPE_HEIGHT, USING_LINES,
+                          o->levels, o->dithering);
+        funlockfile(out);
+        funlockfile(in);
+        fclose(out);
+    }
+    fclose(in);
+
+    if (valid && o->packing && s->outputLength > 0) {
+        FILE *plain = fmemopen(s->output, s->outputLength, "rb");
+        char *packed;
+        size_t packedLength;
+        FILE *envelope = open_memstream(&packed, &packedLength);
+        packSK(plain, envelope);
+        fclose(envelope);
+        fclose(plain);
+        free(s->output);
+        s->output = packed;
+        s->outputLength = packedLength;
+    }
+}
+
+// reads every file of the batch in turn into the next empty slot
+static int readAhead(void *unused) {
+    (void) unused;
+    for (int i=0; i<pipeline.count; i++) {
+        int n = take(&pipeline.empty, &pipeline.writers);
+        slot *s = &pipeline.slots[n];
+        s->file = i;
+        s->loaded = parseFiletype(pipeline.files[i]) == PGM && readFile(pipeline.files[i], s);
+        give(&pipeline.read, n);
+    }
+    finish(&pipeline.readers);
+    return 0;
+}
+
+// reports on a slot's file, writing its .sk if it was encoded. returns
+// false if it couldn't be converted
+static bool deliver(slot *s) {
+    char *filename = pipeline.files[s->file];
+    bool converted = false;
+    if (!s->loaded) printf("Error: %s could not be read as a .pgm file\n", filename);
+    else if (s->output == NULL) printf("Error: %s is not a valid .pgm file\n", filename);
+    else if (!writeFile(s)) printf("Error: the .sk file for %s could not be written\n", filename);
+    else converted = true;
+    free(s->output);
+    return converted;
+}
+
+// encodes slots as they are read until every file has been
+static int encode(void *unused) {
+    (void) unused;
+    for (int n = take(&pipeline.read, &pipeline.readers); n >= 0;
+         n = take(&pipeline.read, &pipeline.readers)) {
+        encodeSlot(&pipeline.slots[n], pipeline.options);
+        give(&pipeline.encoded, n);
+    }
+    finish(&pipeline.workers);
+    return 0;
+}
+
+// starts a thread running a stage, counting it among the stage's PRODUCERS
+// before it can finish. returns false, leaving the count as it was, if the
+// thread can't be started
+static bool startStage(thrd_t *thread, thrd_start_t stage, int *producers) {
+    mtx_lock(&pipeline.lock);
+    (*producers)++;
+    mtx_unlock(&pipeline.lock);
+    if (thrd_create(thread, stage, NULL) == thrd_success) return true;
+    finish(producers);
+    return false;
+}
+
+// converts COUNT .pgm files to .sk files beside them, printing any that
+// can't be converted. returns the number converted
+int convertBatch(int count, char *files[count], batchOptions *options) {
+    int workers = (options->workers > 0) ? options->workers : sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    int slots = workers * BUFFERS_PER_WORKER + 2; // and one being read, one being written
+    pipeline = (struct pipeline) {.slots = calloc(slots, sizeof(slot)), .writers = 1,
+                                  .readers = 0, .workers = 0, .files = files,
+                                  .count = count, .options = options};
+    queue *queues[] = {&pipeline.empty, &pipeline.read, &pipeline.encoded};
+    for (int q=0; q<3; q++) *queues[q] = (queue) {malloc(slots * sizeof(int)), 0, 0, slots};
+    for (int s=0; s<slots; s++) push(&pipeline.empty, s);
+    mtx_init(&pipeline.lock, mtx_plain);
+    cnd_init(&pipeline.changed);
+
+    // only threads that start are counted, so no stage waits on one that
+    // never will. encoders are only started once there is a reader to feed them
+    thrd_t reader;
+    bool reading = startStage(&reader, readAhead, &pipeline.readers);
+    thrd_t *encoders = malloc(workers * sizeof(thrd_t));
+    int started = 0;
+    for (int w=0; w<workers && reading; w++) {
+        if (startStage(&encoders[started], encode, &pipeline.workers)) started++;
+    }
+
+    int converted = 0;
+    if (!reading) {
+        // no threads at all, so each file is read, encoded and written in turn
+        for (int i=0; i<count; i++) {
+            slot *s = &pipeline.slots[0];
+            s->file = i;
+            s->loaded = parseFiletype(files[i]) == PGM && readFile(files[i], s);
+            encodeSlot(s, options);
+            converted += deliver(s);
+        }
+    }
+    else if (started == 0) {
+        // no encoders, so this thread encodes each file as it is read
+        for (int n = take(&pipeline.read, &pipeline.readers); n >= 0;
+             n = take(&pipeline.read, &pipeline.readers)) {
+            encodeSlot(&pipeline.slots[n], options);
+            converted += deliver(&pipeline.slots[n]);
+            give(&pipeline.empty, n);
+        }
+    }
+    else {
+        // each .sk is written on this thread as soon as it is encoded
+        for (int n = take(&pipeline.encoded, &pipeline.workers); n >= 0;
+             n = take(&pipeline.encoded, &pipeline.workers)) {
+            converted += deliver(&pipeline.slots[n]);
+            give(&pipeline.empty, n);
+        }
+    }
+
+    if (reading) thrd_join(reader, NULL);
+    for (int w=0; w<started; w++) thrd_join(encoders[w], NULL);
+    free(encoders);
+    for (int s=0; s<slots; s++) free(pipeline.slots[s].input);
+    for (int q=0; q<3; q++) free(queues[q]->slots);
+    free(pipeline.slots);
+    mtx_destroy(&pipeline.lock);
+    cnd_destroy(&pipeline.changed);
+    return converted;
+}
@@ -0,0 +1,29 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// A batch converts many .pgm files to .sk files beside them as a pipeline:
+// one thread reads files ahead into a fixed set of buffers, worker threads
+// encode them from memory, and another thread writes each .sk out as soon as
+// it is finished. The encoders never wait on the filesystem, and reading,
+// encoding and writing all overlap, so a batch keeps both the disk and every
+// CPU busy. Buffers are reused from one file to the next, so the memory
+// taken depends on the number of workers, not the number of files.
+
+#include <stdbool.h>
+
+// how every file of a batch is converted
+typedef struct batchOptions {
+    int method; // the algorithm, as given to writePGMToSK
+    int stripeHeight; // rows read at a time, if converting in stripes, or 0
+    int levels; // greys to reduce each image to first, or 0 to keep every grey
+    bool dithering;
+    bool packing; // write each .sk in an envelope
+    long deadlineMs; // time limit for each file, or 0 for none
+    int workers; // encoding threads, or 0 for one a CPU
+} batchOptions;
+
+// converts COUNT .pgm files to .sk files beside them, printing any that
+// can't be converted. returns the number converted
+int convertBatch(int count, char *files[count], batchOptions *options);
+
+#endif
@@ -0,0 +1,238 @@
+// End-to-end benchmark of the converter. Generates the same corpus of images
+// every run, converts each to a .sk with every algorithm and back again, and
+// prints the results as a JSON array.
+#define _POSIX_C_SOURCE 200809L
+#include "converter.h"
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define CORPUS_DIR "bench_corpus"
+#define MIN_SECONDS 0.25 // conversions are repeated until they take this long
+#define MAX_SECONDS 20 // a conversion still going after this long is given up on
+
+typedef void generator(unsigned char *pixels, int width, int height);
+
+typedef struct image { char *name; generator *generate; } image;
+typedef struct imageSize { char *name; int width, height; } imageSize;
+
+// xorshift random numbers, seeded the same every time so every run of the
+// benchmark converts exactly the same images
+static unsigned int seed;
+static unsigned int nextRandom(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+// ten flat horizontal bands of random greys, like bands.pgm
+static void generateBands(unsigned char *pixels, int width, int height) {
+    int bandHeight = (height + 9) / 10;
+    unsigned char grey = 0;
+    for (int i=0; i<height; i++) {
+        if (i % bandHeight == 0) grey = nextRandom() & 0xff;
+        for (int j=0; j<width; j++) pixels[i * width + j] = grey;
+    }
+}
+
+// a smooth diagonal gradient from black to white
+static void generateGradient(unsigned char *pixels, int width, int height) {
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) {
+            pixels[i * width + j] = 255L * (i + j) / (width + height - 2);
+        }
+    }
+}
+
+// every pixel a random grey
+static void generateNoise(unsigned char *pixels, int width, int height) {
+    for (int i=0; i<width * height; i++) pixels[i] = nextRandom() & 0xff;
+}
+
+// the Mandelbrot set, shaded by how quickly each point escapes
+static void generateFractal(unsigned char *pixels, int width, int height) {
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) {
+            double cx = -2.2 + 3.2 * j / width, cy = -1.2 + 2.4 * i / height;
+            double x = 0, y = 0;
+            int n = 0;
+            while (n < 255 && x * x + y * y < 4) {
+                double t = x * x - y * y + cx;
+                y = 2 * x * y + cy;
+                x = t;
+                n++;
+            }
+            pixels[i * width + j] = n;
+        }
+    }
+}
+
+// black strokes on white laid out in lines of words, like a page of text
+static void generateText(unsigned char *pixels, int width, int height) {
+    memset(pixels, 255, width * height);
+    // each character is drawn from some of the 7 strokes of a 6x10 cell
+    int strokes[7][4] = {
+        {0, 0, 5, 0}, {0, 4, 5, 4}, {0, 9, 5, 9},
+        {0, 0, 0, 4}, {5, 0, 5, 4}, {0, 4, 0, 9}, {5, 4, 5, 9}
+    };
+    for (int top=4; top + 10 < height; top += 16) {
+        for (int left=4; left + 6 < width; left += 8) {
+            if (nextRandom() % 6 == 0) continue; // gap between words
+            unsigned int shape = nextRandom();
+            for (int s=0; s<7; s++) {
+                if (!((shape >> s) & 1)) continue;
+                for (int y=strokes[s][1]; y<=strokes[s][3]; y++) {
+                    for (int x=strokes[s][0]; x<=strokes[s][2]; x++) {
+                        pixels[(top + y) * width + left + x] = 0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// soft overlapping blobs of light on a gradient, with a little sensor noise
+static void generatePhoto(unsigned char *pixels, int width, int height) {
+    double blobs[8][4];
+    for (int b=0; b<8; b++) {
+        blobs[b][0] = nextRandom() % width;
+        blobs[b][1] = nextRandom() % height;
+        blobs[b][2] = (width + height) / 16.0 * (1 + nextRandom() % 4);
+        blobs[b][3] = (int) (nextRandom() % 160) - 80;
+    }
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) {
+            double grey = 60 + 120.0 * i / height;
+            for (int b=0; b<8; b++) {
+                double dx = j - blobs[b][0], dy = i - blobs[b][1];
+                grey += blobs[b][3] * exp(-(dx * dx + dy * dy) / (blobs[b][2] * blobs[b][2]));
+            }
+            grey += (int) (nextRandom() % 9) - 4;
+            pixels[i * width + j] = (grey < 0) ? 0 : (grey > 255) ? 255 : grey;
+        }
+    }
+}
+
+static const image IMAGES[] = {
+    {"bands", generateBands}, {"gradient", generateGradient},
+    {"noise", generateNoise}, {"fractal", generateFractal},
+    {"text", generateText}, {"photo", generatePhoto}
+};
+static const imageSize SIZES[] = {
+    {"200x200", 200, 200}, {"1080p", 1920, 1080}, {"4k", 3840, 2160}
+};
+static char *METHOD_NAMES[] = {"RLE", "BOX", "STRIPES"};
+
+// seconds since some fixed point in time
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// writes pixels to a .pgm file
+static void writePGM(char filename[], unsigned char *pixels, int width, int height) {
+    FILE *out = fopen(filename, "wb");
+    fprintf(out, "P5 %d %d 255\n", width, height);
+    fwrite(pixels, 1, width * height, out);
+    fclose(out);
+}
+
+// checks a .pgm file holds exactly the given pixels
+static bool matchesPGM(char filename[], unsigned char *pixels, int width, int height) {
+    FILE *in = fopen(filename, "rb");
+    char header[MAX_PGM_HEADER_CHARS];
+    fgets(header, MAX_PGM_HEADER_CHARS, in);
+    bool matches = true;
+    for (int i=0; i<width * height && matches; i++) matches = fgetc(in) == pixels[i];
+    fclose(in);
+    return matches;
+}
+
+// converts one image with one algorithm, there and back, printing the results
+static void benchmark(image im, imageSize size, int method) {
+    int pixelCount = size.width * size.height;
+    unsigned char *pixels = malloc(pixelCount);
+    seed = 2023;
+    im.generate(pixels, size.width, size.height);
+
+    char pgm[MAX_FILENAME_LENGTH], sk[MAX_FILENAME_LENGTH];
+    sprintf(pgm, "%s/%s-%s.pgm", CORPUS_DIR, im.name, size.name);
+    outputFiletype(pgm, sk, SK);
+
+    writePGM(pgm, pixels, size.width, size.height);
+    int encodes = 0;
+    double start = now();
+    while (encodes == 0 || now() - start < MIN_SECONDS) {
+        convertToSK(pgm, false, method, USING_LINES);
+        encodes++;
+    }
+    double encodeTime = (now() - start) / encodes;
+
+    int decodes = 0;
+    start = now();
+    while (decodes == 0 || now() - start < MIN_SECONDS) {
+        convertToPGM(sk, false, size.width, size.height, 1);
+        decodes++;
+    }
+    double decodeTime = (now() - start) / decodes;
+
+    struct stat skStat;
+    stat(sk, &skStat);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("  {\"image\": \"%s\", \"size\": \"%s\", \"width\": %d, \"height\": %d, "
+           "\"method\": \"%s\", \"encode_mb_s\": %.3f, \"decode_mb_s\": %.3f, "
+           "\"sk_bytes\": %ld, \"bytes_per_pixel\": %.4f, \"peak_rss_kb\": %ld, "
+           "\"round_trip\": %s}",
+           im.name, size.name, size.width, size.height, METHOD_NAMES[method],
+           pixelCount / encodeTime / 1e6, pixelCount / decodeTime / 1e6,
+           (long) skStat.st_size, (double) skStat.st_size / pixelCount,
+           usage.ru_maxrss,
+           matchesPGM(pgm, pixels, size.width, size.height) ? "true" : "false");
+    free(pixels);
+}
+
+int main(void) {
+    mkdir(CORPUS_DIR, 0755);
+    setbuf(stdout, NULL);
+    printf("[\n");
+    bool first = true;
+    int images = sizeof(IMAGES) / sizeof(image);
+    int sizes = sizeof(SIZES) / sizeof(imageSize);
+    for (int s=0; s<sizes; s++) {
+        for (int i=0; i<images; i++) {
+            for (int method=RLE; method<=STRIPES; method++) {
+                if (!first) printf(",\n");
+                first = false;
+                // each conversion runs in its own process, so peak memory is
+                // measured per conversion and a crash is reported, not fatal
+                pid_t child = fork();
+                if (child == 0) {
+                    alarm(MAX_SECONDS);
+                    benchmark(IMAGES[i], SIZES[s], method);
+                    exit(0);
+                }
+                int status;
+                waitpid(child, &status, 0);
+                if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
+                    printf("  {\"image\": \"%s\", \"size\": \"%s\", \"method\": \"%s\", "
+                           "\"skipped\": \"took longer than %d seconds\"}",
+                           IMAGES[i].name, SIZES[s].name, METHOD_NAMES[method], MAX_SECONDS);
+                }
+                else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    printf("  {\"image\": \"%s\", \"size\": \"%s\", \"method\": \"%s\", "
+                           "\"error\": \"conversion did not finish\"}",
+                           IMAGES[i].name, SIZES[s].name, METHOD_NAMES[method]);
+                }
+            }
+        }
+    }
+    printf("\n]\n");
+    return 0;
+}
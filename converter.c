@@ -1,5 +1,18 @@
+#define _POSIX_C_SOURCE 200809L // for open_memstream and fmemopen
+#include "batch.h"
 #include "converter.h"
 #include "converterTest.h"
+#include "envelope.h"
+#include "interpreter.h"
+#include "overdraw.h"
+#include "quantise.h"
+#include "seekindex.h"
+#include "stats.h"
+#include "trace.h"
+#include <limits.h>
+#include <math.h>
+#include <threads.h>
+#include <time.h>
 
 const bool USING_LINES = true;
 
@@ -15,9 +28,18 @@ const int MAX_DX = 31;
 
 const int CORRECT = -1; // constants for BOX algorithm
 const int FIXED = -2;
-const int NOT_FOUND = 255;
+const int NOT_FOUND = -1;
 
-// takes a filename and determines whether it is a .sk or a .pgm
+const int STRIPE_HEIGHT = 64; // rows read at a time by the STRIPES algorithm
+const int ORDER_PASSES = 4; // most passes the exhaustive effort makes over the colour order
+
+const int DIRTY_TILE = 16; // size of the squares changes between frames are found in
+const int KEYFRAME_INTERVAL = 30; // frames between each one drawn in full
+
+// when encoding has to be finished by, in seconds, or 0 if there is no limit
+static _Thread_local double deadline = 0;
+
+// takes a filename and determines whether it is a .sk, a .pgm, a .ppm or a .pam
 int parseFiletype(char filename[]) {
     int len = strlen(filename);
 
@@ -26,6 +48,9 @@ int parseFiletype(char filename[]) {
 
     if (len > 4 && filename[len-4] == '.' && filename[len-3] == 'p' 
         && filename[len-2] == 'g' && filename[len-1] == 'm') return PGM;
+
+    if (len > 4 && strcmp(&filename[len-4], ".ppm") == 0) return PPM;
+    if (len > 4 && strcmp(&filename[len-4], ".pam") == 0) return PAM;
     
     else return INVALID;
 }
@@ -56,38 +81,205 @@ unsigned int greyscaleToRGBA(unsigned char g) {
     return result;
 }
 
-// initialise 200x200 pixel grid based on sk file input stream
-board initialiseBoard(FILE *in) {
-    board b = malloc(HEIGHT * sizeof(int*));
-    for(int i=0; i<HEIGHT; i++) {
-        b[i] = malloc(WIDTH * sizeof(int));
-        for (int j=0; j<WIDTH; j++) {b[i][j] = fgetc(in);}
+// finds the RGBA of a value in a palette, or of a grey if there is none
+static unsigned int paletteRGBA(unsigned int palette[], int value) {
+    return (palette == NULL) ? greyscaleToRGBA(value) : palette[value];
+}
+
+// finds the RGBA of a value a pixel of a board holds
+unsigned int boardRGBA(board b, int value) {
+    return paletteRGBA(b.palette, value);
+}
+
+// reads the header of a .pgm file, finding the size of the image. returns
+// false unless it is a binary greyscale image with max greyscale value 255
+bool readPGMHeader(FILE *in, int *width, int *height) {
+    int maxGrey;
+    if (fscanf(in, "P5 %d %d %d", width, height, &maxGrey) != 3) return false;
+    // a single whitespace character separates the header from the pixels
+    int separator = fgetc(in);
+    return *width > 0 && *height > 0 && maxGrey == 255
+        && (separator == ' ' || separator == '\n' || separator == '\t' || separator == '\r');
+}
+
+// reads the fields of a .pam header after its P7, up to ENDHDR, skipping any
+// comments. returns false if a field is unknown, or the depth doesn't match
+// the tuple type
+static bool readPAMFields(FILE *in, int *width, int *height, int *channels, int *maxValue) {
+    char field[16], tupleType[16] = "";
+    *width = *height = *channels = *maxValue = 0;
+    while (fscanf(in, " %15s", field) == 1) {
+        if (field[0] == '#') {
+            for (int ch = fgetc(in); ch != '\n' && ch != EOF; ch = fgetc(in));
+        }
+        else if (strcmp(field, "ENDHDR") == 0) {
+            // the pixels start on the next line
+            bool known = (*channels == 3 && strcmp(tupleType, "RGB") == 0)
+                || (*channels == 4 && strcmp(tupleType, "RGB_ALPHA") == 0);
+            return fgetc(in) == '\n' && known;
+        }
+        else if (strcmp(field, "WIDTH") == 0) fscanf(in, "%d", width);
+        else if (strcmp(field, "HEIGHT") == 0) fscanf(in, "%d", height);
+        else if (strcmp(field, "DEPTH") == 0) fscanf(in, "%d", channels);
+        else if (strcmp(field, "MAXVAL") == 0) fscanf(in, "%d", maxValue);
+        else if (strcmp(field, "TUPLTYPE") == 0) fscanf(in, " %15s", tupleType);
+        else return false;
+    }
+    return false;
+}
+
+// reads the header of a .ppm or .pam file, finding the size of the image and
+// the CHANNELS of each pixel, 3 for RGB or 4 for RGB with alpha. returns
+// false unless it is a binary image with max value 255
+bool readColourHeader(FILE *in, int *width, int *height, int *channels) {
+    char magic[3] = "";
+    if (fscanf(in, "%2s", magic) != 1) return false;
+    int maxValue;
+    bool valid;
+    if (strcmp(magic, "P7") == 0) valid = readPAMFields(in, width, height, channels, &maxValue);
+    else {
+        *channels = 3;
+        valid = strcmp(magic, "P6") == 0 && fscanf(in, "%d %d %d", width, height, &maxValue) == 3;
+        // a single whitespace character separates the header from the pixels
+        int separator = fgetc(in);
+        valid = valid && (separator == ' ' || separator == '\n' || separator == '\t'
+                          || separator == '\r');
+    }
+    return valid && *width > 0 && *height > 0 && maxValue == 255;
+}
+
+// allocates a board of greys of the given size with every pixel set to 0,
+// or one with no pixels if out of memory
+board newBoard(int width, int height) {
+    board b = {width, height, calloc(height, sizeof(int*)), NULL, GREYSCALE_COLOURS};
+    if (b.pixels == NULL) return b;
+    for(int i=0; i<height; i++) {
+        b.pixels[i] = calloc(width, sizeof(int));
+        if (b.pixels[i] == NULL) {
+            freeBoard(b);
+            b.pixels = NULL;
+            return b;
+        }
     }
     return b;
 }
 
-// free allocated memory of a board pointer
+// initialise pixel grid of the given size based on pgm file input stream
+board initialiseBoard(FILE *in, int width, int height) {
+    board b = newBoard(width, height);
+    for(int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) {b.pixels[i][j] = fgetc(in);}
+    }
+    return b;
+}
+
+// the distinct colours of a colour image as they are found, with a hash
+// table from each RGBA to its place in the palette, kept at most half full
+// so probes stay short
+typedef struct colourTable {
+    unsigned int *palette; // each colour, in the order found
+    int count, capacity;
+    int *slots; // a place in the palette plus one, or 0 if empty
+    unsigned int mask; // slots - 1, a power of two less one
+} colourTable;
+
+// the number of slots a colour table starts with, a power of two
+static const int COLOUR_TABLE_SLOTS = 1024;
+
+// finds the slot a colour is in, or the empty one it would go in
+static int colourSlot(colourTable *t, unsigned int rgba) {
+    // Fibonacci hashing spreads colours that differ in one channel apart
+    unsigned int hash = rgba * 2654435769u;
+    unsigned int slot = (hash ^ hash >> 16) & t->mask;
+    while (t->slots[slot] != 0 && t->palette[t->slots[slot] - 1] != rgba) {
+        slot = (slot + 1) & t->mask;
+    }
+    return slot;
+}
+
+// finds a colour's place in the palette, adding it if it is new
+static int colourPlace(colourTable *t, unsigned int rgba) {
+    int slot = colourSlot(t, rgba);
+    if (t->slots[slot] != 0) return t->slots[slot] - 1;
+    if (t->count == t->capacity) {
+        t->capacity *= 2;
+        t->palette = realloc(t->palette, t->capacity * sizeof(unsigned int));
+    }
+    t->palette[t->count++] = rgba;
+    t->slots[slot] = t->count;
+    // rehash every colour into twice as many slots once half full
+    if (2 * (unsigned int) t->count > t->mask) {
+        free(t->slots);
+        t->mask = 2 * t->mask + 1;
+        t->slots = calloc(t->mask + 1, sizeof(int));
+        for (int i=0; i<t->count; i++) t->slots[colourSlot(t, t->palette[i])] = i + 1;
+    }
+    return t->count - 1;
+}
+
+// initialise pixel grid of the given size based on a .ppm or .pam file input
+// stream with CHANNELS bytes a pixel. each distinct colour is given a place
+// in the board's palette, found in a hash table as the pixels are read, and
+// its pixels are set to that place
+board initialiseColourBoard(FILE *in, int width, int height, int channels) {
+    board b = newBoard(width, height);
+    colourTable t = {malloc(COLOUR_TABLE_SLOTS * sizeof(unsigned int)), 0, COLOUR_TABLE_SLOTS,
+                     calloc(COLOUR_TABLE_SLOTS, sizeof(int)), COLOUR_TABLE_SLOTS - 1};
+    // neighbouring pixels are often the same colour, so the last is kept
+    // to skip the table for them
+    unsigned int last = 0;
+    int lastPlace = -1;
+    unsigned char pixel[4];
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) {
+            // any pixels missing from the end of the file are left black
+            if (fread(pixel, 1, channels, in) < (size_t) channels) memset(pixel, 0, channels);
+            unsigned int alpha = (channels == 4) ? pixel[3] : 0xff;
+            unsigned int rgba = (unsigned int) pixel[0] << 24 | pixel[1] << 16 | pixel[2] << 8 | alpha;
+            if (lastPlace < 0 || rgba != last) {
+                last = rgba;
+                lastPlace = colourPlace(&t, rgba);
+            }
+            b.pixels[i][j] = lastPlace;
+        }
+    }
+    free(t.slots);
+    b.palette = realloc(t.palette, t.count * sizeof(unsigned int));
+    b.colours = t.count;
+    return b;
+}
+
+// free allocated memory of a board pointer, and of its palette
 void freeBoard(board b) {
-    for(int i=0; i<HEIGHT; i++) {free(b[i]);}
-    free(b);
+    for(int i=0; i<b.height; i++) {free(b.pixels[i]);}
+    free(b.pixels);
+    free(b.palette);
 }
 
-// initialise all the counts of the 256 colours based on the values
-// currently stored in the board
+// initialise all the counts of the board's colours, the 256 greys unless it
+// has a palette, and the box each lies in, based on the values currently
+// stored in the board, not counting FIXED pixels
 colourInfo *initialiseColourInfo(board b) {
-    colourInfo *c = malloc(GREYSCALE_COLOURS * sizeof(colourInfo));
+    colourInfo *c = malloc(b.colours * sizeof(colourInfo));
 
-    // first initialise the 256 colours and set counts to 0;
-    for (int i=0; i<GREYSCALE_COLOURS; i++) {
-        c[i].greyValue = i;
-        c[i].count = 0;
+    // first initialise the colours and set counts to 0, with boxes that
+    // hold nothing until a pixel is seen
+    for (int i=0; i<b.colours; i++) {
+        c[i] = (colourInfo) {i, 0, {b.width, b.height}, {0, 0}};
     }
 
-    // increment the count of that colour every time it's seen in the board
-    for (int i=0; i<HEIGHT; i++) {
-        for (int j=0; j<WIDTH; j++) {
-            int colour = b[i][j];
-            c[colour].count += 1;
+    // increment the count of that colour every time it's seen in the board,
+    // growing its box to take the pixel in
+    for (int i=0; i<b.height; i++) {
+        for (int j=0; j<b.width; j++) {
+            int colour = b.pixels[i][j];
+            if (colour == FIXED) continue;
+            colourInfo *info = &c[colour];
+            info->count += 1;
+            if (j < info->from.x) info->from.x = j;
+            if (i < info->from.y) info->from.y = i;
+            if (j >= info->to.x) info->to.x = j + 1;
+            if (i >= info->to.y) info->to.y = i + 1;
         }
     }
     return c;
@@ -141,41 +333,114 @@ void move(FILE *out, int pixels, const int axisCode) {
 // writes to .sk file commands to draw an image from .pgm file
 // using run length encoding (RLE) algorithm
 void writeToSK_RLE(FILE *out, board b) {
-    unsigned char currentColour = 255; 
-    for (int i=0; i<HEIGHT; i++) {
+    int currentColour = -1; // no colour set yet, so the first is always written
+    for (int i=0; i<b.width; i++) {
         // recheck for colour mismatch at the start of every column
-        if (currentColour != b[0][i]) {
-            currentColour = b[0][i];
-            writeColour(out, greyscaleToRGBA(currentColour));
+        if (currentColour != b.pixels[0][i]) {
+            currentColour = b.pixels[0][i];
+            writeColour(out, boardRGBA(b, currentColour));
             }
         int dy = 0;
         // scan vertically down as dy updates current x and y but not dx
-        for (int j=0; j<WIDTH; j++) {
+        for (int j=0; j<b.height; j++) {
             // if different colour detected, draw a line downwards 
             // to the current point then change the colour
-            if (currentColour != b[j][i]) {
+            if (currentColour != b.pixels[j][i]) {
+                COUNT_DRAW(currentColour);
                 move(out, dy, DY);
                 dy = 1;
-                currentColour = b[j][i];
-                writeColour(out, greyscaleToRGBA(currentColour));
+                currentColour = b.pixels[j][i];
+                writeColour(out, boardRGBA(b, currentColour));
             }
             else dy++;
         }
         // once reached the bottom of the image, draw a line and reset to the top
+        COUNT_DRAW(currentColour);
         move(out, dy, DY);            
-        if (i < 199) resety(out);
+        if (i < b.width - 1) resety(out);
     }       
 }
 
+// moves back to the left of the board, one row down from the current position
+void resetx(FILE *out) {
+    fputc(0x80, out); // set tool to NONE
+    fputc(0x84, out); // set targetX to 0
+    fputc(0x41, out); // dy by 1, moving to (0, y+1)
+    fputc(0x81, out); // set tool to LINE
+}
+
+// writes to .sk file commands to draw one row of pixels from left to right,
+// as a line for each run of the same colour. COLOUR is the colour currently
+// set, and is updated as it changes. the pixels are places in PALETTE, or
+// greys if it is NULL
+void writeRowRuns(FILE *out, int row[], int width, int *colour, unsigned int palette[]) {
+    // recheck for colour mismatch at the start of every row
+    if (*colour != row[0]) {
+        *colour = row[0];
+        writeColour(out, paletteRGBA(palette, *colour));
+    }
+    int dx = 0;
+    for (int i=0; i<width; i++) {
+        // if different colour detected, draw a line right to the current
+        // point, which the next line draws over, then change the colour
+        if (*colour != row[i]) {
+            COUNT_DRAW(*colour);
+            move(out, dx, DX);
+            move(out, 0, DY); // DY draws the line
+            dx = 1;
+            *colour = row[i];
+            writeColour(out, paletteRGBA(palette, *colour));
+        }
+        else dx++;
+    }
+    COUNT_DRAW(*colour);
+    move(out, dx, DX);
+    move(out, 0, DY);
+}
+
+// writes to .sk file commands to draw an image from .pgm file using run
+// length encoding along rows, the same commands as writeToSK_Stripes
+void writeToSK_Rows(FILE *out, board b) {
+    int colour = -1; // no colour set yet, so the first is always written
+    for (int i=0; i<b.height; i++) {
+        writeRowRuns(out, b.pixels[i], b.width, &colour, b.palette);
+        if (i < b.height - 1) resetx(out);
+    }
+}
+
+// writes to .sk file commands to draw the pixels of a .pgm file, read after
+// its header, using run length encoding along rows. only STRIPEHEIGHT rows
+// are held in memory at a time, so images of any size can be converted
+void writeToSK_Stripes(FILE *in, FILE *out, int width, int height, int stripeHeight) {
+    unsigned char *stripe = malloc((size_t) width * stripeHeight);
+    int *row = malloc(width * sizeof(int));
+    int colour = -1; // no colour set yet, so the first is always written
+    for (int top=0; top<height; top+=stripeHeight) {
+        int rows = (height - top < stripeHeight) ? height - top : stripeHeight;
+        size_t got = fread(stripe, 1, (size_t) width * rows, in);
+        // any pixels missing from the end of the file are left black
+        memset(&stripe[got], 0, (size_t) width * rows - got);
+        for (int i=0; i<rows; i++) {
+            for (int j=0; j<width; j++) row[j] = stripe[(size_t) i * width + j];
+            writeRowRuns(out, row, width, &colour, NULL);
+            if (top + i < height - 1) resetx(out);
+        }
+    }
+    free(row);
+    free(stripe);
+}
+
 // writes to .sk file commands to set location to POS in the x or y direction
-void set(FILE *out, unsigned char pos, int AxisCode) {
+void set(FILE *out, int pos, int AxisCode) {
     unsigned char dataOpcode = DATA << SKETCH_DATA_BITS;
     unsigned char AxisCommand = (TOOL << SKETCH_DATA_BITS) + AxisCode;
-    // 95-199: 2 data commands (3-4 bytes)
+    // 95-4095: 2 data commands (3-4 bytes), and one more for every 6 bits after
     if (pos > SKETCH_DATA_MAX + MAX_DX) {
-        fputc(dataOpcode + (pos >> SKETCH_DATA_BITS), out);
-        pos &= SKETCH_DATA_MAX;
-        fputc(dataOpcode + pos, out);
+        int shift = SKETCH_DATA_BITS;
+        while (pos >> shift > SKETCH_DATA_MAX) shift += SKETCH_DATA_BITS;
+        for (; shift >= 0; shift -= SKETCH_DATA_BITS) {
+            fputc(dataOpcode + ((pos >> shift) & SKETCH_DATA_MAX), out);
+        }
         fputc(AxisCommand, out);
         // need to call DY to update position if not already called
         if (AxisCode == TARGETY) fputc(0x40, out); 
@@ -186,9 +451,7 @@ void set(FILE *out, unsigned char pos, int AxisCode) {
         fputc(dataOpcode + operand, out);
         fputc(AxisCommand, out);
 
-        if (AxisCode == TARGETX) AxisCode = DX;
-        else if (AxisCode == TARGETY) AxisCode = DY;
-        else exit(-1);
+        AxisCode = (AxisCode == TARGETX) ? DX : DY;
         int pixels = pos - operand;
         move(out, pixels, AxisCode);
     }
@@ -223,50 +486,132 @@ void changePosition(FILE *out, position *current, position next, bool drawingBox
     *current = next;
 }
 
-// sets all CORRECT pixels in a board to be FIXED 
-void finalise(board b) {
-    for (int i=0; i<HEIGHT; i++) {
-        for (int j=0; j<WIDTH; j++) {
-            if (b[i][j] == CORRECT) b[i][j] = FIXED;
+// counts the bytes move writes
+static long moveLength(int pixels, const int axisCode) {
+    if (pixels == 0) return (axisCode == DY) ? 1 : 0;
+    if (pixels > 0) return (pixels + MAX_DX - 1) / MAX_DX;
+    return (pixels + MIN_DX + 1) / MIN_DX;
+}
+
+// counts the bytes set writes
+static long setLength(int pos, int AxisCode) {
+    int moveCode = (AxisCode == TARGETX) ? DX : DY;
+    if (pos > SKETCH_DATA_MAX + MAX_DX) {
+        int shift = SKETCH_DATA_BITS;
+        while (pos >> shift > SKETCH_DATA_MAX) shift += SKETCH_DATA_BITS;
+        return shift / SKETCH_DATA_BITS + 2 + (AxisCode == TARGETY);
+    }
+    else if (pos > MAX_DX) {
+        int operand = (pos > SKETCH_DATA_MAX) ? SKETCH_DATA_MAX : pos;
+        return 2 + moveLength(pos - operand, moveCode);
+    }
+    else return 1 + moveLength(pos, moveCode);
+}
+
+// counts the bytes changePosition writes, without writing them
+long positionLength(position current, position next, bool drawingBox) {
+    int diffX = next.x - current.x;
+    int diffY = next.y - current.y;
+    long length;
+    if (MIN_DX <= diffX && diffX <= MAX_DX) length = moveLength(diffX, DX);
+    else if (0 <= next.x && next.x <= SKETCH_DATA_MAX) length = setLength(next.x, TARGETX);
+    else if (MIN_DX * 2 <= diffX && diffX <= MAX_DX * 2) length = moveLength(diffX, DX);
+    else length = setLength(next.x, TARGETX);
+
+    if (MIN_DX <= diffY && diffY <= MAX_DX) length += moveLength(diffY, DY);
+    else if (!drawingBox && MIN_DX * 3 <= diffY && diffY <= MAX_DX * 3) {
+        length += moveLength(diffY, DY);
+    }
+    else length += setLength(next.y, TARGETY);
+    return length;
+}
+
+// seconds since some fixed point in time
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// makes encoding finish MILLISECONDS from now, refining no further once out
+// of time, or removes the limit if 0
+void setDeadline(long milliseconds) {
+    deadline = (milliseconds > 0) ? now() + milliseconds / 1e3 : 0;
+}
+
+// checks whether encoding has run out of time
+bool pastDeadline(void) {
+    return deadline != 0 && now() >= deadline;
+}
+
+// sets all CORRECT pixels from FROM up to TO in a board to be FIXED
+static void finaliseIn(board b, position from, position to) {
+    COUNT(finalisePasses, 1);
+    beginSpan("finalise");
+    for (int i=from.y; i<to.y; i++) {
+        for (int j=from.x; j<to.x; j++) {
+            if (b.pixels[i][j] == CORRECT) b.pixels[i][j] = FIXED;
         }
     }
+    endSpan();
 }
 
-// finds position in board of the first pixel of a colour, in reading order
-// assuming you read down to the end of the page first then go right
-position findPixel(unsigned char greyValue, board b) {
-    for (int i=0; i<HEIGHT; i++) {
-        for (int j=0; j<WIDTH; j++) {
-            if (b[j][i] == greyValue) {
+// sets all CORRECT pixels in a board to be FIXED 
+void finalise(board b) {
+    finaliseIn(b, (position) {0, 0}, (position) {b.width, b.height});
+}
+
+// findPixel, looking only from FROM up to TO, and starting at AT, which no
+// pixel of the colour comes before
+static position findPixelAfter(int value, board b, position from, position to, position at) {
+    COUNT(findPixelCalls, 1);
+    for (int i=at.x; i<to.x; i++) {
+        for (int j=(i == at.x) ? at.y : from.y; j<to.y; j++) {
+            if (b.pixels[j][i] == value) {
+                COUNT(findPixelCells, (long) (i - at.x) * (to.y - from.y) + j - at.y + 1);
                 return (position) {i, j};
             }
         }
     }
+    COUNT(findPixelCells, (long) (to.x - at.x) * (to.y - from.y) - (at.y - from.y));
     return (position) {NOT_FOUND, NOT_FOUND};
 }
 
-// finds the box with the most unfilled in pixels of a colour without 
-// overrwriting any fixed pixels
-position findBoxEnd(position startPos, board b, unsigned char greyValue) {
+// findPixel, looking only from FROM up to TO
+static position findPixelIn(int value, board b, position from, position to) {
+    return findPixelAfter(value, b, from, to, from);
+}
+
+// finds position in board of the first pixel of a colour, in reading order
+// assuming you read down to the end of the page first then go right
+position findPixel(int value, board b) {
+    return findPixelIn(value, b, (position) {0, 0}, (position) {b.width, b.height});
+}
+
+// findBoxEnd, for a colour whose pixels all lie above and left of TO. a box
+// reaching past them fills no more, so is never the best
+static position findBoxEndIn(position startPos, board b, int value, position to) {
     position endPos = startPos;
     bool validLine = true;
     int maxCount = 0;
-    // iterates through x values
-    for (int i=startPos.x; i<200 && validLine; i++) {
-        if (b[startPos.y][i] == FIXED) validLine = false;
+    // iterates through x values, keeping the best box so far once out of time
+    for (int i=startPos.x; i<to.x && validLine && (i == startPos.x || !pastDeadline()); i++) {
+        COUNT(boxEndCells, 1);
+        if (b.pixels[startPos.y][i] == FIXED) validLine = false;
 
         bool validBox = true;
         int boxCount = 0;
         // iterates through y values
-        for (int j=startPos.y; j<200 && validBox && validLine; j++) {
+        for (int j=startPos.y; j<to.y && validBox && validLine; j++) {
             int lineCount = 0;
             // checks if the line from (startPos.x, j) to (i, j) is valid
             for (int k=startPos.x; k<=i && validBox; k++) {
-                if (b[j][k] == FIXED) {
+                COUNT(boxEndCells, 1);
+                if (b.pixels[j][k] == FIXED) {
                     validBox = false;
                     j--;
                 }
-                else if (b[j][k] == greyValue) lineCount++;
+                else if (b.pixels[j][k] == value) lineCount++;
             }
             // add the line's good pixels to the box's if the line was valid
             if (validBox) boxCount += lineCount;
@@ -281,38 +626,371 @@ position findBoxEnd(position startPos, board b, unsigned char greyValue) {
     return endPos;
 }
 
+// finds the box with the most unfilled in pixels of a colour without 
+// overrwriting any fixed pixels
+position findBoxEnd(position startPos, board b, int value) {
+    return findBoxEndIn(startPos, b, value, (position) {b.width, b.height});
+}
+
 // updates board state given a box that has just been filled with a colour
-void updateBoxBoard(unsigned char colour, position start, position end, board b) {
+void updateBoxBoard(int colour, position start, position end, board b) {
     for (int i=start.y; i<end.y; i++) { 
         for (int j=start.x; j<end.x; j++) {
-            if (b[i][j] == colour) b[i][j] = CORRECT;
+            if (b.pixels[i][j] == colour) b.pixels[i][j] = CORRECT;
         }
     }
 }
 
+// writes to .sk file commands to draw a box from START to END, moving to its
+// start first if needed
+void writeBox(FILE *out, position *currentPos, position start, position end, bool usingLines) {
+    // set tool to NONE and move if you need to move
+    if (!(currentPos->x == start.x && currentPos->y == start.y)) {
+        fputc(0x80, out); 
+        changePosition(out, currentPos, start, false); // goto pixel of colour
+    } 
+    // if block is a single pixel wide, use a LINE instead
+    // this saves a single [DX 1] instruction over using a BLOCK
+    if (start.x + 1 == end.x && usingLines) {
+        fputc(0x81, out);
+        end.x--; end.y--;
+    }
+    else fputc(0x82, out); // set tool to BLOCK otherwise
+    changePosition(out, currentPos, end, true); 
+}
+
+// fillColour, for a colour whose pixels all lie from FROM up to TO
+static void fillColourIn(FILE *out, board b, int value, position from, position to,
+                         position *currentPos, bool usingLines) {
+    position start = findPixelIn(value, b, from, to);
+    while (start.x != NOT_FOUND && !pastDeadline()) {
+        position end = findBoxEndIn(start, b, value, to);
+        updateBoxBoard(value, start, end, b);
+        COUNT_DRAW(value);
+        writeBox(out, currentPos, start, end, usingLines);
+        // the box covers its start, and no pixel of the colour came before it
+        start = findPixelAfter(value, b, from, to, start);
+    }
+}
+
 // writes to .sk file commands to fill all pixels of a certain colour 
-// making sure not to overwrite any fixed pixels
-void fillColour(FILE *out, board b, unsigned char greyValue, position *currentPos, bool usingLines) {
-    position nextPos = findPixel(greyValue, b);
-    while (nextPos.x != NOT_FOUND) {
-        // set tool to NONE and move if you need to move
-        if (!(currentPos->x == nextPos.x && currentPos->y == nextPos.y)) {
-            fputc(0x80, out); 
-            changePosition(out, currentPos, nextPos, false); // goto pixel of colour
-        } 
-        
-        nextPos = findBoxEnd(*currentPos, b, greyValue);
-        updateBoxBoard(greyValue, *currentPos, nextPos, b);
-        // if block is a single pixel wide, use a LINE instead
-        // this saves a single [DX 1] instruction over using a BLOCK
-        if (currentPos->x + 1 == nextPos.x && usingLines) {
-            fputc(0x81, out);
-            nextPos.x--; nextPos.y--;
-        }
-        else fputc(0x82, out); // set tool to BLOCK otherwise
-        changePosition(out, currentPos, nextPos, true); 
-        nextPos = findPixel(greyValue, b);
+// making sure not to overwrite any fixed pixels. stops early once out of
+// time, leaving the rest to finishInRows
+void fillColour(FILE *out, board b, int value, position *currentPos, bool usingLines) {
+    fillColourIn(out, b, value, (position) {0, 0}, (position) {b.width, b.height}, currentPos,
+                 usingLines);
+}
+
+// counts the bytes taken to move from one position to another before a draw
+static long moveBytes(position from, position to) {
+    if (from.x == to.x && from.y == to.y) return 0;
+    return positionLength(from, to, false) + 1; // and setting the tool to NONE
+}
+
+// draws boxes of a colour already found, in a tour that always goes to
+// whichever box is fewest bytes away next, or in the order they were found
+// once out of time
+static void tourBoxes(FILE *out, position (*boxes)[2], int count, int value,
+                      position *currentPos, bool usingLines) {
+    for (int i=0; i<count; i++) {
+        // swap the nearest box left into place
+        int nearest = i;
+        long fewest = LONG_MAX;
+        bool touring = !pastDeadline();
+        for (int j=i; j<count && touring && fewest > 0; j++) {
+            long bytes = moveBytes(*currentPos, boxes[j][0]);
+            if (bytes < fewest) {
+                fewest = bytes;
+                nearest = j;
+            }
+        }
+        position nearestStart = boxes[nearest][0], nearestEnd = boxes[nearest][1];
+        boxes[nearest][0] = boxes[i][0];
+        boxes[nearest][1] = boxes[i][1];
+        COUNT_DRAW(value);
+        writeBox(out, currentPos, nearestStart, nearestEnd, usingLines);
+    }
+}
+
+// fillColourToured, for a colour whose pixels all lie from FROM up to TO
+static void fillColourTouredIn(FILE *out, board b, int value, position from, position to,
+                               position *currentPos, bool usingLines) {
+    int count = 0, capacity = 16;
+    position (*boxes)[2] = malloc(capacity * sizeof(*boxes));
+    position start = findPixelIn(value, b, from, to);
+    while (start.x != NOT_FOUND && !pastDeadline()) {
+        position end = findBoxEndIn(start, b, value, to);
+        updateBoxBoard(value, start, end, b);
+        if (count == capacity) {
+            capacity *= 2;
+            boxes = realloc(boxes, capacity * sizeof(*boxes));
+        }
+        boxes[count][0] = start;
+        boxes[count][1] = end;
+        count++;
+        start = findPixelAfter(value, b, from, to, start);
+    }
+
+    tourBoxes(out, boxes, count, value, currentPos, usingLines);
+    free(boxes);
+}
+
+// writes to .sk file commands to fill all pixels of a certain colour like
+// fillColour, but finds every box first, then draws them in a tour that
+// always goes to whichever box is fewest bytes away next
+void fillColourToured(FILE *out, board b, int value, position *currentPos, bool usingLines) {
+    fillColourTouredIn(out, b, value, (position) {0, 0}, (position) {b.width, b.height},
+                       currentPos, usingLines);
+}
+
+// a box that could be drawn next from a pixel of the colour being drawn,
+// the best findBoxEnd finds with that pixel as its top left corner
+typedef struct candidate {
+    position start, end;
+    int version; // changed whenever the box is found again
+    bool live;
+} candidate;
+
+// a candidate as it was when put in the queue, which is out of date once
+// the candidate's version has moved on
+typedef struct queued {
+    double score;
+    int index, version;
+} queued;
+
+typedef struct candidateQueue {
+    queued *heap; // a binary heap with the highest score first
+    int count, capacity;
+} candidateQueue;
+
+// bytes a move to a box's start is taken to cost when scoring it, as where
+// the last box ends isn't known until boxes are drawn
+static const int BOX_MOVE_BYTES = 3;
+
+static void pushCandidate(candidateQueue *q, queued entry) {
+    if (q->count == q->capacity) {
+        q->capacity *= 2;
+        q->heap = realloc(q->heap, q->capacity * sizeof(queued));
+    }
+    int i = q->count++;
+    while (i > 0 && q->heap[(i - 1) / 2].score < entry.score) {
+        q->heap[i] = q->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    q->heap[i] = entry;
+}
+
+static queued popCandidate(candidateQueue *q) {
+    queued top = q->heap[0], last = q->heap[--q->count];
+    int i = 0;
+    while (2 * i + 1 < q->count) {
+        int child = 2 * i + 1;
+        if (child + 1 < q->count && q->heap[child + 1].score > q->heap[child].score) child++;
+        if (q->heap[child].score <= last.score) break;
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    q->heap[i] = last;
+    return top;
+}
+
+// checks whether a pixel is of a colour and not yet drawn
+static bool undrawn(board b, int x, int y, int value) {
+    return 0 <= x && x < b.width && 0 <= y && y < b.height && b.pixels[y][x] == value;
+}
+
+// checks whether an undrawn pixel of a colour has none to its left or
+// above it, so the boxes found from it are the only ones that can start there
+static bool corner(board b, int x, int y, int value) {
+    return undrawn(b, x, y, value) && !undrawn(b, x - 1, y, value)
+        && !undrawn(b, x, y - 1, value);
+}
+
+// finds the best box from a candidate's start again, and queues it scored
+// by the undrawn pixels it fills per byte it takes to draw. the colour's
+// pixels all lie above and left of TO
+static void findCandidate(candidateQueue *q, candidate *c, int index, board b,
+                          int value, position to, FILE *scratch, bool usingLines) {
+    c->end = findBoxEndIn(c->start, b, value, to);
+    c->version++;
+    long filled = 0;
+    for (int i=c->start.y; i<c->end.y; i++) {
+        for (int j=c->start.x; j<c->end.x; j++) filled += b.pixels[i][j] == value;
+    }
+    rewind(scratch);
+    position at = c->start;
+    writeBox(scratch, &at, c->start, c->end, usingLines);
+    double score = (double) filled / (ftell(scratch) + BOX_MOVE_BYTES);
+    pushCandidate(q, (queued) {score, index, c->version});
+}
+
+// which pixels of the box a colour lies in, from FROM up to TO, have a
+// candidate
+typedef struct anchors {
+    bool *marked;
+    position from, to;
+} anchors;
+
+// whether a pixel of the colour has a candidate
+static bool *anchor(anchors *a, int x, int y) {
+    return &a->marked[(size_t) (y - a->from.y) * (a->to.x - a->from.x) + (x - a->from.x)];
+}
+
+// adds a candidate starting at a corner pixel, growing the list if needed,
+// and marks the pixel as having one
+static void addCandidate(candidateQueue *q, candidate **candidates, int *count, int *capacity,
+                         anchors *anchored, position start, board b, int value,
+                         FILE *scratch, bool usingLines) {
+    if (*count == *capacity) {
+        *capacity *= 2;
+        *candidates = realloc(*candidates, *capacity * sizeof(candidate));
+    }
+    candidate *c = &(*candidates)[*count];
+    *c = (candidate) {start, start, 0, true};
+    findCandidate(q, c, *count, b, value, anchored->to, scratch, usingLines);
+    *anchor(anchored, start.x, start.y) = true;
+    *count += 1;
+}
+
+// fillColourLargestFirst, for a colour whose pixels all lie from FROM up to TO
+static void fillColourLargestFirstIn(FILE *out, board b, int value, position from, position to,
+                                     position *currentPos, bool usingLines) {
+    char *scratchBuffer;
+    size_t scratchLength;
+    FILE *scratch = open_memstream(&scratchBuffer, &scratchLength);
+    candidateQueue q = {malloc(64 * sizeof(queued)), 0, 64};
+    int count = 0, capacity = 64;
+    candidate *candidates = malloc(capacity * sizeof(candidate));
+    // only pixels of the colour are ever marked, and they all lie in its box
+    anchors anchored = {calloc((size_t) (to.x - from.x) * (to.y - from.y), sizeof(bool)), from, to};
+    for (int i=from.y; i<to.y; i++) {
+        for (int j=from.x; j<to.x; j++) {
+            if (!corner(b, j, i, value)) continue;
+            position start = {j, i};
+            addCandidate(&q, &candidates, &count, &capacity, &anchored, start, b, value, scratch,
+                         usingLines);
+        }
+    }
+
+    int boxCount = 0, boxCapacity = 16;
+    position (*boxes)[2] = malloc(boxCapacity * sizeof(*boxes));
+    while (q.count > 0 && !pastDeadline()) {
+        queued best = popCandidate(&q);
+        candidate *c = &candidates[best.index];
+        if (!c->live || best.version != c->version) continue;
+        position start = c->start, end = c->end;
+        c->live = false;
+        *anchor(&anchored, start.x, start.y) = false;
+        updateBoxBoard(value, start, end, b);
+        if (boxCount == boxCapacity) {
+            boxCapacity *= 2;
+            boxes = realloc(boxes, boxCapacity * sizeof(*boxes));
+        }
+        boxes[boxCount][0] = start;
+        boxes[boxCount][1] = end;
+        boxCount++;
+
+        // boxes overlapping the one taken fill fewer pixels now, and those
+        // starting inside it are no longer needed
+        for (int k=0; k<count; k++) {
+            candidate *o = &candidates[k];
+            if (!o->live || o->start.x >= end.x || o->end.x <= start.x
+                || o->start.y >= end.y || o->end.y <= start.y) continue;
+            if (undrawn(b, o->start.x, o->start.y, value)) {
+                findCandidate(&q, o, k, b, value, to, scratch, usingLines);
+            }
+            else {
+                o->live = false;
+                *anchor(&anchored, o->start.x, o->start.y) = false;
+            }
+        }
+        // and the pixels just right of it and below it may be corners now
+        for (int i=start.y; i<end.y; i++) {
+            position right = {end.x, i};
+            if (!corner(b, right.x, right.y, value) || *anchor(&anchored, right.x, right.y)) continue;
+            addCandidate(&q, &candidates, &count, &capacity, &anchored, right, b, value, scratch,
+                         usingLines);
+        }
+        for (int j=start.x; j<end.x; j++) {
+            position below = {j, end.y};
+            if (!corner(b, below.x, below.y, value) || *anchor(&anchored, below.x, below.y)) continue;
+            addCandidate(&q, &candidates, &count, &capacity, &anchored, below, b, value, scratch,
+                         usingLines);
+        }
+    }
+    fclose(scratch);
+    free(scratchBuffer);
+    free(anchored.marked);
+    free(candidates);
+    free(q.heap);
+    tourBoxes(out, boxes, boxCount, value, currentPos, usingLines);
+    free(boxes);
+}
+
+// writes to .sk file commands to fill all pixels of a certain colour like
+// fillColour, but keeps a box from every corner of the pixels left in a
+// queue and always takes the one filling the most pixels per byte, finding
+// again only the boxes that overlap it. the boxes are then toured
+void fillColourLargestFirst(FILE *out, board b, int value, position *currentPos, bool usingLines) {
+    fillColourLargestFirstIn(out, b, value, (position) {0, 0}, (position) {b.width, b.height},
+                             currentPos, usingLines);
+}
+
+// a run of pixels of the same colour along a row, left for finishInRows
+typedef struct run {
+    position start, end;
+    int colour;
+} run;
+
+// writes to .sk file commands to draw every pixel not yet FIXED as a box
+// one pixel high for each run of the same colour along a row, the fastest
+// way to finish a board once out of time. the runs are drawn a colour at a
+// time, in the order the colours are first found, so each colour is only
+// set once
+void finishInRows(FILE *out, board b, position *currentPos, bool usingLines) {
+    int count = 0, capacity = 64;
+    run *runs = malloc(capacity * sizeof(run));
+    // each colour's place in the drawing order, or -1 if it has no runs
+    int *order = malloc(b.colours * sizeof(int));
+    for (int i=0; i<b.colours; i++) order[i] = -1;
+    int colours = 0;
+    for (int i=0; i<b.height; i++) {
+        int j = 0;
+        while (j < b.width) {
+            if (b.pixels[i][j] == FIXED) {
+                j++;
+                continue;
+            }
+            int end = j;
+            while (end + 1 < b.width && b.pixels[i][end + 1] == b.pixels[i][j]) end++;
+            if (count == capacity) {
+                capacity *= 2;
+                runs = realloc(runs, capacity * sizeof(run));
+            }
+            runs[count++] = (run) {{j, i}, {end + 1, i + 1}, b.pixels[i][j]};
+            if (order[b.pixels[i][j]] < 0) order[b.pixels[i][j]] = colours++;
+            j = end + 1;
+        }
     }
+
+    // sort the runs by colour, keeping each colour's in reading order
+    int *first = calloc(colours + 1, sizeof(int)); // where each colour's runs start
+    for (int i=0; i<count; i++) first[order[runs[i].colour] + 1]++;
+    for (int i=0; i<colours; i++) first[i + 1] += first[i];
+    run *sorted = malloc(count * sizeof(run));
+    for (int i=0; i<count; i++) sorted[first[order[runs[i].colour]]++] = runs[i];
+
+    for (int i=0; i<count; i++) {
+        if (i == 0 || sorted[i].colour != sorted[i - 1].colour) {
+            writeColour(out, boardRGBA(b, sorted[i].colour));
+        }
+        COUNT_DRAW(sorted[i].colour);
+        writeBox(out, currentPos, sorted[i].start, sorted[i].end, usingLines);
+    }
+    free(sorted);
+    free(first);
+    free(order);
+    free(runs);
 }
 
 int compareColourInfo(const void *p, const void *q) {
@@ -324,66 +1002,652 @@ int compareColourInfo(const void *p, const void *q) {
     else return 0;
 }
 
-// writes to .sk file commands to draw an image from .pgm file
-// using BOX algorithm
-void writeToSK_BOX(FILE *out, board b, colourInfo c[GREYSCALE_COLOURS], bool usingLines) {
-    // sorts all 256 colours in descending order based on their count
-    qsort(c, GREYSCALE_COLOURS, sizeof(colourInfo), compareColourInfo);
+// checks whether the first colour drawn can fill the entire grid, which it
+// can only do if nothing is FIXED yet
+static bool fillsGrid(board b, colourInfo c[]) {
+    long drawable = 0;
+    for (int i=0; i<b.colours; i++) drawable += c[i].count;
+    return drawable == (long) b.width * b.height;
+}
+
+// writes to .sk file commands to draw one colour using the BOX algorithm,
+// choosing its boxes by SELECTION, or filling the entire grid with it if
+// FILLING, then sets its pixels FIXED
+static void drawColour(FILE *out, board b, colourInfo c, bool filling, position *currentPos,
+                       bool usingLines, int selection) {
+    int colour = c.value;
+    beginValueSpan("fillColour", "grey", colour);
+    writeColour(out, boardRGBA(b, colour));
+    // the colour's pixels are only looked for, and only become
+    // CORRECT, in the box they lie in
+    position from = c.from, to = c.to;
+    // special case for the first colour, just fill the entire grid
+    // with that colour
+    if (filling) {
+        fputc(0x82, out);
+        COUNT_DRAW(colour);
+        updateBoxBoard(colour, *currentPos, (position) {b.width, b.height}, b);
+        changePosition(out, currentPos, (position) {b.width, b.height}, true);
+    }
+    else if (selection == TOURED) {
+        fillColourTouredIn(out, b, colour, from, to, currentPos, usingLines);
+    }
+    else if (selection == LARGEST_FIRST) {
+        fillColourLargestFirstIn(out, b, colour, from, to, currentPos, usingLines);
+    }
+    else fillColourIn(out, b, colour, from, to, currentPos, usingLines);
+    endSpan();
+    // set all CORRECT pixels to FIXED so they don't get overwritten
+    finaliseIn(b, from, to);
+}
+
+// writes to .sk file commands to draw each colour in the order given using
+// the BOX algorithm, choosing each colour's boxes by SELECTION. once out of
+// time, the rest of the board is finished in rows. C has an entry for each
+// of the board's colours
+void writeColours(FILE *out, board b, colourInfo c[], bool usingLines, int selection) {
     position *currentPos = malloc(sizeof(position));
     *currentPos = (position) {0, 0};
-    for (int i=0; i<GREYSCALE_COLOURS; i++) {
+    bool filling = fillsGrid(b, c);
+    for (int i=0; i<b.colours && !pastDeadline(); i++) {
         if (c[i].count > 0) {
-            unsigned char colour = c[i].greyValue;
-            writeColour(out, greyscaleToRGBA(colour));
-            // special case for the first colour, just fill the entire grid
-            // with that colour
-            if (i == 0) {
-                fputc(0x82, out);
-                updateBoxBoard(colour, *currentPos, (position) {HEIGHT, WIDTH}, b);
-                changePosition(out, currentPos, (position) {HEIGHT, WIDTH}, true);
-                }
-            else fillColour(out, b, colour, currentPos, usingLines);
-            finalise(b); // set all CORRECT pixels to FIXED so they don't get overwritten
+            drawColour(out, b, c[i], i == 0 && filling, currentPos, usingLines, selection);
         }
     } 
+    if (pastDeadline()) {
+        beginSpan("finishInRows");
+        finishInRows(out, b, currentPos, usingLines);
+        endSpan();
+    }
     free(currentPos);  
 }
 
-void writeToSK(FILE *out, board b, colourInfo c[GREYSCALE_COLOURS], int method, bool usingLines) {
+// writes to .sk file commands to draw an image from .pgm file
+// using BOX algorithm
+void writeToSK_BOX(FILE *out, board b, colourInfo c[], bool usingLines) {
+    // sorts all the colours in descending order based on their count
+    beginSpan("colour sort");
+    qsort(c, b.colours, sizeof(colourInfo), compareColourInfo);
+    endSpan();
+    writeColours(out, b, c, usingLines, FIRST_PIXEL);
+}
+
+// writes to .sk file commands to draw an image from .pgm file using the BOX
+// algorithm, taking each colour's boxes largest first
+void writeToSK_Largest(FILE *out, board b, colourInfo c[], bool usingLines) {
+    beginSpan("colour sort");
+    qsort(c, b.colours, sizeof(colourInfo), compareColourInfo);
+    endSpan();
+    writeColours(out, b, c, usingLines, LARGEST_FIRST);
+}
+
+// copies the pixels from START up to END of one board onto another of the
+// same size
+static void copyPixelsIn(board to, board from, position start, position end) {
+    for (int i=start.y; i<end.y; i++) {
+        memcpy(to.pixels[i] + start.x, from.pixels[i] + start.x,
+               (end.x - start.x) * sizeof(int));
+    }
+}
+
+// copies every pixel of one board onto another of the same size
+static void copyPixels(board to, board from) {
+    copyPixelsIn(to, from, (position) {0, 0}, (position) {from.width, from.height});
+}
+
+// counts the bytes taken to draw COUNT colours from C onwards, toured, from
+// the board and position the colours before them leave, leaving the board as
+// it was. only the boxes the colours lie in can change, so only they are
+// kept in SAVED while drawing
+static long colourBytes(FILE *scratch, board b, board saved, colourInfo c[], int count,
+                        bool filling, position at, bool usingLines) {
+    position from = c[0].from, to = c[0].to;
+    for (int k=1; k<count; k++) {
+        if (c[k].from.x < from.x) from.x = c[k].from.x;
+        if (c[k].from.y < from.y) from.y = c[k].from.y;
+        if (c[k].to.x > to.x) to.x = c[k].to.x;
+        if (c[k].to.y > to.y) to.y = c[k].to.y;
+    }
+    copyPixelsIn(saved, b, from, to);
+    rewind(scratch);
+    for (int k=0; k<count; k++) {
+        drawColour(scratch, b, c[k], filling && k == 0, &at, usingLines, TOURED);
+    }
+    long bytes = ftell(scratch);
+    copyPixelsIn(b, saved, from, to);
+    return bytes;
+}
+
+// writes to .sk file commands to draw an image from .pgm file using the BOX
+// algorithm, touring each colour's boxes, then keeps swapping neighbouring
+// colours in the drawing order while that writes fewer bytes, until no swap
+// helps, ORDER_PASSES passes have been made or it runs out of time. a swap is
+// judged only by the bytes of the two colours and the one after them, whose
+// tour starts where they end, so a pass costs about eight drawings of the
+// image rather than one per colour. each pass is kept only if the whole
+// sketch then comes out shorter
+void writeToSK_Exhaustive(FILE *out, board b, colourInfo c[], bool usingLines) {
+    beginSpan("colour sort");
+    qsort(c, b.colours, sizeof(colourInfo), compareColourInfo);
+    endSpan();
+    int colours = 0;
+    while (colours < b.colours && c[colours].count > 0) colours++;
+    bool filling = fillsGrid(b, c);
+    board original = newBoard(b.width, b.height);
+    copyPixels(original, b);
+    board saved = newBoard(b.width, b.height);
+    colourInfo *bestOrder = malloc(b.colours * sizeof(colourInfo));
+    memcpy(bestOrder, c, b.colours * sizeof(colourInfo));
+
+    char *best;
+    size_t bestLength;
+    FILE *sketch = open_memstream(&best, &bestLength);
+    writeColours(sketch, b, c, usingLines, TOURED);
+    fclose(sketch);
+
+    char *scratchBuffer;
+    size_t scratchLength;
+    FILE *scratch = open_memstream(&scratchBuffer, &scratchLength);
+    bool improved = true;
+    for (int pass=0; pass < ORDER_PASSES && improved && !pastDeadline(); pass++) {
+        improved = false;
+        // go down the order, drawing each colour once its place is settled
+        copyPixels(b, original);
+        position at = {0, 0};
+        bool reordered = false;
+        for (int i=0; i<colours && !pastDeadline(); i++) {
+            if (i+1 < colours) {
+                int count = (i+2 < colours) ? 3 : 2;
+                beginValueSpan("order trial", "swap", i);
+                long kept = colourBytes(scratch, b, saved, &c[i], count, filling && i == 0, at,
+                                        usingLines);
+                colourInfo swapped = c[i];
+                c[i] = c[i+1];
+                c[i+1] = swapped;
+                long trial = colourBytes(scratch, b, saved, &c[i], count, filling && i == 0, at,
+                                         usingLines);
+                endSpan();
+                if (trial < kept) reordered = true;
+                // otherwise swap them back
+                else {
+                    c[i+1] = c[i];
+                    c[i] = swapped;
+                }
+            }
+            rewind(scratch);
+            drawColour(scratch, b, c[i], filling && i == 0, &at, usingLines, TOURED);
+        }
+        if (!reordered || pastDeadline()) break;
+
+        char *trial;
+        size_t trialLength;
+        copyPixels(b, original);
+        sketch = open_memstream(&trial, &trialLength);
+        beginSpan("order check");
+        writeColours(sketch, b, c, usingLines, TOURED);
+        endSpan();
+        fclose(sketch);
+        if (trialLength < bestLength) {
+            free(best);
+            best = trial;
+            bestLength = trialLength;
+            memcpy(bestOrder, c, b.colours * sizeof(colourInfo));
+            improved = true;
+        }
+        else free(trial);
+    }
+    memcpy(c, bestOrder, b.colours * sizeof(colourInfo));
+    fwrite(best, 1, bestLength, out);
+    fclose(scratch);
+    free(scratchBuffer);
+    free(best);
+    free(bestOrder);
+    freeBoard(saved);
+    freeBoard(original);
+}
+
+void writeToSK(FILE *out, board b, colourInfo c[], int method, bool usingLines) {
     if (method == RLE) writeToSK_RLE(out, b);
     else if (method == BOX) writeToSK_BOX(out, b, c, usingLines);
+    else if (method == STRIPES) writeToSK_Rows(out, b);
+    else if (method == EXHAUSTIVE) writeToSK_Exhaustive(out, b, c, usingLines);
+    else if (method == LARGEST) writeToSK_Largest(out, b, c, usingLines);
 }
 
-// converts a .pgm into a .sk file
-void convertToSK(char filein[], bool confirmation, bool usingLines) {
-    FILE *in = fopen(filein, "r");
+// writes to .sk file commands to draw a board using the given algorithm,
+// then removes any overdraw if REMOVING_OVERDRAW and there is still time.
+// run length encoding only ever draws over the last pixel of each line,
+// which can't be removed without moving, so only boxes are checked
+void writeSketch(FILE *out, board b, int method, bool usingLines) {
+    beginSpan("initialiseColourInfo");
+    colourInfo *c = initialiseColourInfo(b);
+    endSpan();
 
-    // check if the .pgm file is a 200x200 image with max greyscale value 255
-    char header[MAX_PGM_HEADER_CHARS];
-    fgets(header, MAX_PGM_HEADER_CHARS, in);
+    if (REMOVING_OVERDRAW && (method == BOX || method == EXHAUSTIVE || method == LARGEST)) {
+        // write to memory first so the draws can be read back
+        char *commands;
+        size_t length;
+        FILE *sketch = open_memstream(&commands, &length);
+        beginSpan("writeToSK");
+        writeToSK(sketch, b, c, method, usingLines);
+        endSpan();
+        fclose(sketch);
+        if (pastDeadline()) fwrite(commands, 1, length, out);
+        else if (length > 0) {
+            sketch = fmemopen(commands, length, "rb");
+            beginSpan("removeOverdraw");
+            removeOverdraw(sketch, out, b.width, b.height);
+            endSpan();
+            fclose(sketch);
+        }
+        free(commands);
+    }
+    else {
+        beginSpan("writeToSK");
+        writeToSK(out, b, c, method, usingLines);
+        endSpan();
+    }
+    freeColourInfo(c);
+}
 
-    // if so, converts the file to a .sk
-    if (strcmp(header, "P5 200 200 255\n") == 0) {
-        board b = initialiseBoard(in);
-        colourInfo *c = initialiseColourInfo(b);
+// converts a .pgm into a .sk file using the STRIPES algorithm, reading
+// STRIPEHEIGHT rows of the image at a time
+void convertToSKInStripes(char filein[], bool confirmation, int stripeHeight) {
+    FILE *in = fopen(filein, "rb");
+    if (in == NULL) {
+        printf("Error: %s could not be opened\n", filein);
+        return;
+    }
+    beginSpan("header parse");
+    int width, height;
+    bool valid = readPGMHeader(in, &width, &height);
+    endSpan();
 
-        char fileout[MAX_FILENAME_LENGTH];
+    if (valid) {
+        char fileout[strlen(filein) + 1];
         outputFiletype(filein, fileout, SK);
         FILE *out = fopen(fileout, "wb");
-        writeToSK(out, b, c, BOX, usingLines);
-
-        // free all allocated memory, write success message
-        freeBoard(b);
-        freeColourInfo(c);
+        if (out == NULL) {
+            printf("Error: %s could not be written\n", fileout);
+            fclose(in);
+            return;
+        }
+        beginSpan("writeToSK_Stripes");
+        writeToSK_Stripes(in, out, width, height, stripeHeight);
+        endSpan();
+        beginSpan("output write");
+        fclose(out);
+        endSpan();
+        fclose(in);
+        if (confirmation) printf("File %s has been written.\n", fileout);
+    }
+    else {
+        printf("Error: .pgm file header mismatch\n");
         fclose(in);
+    }
+}
+
+// converts a .pgm into a .sk file using the given algorithm
+void convertToSK(char filein[], bool confirmation, int method, bool usingLines) {
+    convertToSKLossy(filein, confirmation, method, usingLines, 0, false);
+}
+
+// converts a .pgm into a .sk file using the given algorithm, first reducing
+// the image to LEVELS greys unless LEVELS is 0. returns the PSNR of the image
+// drawn against the original, which is INFINITY if nothing was lost
+double convertToSKLossy(char filein[], bool confirmation, int method, bool usingLines,
+                        int levels, bool dithering) {
+    // the STRIPES algorithm never needs the whole image in memory
+    if (method == STRIPES && levels == 0) {
+        convertToSKInStripes(filein, confirmation, STRIPE_HEIGHT);
+        return INFINITY;
+    }
+    double quality = INFINITY;
+    FILE *in = fopen(filein, "rb");
+    if (in == NULL) {
+        printf("Error: %s could not be opened\n", filein);
+        return quality;
+    }
+
+    // check if the .pgm file is a greyscale image with max greyscale value 255
+    beginSpan("header parse");
+    int width, height;
+    bool valid = readPGMHeader(in, &width, &height);
+    endSpan();
+
+    // if so, converts the file to a .sk
+    if (valid) {
+        char fileout[strlen(filein) + 1];
+        outputFiletype(filein, fileout, SK);
+        FILE *out = fopen(fileout, "wb");
+        if (out == NULL) {
+            printf("Error: %s could not be written\n", fileout);
+            fclose(in);
+            return quality;
+        }
+        quality = writePGMToSK(in, out, width, height, method, STRIPE_HEIGHT, usingLines, levels,
+                               dithering);
+        beginSpan("output write");
         fclose(out);
+        endSpan();
+
+        fclose(in);
         if (confirmation) printf("File %s has been written.\n", fileout);
+        if (confirmation && levels > 0) printf("PSNR: %.2f dB\n", quality);
     }
 
     else {
         printf("Error: .pgm file header mismatch\n");
         fclose(in);
     }
+    return quality;
+}
+
+// converts a .ppm or .pam into a .sk file using the given algorithm, with
+// each distinct colour drawn as a layer of its own. the BOX algorithms set
+// each colour once, when its layer is drawn
+void convertColourToSK(char filein[], bool confirmation, int method, bool usingLines) {
+    FILE *in = fopen(filein, "rb");
+    if (in == NULL) {
+        printf("Error: %s could not be opened\n", filein);
+        return;
+    }
+    beginSpan("header parse");
+    int width, height, channels;
+    bool valid = readColourHeader(in, &width, &height, &channels);
+    endSpan();
+
+    if (valid) {
+        beginSpan("initialiseColourBoard");
+        board b = initialiseColourBoard(in, width, height, channels);
+        endSpan();
+        fclose(in);
+        char fileout[strlen(filein) + 1];
+        outputFiletype(filein, fileout, SK);
+        FILE *out = fopen(fileout, "wb");
+        writeSketch(out, b, method, usingLines);
+        freeBoard(b);
+        beginSpan("output write");
+        fclose(out);
+        endSpan();
+        if (confirmation) printf("File %s has been written.\n", fileout);
+    }
+    else {
+        printf("Error: .ppm or .pam file header mismatch\n");
+        fclose(in);
+    }
+}
+
+// writes to .sk file commands to draw the pixels of a .pgm file of the given
+// size, read after its header, using the given algorithm, first reducing the
+// image to LEVELS greys unless LEVELS is 0. without that, the STRIPES
+// algorithm reads STRIPEHEIGHT rows at a time. returns the PSNR of the image
+// drawn against the original, which is INFINITY if nothing was lost
+double writePGMToSK(FILE *in, FILE *out, int width, int height, int method, int stripeHeight,
+                    bool usingLines, int levels, bool dithering) {
+    if (method == STRIPES && levels == 0) {
+        beginSpan("writeToSK_Stripes");
+        writeToSK_Stripes(in, out, width, height, stripeHeight);
+        endSpan();
+        return INFINITY;
+    }
+    double quality = INFINITY;
+    beginSpan("initialiseBoard");
+    board b = initialiseBoard(in, width, height);
+    endSpan();
+    if (levels > 0) {
+        beginValueSpan("quantise", "levels", levels);
+        board original = newBoard(width, height);
+        for (int i=0; i<height; i++) {
+            memcpy(original.pixels[i], b.pixels[i], width * sizeof(int));
+        }
+        quantise(b, levels, dithering);
+        quality = psnr(original, b);
+        freeBoard(original);
+        endSpan();
+    }
+    writeSketch(out, b, method, usingLines);
+    freeBoard(b);
+    return quality;
+}
+
+// marks every pixel of a frame FIXED except those inside the smallest box
+// around the pixels that changed since the last frame, found separately in
+// each DIRTY_TILE square, so only what changed is drawn again. returns the
+// number of pixels left to draw
+long maskUnchanged(board frame, board last) {
+    long drawable = 0;
+    for (int top=0; top<frame.height; top+=DIRTY_TILE) {
+        for (int left=0; left<frame.width; left+=DIRTY_TILE) {
+            int bottom = (top + DIRTY_TILE < frame.height) ? top + DIRTY_TILE : frame.height;
+            int right = (left + DIRTY_TILE < frame.width) ? left + DIRTY_TILE : frame.width;
+
+            // box around the changes in this tile, empty if there are none
+            position start = {right, bottom}, end = {left, top};
+            for (int i=top; i<bottom; i++) {
+                for (int j=left; j<right; j++) {
+                    if (frame.pixels[i][j] == last.pixels[i][j]) continue;
+                    if (j < start.x) start.x = j;
+                    if (i < start.y) start.y = i;
+                    if (j >= end.x) end.x = j + 1;
+                    if (i >= end.y) end.y = i + 1;
+                }
+            }
+            for (int i=top; i<bottom; i++) {
+                for (int j=left; j<right; j++) {
+                    if (start.x <= j && j < end.x && start.y <= i && i < end.y) drawable++;
+                    else frame.pixels[i][j] = FIXED;
+                }
+            }
+        }
+    }
+    return drawable;
+}
+
+// converts a sequence of .pgm files of the same size into one animated .sk
+// file, with each frame after the first drawing only what changed since the
+// frame before, apart from every KEYFRAMEINTERVAL frames being drawn in full.
+// returns false, saying why, if a frame can't be read or the file written
+bool convertFramesToSK(int count, char *frames[], char fileout[], bool confirmation,
+                       int keyframeInterval, bool usingLines) {
+    FILE *out = fopen(fileout, "wb");
+    if (out == NULL) {
+        printf("Error: %s could not be written\n", fileout);
+        return false;
+    }
+    board last = {0, 0, NULL};
+    int i = 0;
+    for (; i<count; i++) {
+        FILE *in = fopen(frames[i], "rb");
+        int width, height;
+        if (in == NULL || !readPGMHeader(in, &width, &height)) {
+            printf("Error: .pgm file header mismatch in %s\n", frames[i]);
+            if (in != NULL) fclose(in);
+            break;
+        }
+        if (i > 0 && (width != last.width || height != last.height)) {
+            printf("Error: %s is not the same size as the frames before it\n", frames[i]);
+            fclose(in);
+            break;
+        }
+        beginValueSpan("frame", "frame", i);
+        board frame = initialiseBoard(in, width, height);
+        fclose(in);
+        board changes = newBoard(width, height);
+        for (int j=0; j<height; j++) {
+            memcpy(changes.pixels[j], frame.pixels[j], width * sizeof(int));
+        }
+
+        // the viewer starts each frame from where the last one left the
+        // display, so anything unchanged can be left as it is
+        if (i > 0) fputc((TOOL << SKETCH_DATA_BITS) + NEXTFRAME, out);
+        bool keyframe = i % keyframeInterval == 0;
+        if (keyframe || maskUnchanged(changes, last) > 0) {
+            writeSketch(out, changes, BOX, usingLines);
+        }
+        freeBoard(changes);
+        if (i > 0) freeBoard(last);
+        last = frame;
+        endSpan();
+    }
+    int width = last.width, height = last.height;
+    if (i > 0) freeBoard(last);
+    if (fclose(out) != 0) {
+        printf("Error: %s could not be written\n", fileout);
+        return false;
+    }
+    if (i < count) return false;
+    if (confirmation) printf("File %s has been written.\n", fileout);
+    indexSK(fileout, confirmation, width, height);
+    return true;
+}
+
+// writes the seek index of a .sk file drawn on a canvas of the given size
+void indexSK(char skFile[], bool confirmation, int width, int height) {
+    char indexFile[strlen(skFile) + 2];
+    seekIndexName(skFile, indexFile);
+    FILE *in = openSK(skFile);
+    if (in == NULL) {
+        printf("Error: %s could not be opened\n", skFile);
+        return;
+    }
+    FILE *out = fopen(indexFile, "wb");
+    if (out == NULL) {
+        printf("Error: %s could not be written\n", indexFile);
+        fclose(in);
+        return;
+    }
+    beginSpan("writeSeekIndex");
+    writeSeekIndex(in, out, width, height);
+    endSpan();
+    fclose(out);
+    fclose(in);
+    if (confirmation) printf("File %s has been written.\n", indexFile);
+}
+
+// marks each DIRTY_TILE square of an image, counting along its rows, with
+// any pixel that differs from the last image
+void markChangedTiles(board image, board last, bool dirty[]) {
+    int across = (image.width + DIRTY_TILE - 1) / DIRTY_TILE;
+    for (int i=0; i<image.height; i++) {
+        for (int j=0; j<image.width; j++) {
+            if (image.pixels[i][j] == last.pixels[i][j]) continue;
+            dirty[i / DIRTY_TILE * across + j / DIRTY_TILE] = true;
+        }
+    }
+}
+
+// rewrites a .sk file to draw a new .pgm image of the same size, keeping its
+// commands for every DIRTY_TILE square that hasn't changed and drawing only
+// the rest again. the changes are taken to lie in the box from START to END,
+// or if that is empty, are found by comparing against the image the file draws
+bool updateSK(char skFile[], char filein[], bool confirmation, position start, position end,
+              bool usingLines) {
+    FILE *in = fopen(filein, "rb");
+    int width, height;
+    if (in == NULL || !readPGMHeader(in, &width, &height)) {
+        printf("Error: .pgm file header mismatch in %s\n", filein);
+        if (in != NULL) fclose(in);
+        return false;
+    }
+    board image = initialiseBoard(in, width, height);
+    fclose(in);
+    bool packed = packedSK(skFile);
+    FILE *sk = openSK(skFile);
+    if (sk == NULL) {
+        printf("Error: %s could not be opened\n", skFile);
+        freeBoard(image);
+        return false;
+    }
+
+    beginSpan("find changes");
+    int across = (width + DIRTY_TILE - 1) / DIRTY_TILE;
+    int down = (height + DIRTY_TILE - 1) / DIRTY_TILE;
+    bool *dirty = calloc((size_t) across * down, sizeof(bool));
+    if (start.x < end.x && start.y < end.y) {
+        for (int i=start.y / DIRTY_TILE; i<down && i * DIRTY_TILE < end.y; i++) {
+            for (int j=start.x / DIRTY_TILE; j<across && j * DIRTY_TILE < end.x; j++) {
+                dirty[i * across + j] = true;
+            }
+        }
+    }
+    else {
+        board last = newBoard(width, height);
+        for (int i=0; i<height; i++) {for (int j=0; j<width; j++) {last.pixels[i][j] = 0xff;}}
+        // a file that can't be decoded is drawn again in full
+        if (convertSKToBoard(sk, last)) markChangedTiles(image, last, dirty);
+        else memset(dirty, true, (size_t) across * down);
+        freeBoard(last);
+        rewind(sk);
+    }
+    // the box around every tile to be drawn again
+    position from = {width, height}, to = {0, 0};
+    for (int i=0; i<down; i++) {
+        for (int j=0; j<across; j++) {
+            if (!dirty[i * across + j]) continue;
+            if (j * DIRTY_TILE < from.x) from.x = j * DIRTY_TILE;
+            if (i * DIRTY_TILE < from.y) from.y = i * DIRTY_TILE;
+            if ((j + 1) * DIRTY_TILE > to.x) to.x = (j + 1) * DIRTY_TILE;
+            if ((i + 1) * DIRTY_TILE > to.y) to.y = (i + 1) * DIRTY_TILE;
+        }
+    }
+    if (to.x > width) to.x = width;
+    if (to.y > height) to.y = height;
+    endSpan();
+
+    int count;
+    drawCommand *old = readDrawCommands(sk, &count);
+    fclose(sk);
+    bool written = true;
+    // nothing to do if nothing changed
+    if (from.x < to.x) {
+        // draws every pixel of the changed tiles in that box, and nothing else
+        board changes = newBoard(to.x - from.x, to.y - from.y);
+        for (int i=0; i<changes.height; i++) {
+            for (int j=0; j<changes.width; j++) {
+                int y = from.y + i, x = from.x + j;
+                bool changed = dirty[y / DIRTY_TILE * across + x / DIRTY_TILE];
+                changes.pixels[i][j] = changed ? image.pixels[y][x] : FIXED;
+            }
+        }
+        char *commands;
+        size_t length;
+        FILE *sketch = open_memstream(&commands, &length);
+        writeSketch(sketch, changes, BOX, usingLines);
+        fclose(sketch);
+        freeBoard(changes);
+        sketch = fmemopen(commands, length, "rb");
+        int addedCount;
+        drawCommand *added = readDrawCommands(sketch, &addedCount);
+        fclose(sketch);
+        free(commands);
+        // the changes were drawn as if the box were the whole board
+        for (int k=0; k<addedCount; k++) {
+            if (added[k].tool != LINE && added[k].tool != BLOCK) continue;
+            added[k].x += from.x; added[k].tx += from.x;
+            added[k].y += from.y; added[k].ty += from.y;
+        }
+
+        beginSpan("splice");
+        FILE *out = fopen(skFile, "wb");
+        written = out != NULL;
+        // a file with draws that can't be written back is replaced outright
+        if (written && !spliceDraws(out, old, count, added, addedCount, dirty, DIRTY_TILE,
+                                    width, height)) {
+            writeSketch(out, image, BOX, usingLines);
+        }
+        if (written) written = fclose(out) == 0;
+        // the file is left packed if it was
+        if (written && packed) written = packSKFile(skFile, true);
+        endSpan();
+        free(added);
+    }
+    free(old);
+    free(dirty);
+    freeBoard(image);
+    if (!written) printf("Error: %s could not be written\n", skFile);
+    else if (confirmation) printf("File %s has been written.\n", skFile);
+    return written;
 }
 
 // signs an signed 6 bit two's complement number
@@ -392,109 +1656,581 @@ int sign(unsigned char x) { return (x > 31) ? x - 64 : x; }
 // converts RGBA colour to its corresponding greyscale value
 unsigned char RGBAToGreyscale(unsigned int c) { return (c >> 8) & 0xff; }
 
-// updates board state when a line is drawn
-// does not support diagonal lines
-void drawLine(unsigned char c, position start, position end, int b[HEIGHT][WIDTH]) {
-    if(start.x != end.x && start.y != end.y) {
-        printf("Diagonal Lines are not supported.\n");
-        exit(-1);
+// updates board state when a line is drawn, ignoring any pixels off the board
+// does not support diagonal lines, returning false if given one
+bool drawLine(unsigned char c, position start, position end, board b) {
+    if(start.x != end.x && start.y != end.y) return false;
+    // lines can be drawn in either direction
+    position from = {(start.x < end.x) ? start.x : end.x, (start.y < end.y) ? start.y : end.y};
+    position to = {(start.x < end.x) ? end.x : start.x, (start.y < end.y) ? end.y : start.y};
+    for(int i=(from.y < 0) ? 0 : from.y; i<=to.y && i<b.height; i++) {
+        for (int j=(from.x < 0) ? 0 : from.x; j<=to.x && j<b.width; j++) {
+            b.pixels[i][j] = c;
+        }
     }
-    for(int i=start.y; i<=end.y; i++) {
-        for (int j=start.x; j<=end.x; j++) {
-            b[i][j] = c;
+    return true;
+}
+
+// updates board state when a box is drawn, ignoring any pixels off the board
+void drawBox(unsigned char c, position start, position end, board b) {
+    for(int i=(start.y < 0) ? 0 : start.y; i<end.y && i<b.height; i++) {
+        for (int j=(start.x < 0) ? 0 : start.x; j<end.x && j<b.width; j++) {
+            b.pixels[i][j] = c;
         }
     }
 }
 
-// updates board state when a box is drawn
-void drawBox(unsigned char c, position start, position end, int b[HEIGHT][WIDTH]) {
-    for(int i=start.y; i<end.y; i++) {
-        for (int j=start.x; j<end.x; j++) {
-            b[i][j] = c;
-        }
-    }
-}
-
-// writes to board the image drawn from the commands in a .sk file
-void convertSKToBoard(FILE *in, int b[HEIGHT][WIDTH]) {
-    // initialise state variables
-    int tool = LINE; unsigned char colour = 0; unsigned int data = 0;
-    position currentPos = (position) {0, 0}; 
-    position nextPos = (position) {0, 0};
-
-    // reads commands from .sk file 
-    while(!feof(in)) {
-        unsigned char command = fgetc(in);
-        unsigned char opcode = command >> 6;
-        unsigned char operand = command & 0x3f;
-        
-        // DX and DY require a signed operand
-        if (opcode == DX) nextPos.x += sign(operand);
-        else if (opcode == DY) {
-            nextPos.y += sign(operand);
-            if (tool == LINE) drawLine(colour, currentPos, nextPos, b);
-            else if (tool == BLOCK) drawBox(colour, currentPos, nextPos, b);
-            currentPos = nextPos;
-        }
-        // set tool if it's none/line/block, otherwise do the relevant function
-        // ignores SHOW, PAUSE instructions as they do not affect the final
-        // output of the file
-        else if (opcode == TOOL) {
-            if (operand == NONE || operand == LINE || operand == BLOCK) tool = operand;
-            else if (operand == COLOUR) colour = RGBAToGreyscale(data);
-            else if (operand == TARGETX) nextPos.x = data;
-            else if (operand == TARGETY) nextPos.y = data;
-            data = 0;
-        }
-        else if (opcode == DATA) {data <<= 6; data += operand;}    
-    }
-}
-
-// converts a .sk file into a .pgm file
-void convertToPGM(char filein[]) {
-    FILE *in = fopen(filein, "r");
-    char fileout[MAX_FILENAME_LENGTH];
-    outputFiletype(filein, fileout, PGM);
+// a board the interpreter draws on in greys, from row TOP of the sketch
+typedef struct boardTarget {
+    board rows; // pixels[0] is row TOP of the sketch
+    int top;
+    unsigned char colour;
+    bool diagonal; // set once a diagonal line is drawn, which boards can't show
+} boardTarget;
 
-    // initialise board with all black pixels
-    int b[HEIGHT][WIDTH];
-    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {b[i][j] = 0xff;}}
-    convertSKToBoard(in, b); // fill in the board with the correct pixels
+static void boardLine(void *target, int x0, int y0, int x1, int y1) {
+    boardTarget *t = target;
+    position start = {x0, y0 - t->top}, end = {x1, y1 - t->top};
+    if (!drawLine(t->colour, start, end, t->rows)) t->diagonal = true;
+}
 
-    FILE *out = fopen(fileout, "wb");
-    fputs("P5 200 200 255\n", out); // PGM File Header
+// blocks of negative size cover the same pixels as the viewer draws for them
+static void boardBlock(void *target, int x, int y, int w, int h) {
+    boardTarget *t = target;
+    if (w < 0) { x += w; w = -w; }
+    if (h < 0) { y += h; h = -h; }
+    drawBox(t->colour, (position) {x, y - t->top}, (position) {x + w, y + h - t->top}, t->rows);
+}
+
+static void boardColour(void *target, unsigned int rgba) {
+    ((boardTarget *) target)->colour = RGBAToGreyscale(rgba);
+}
+
+// a backend drawing onto a board. SHOW and PAUSE are left out, as they do
+// not change the last frame, which is what the board holds
+static sketchBackend boardBackend(boardTarget *t) {
+    return (sketchBackend) {t, boardLine, boardBlock, boardColour, NULL, NULL, NULL};
+}
+
+// writes to board the image drawn from the commands in a .sk file, returning
+// false if it draws a diagonal line or can't be read whole
+bool convertSKToBoard(FILE *in, board b) {
+    boardTarget t = {b, 0, 0, false};
+    sketchBackend backend = boardBackend(&t);
+    sketchState s = newSketchState();
+    sketchOp op;
+    for (int ch = fgetc(in); ch != EOF && !t.diagonal; ch = fgetc(in)) {
+        if (decodeByte(&s, ch, &op)) playOp(&op, &backend);
+    }
+    return !t.diagonal && !ferror(in);
+}
+
+// the rows of a board one thread draws, and every op to clip to them
+typedef struct band {
+    opTable ops;
+    boardTarget rows;
+} band;
+
+// draws onto a band of a board, in order, the part of every op inside it
+static int drawBand(void *arg) {
+    band *s = arg;
+    // drawing a board the band's height moved up clips draws to the band
+    sketchBackend backend = boardBackend(&s->rows);
+    playOps(s->ops, 0, s->ops.count, &backend);
+    return 0;
+}
+
+// writes to board the image drawn from the commands in a .sk file like
+// convertSKToBoard, but reads every draw first and then splits the board
+// into THREADS bands of rows, each drawn by its own thread. every thread
+// draws in the file's order and only into its own rows, so none need locks
+bool convertSKToBoardInBands(FILE *in, board b, int threads) {
+    if (threads <= 1) return convertSKToBoard(in, b);
+    opTable ops = decodeOps(in);
+    if (ferror(in)) {
+        freeOps(ops);
+        return false;
+    }
+    for (int i=0; i<ops.count; i++) {
+        sketchOp *op = &ops.ops[i];
+        if (op->kind == OP_LINE && op->x != op->tx && op->y != op->ty) {
+            freeOps(ops);
+            return false;
+        }
+    }
+
+    if (threads > b.height) threads = b.height;
+    band *bands = malloc(threads * sizeof(band));
+    thrd_t *workers = malloc(threads * sizeof(thrd_t));
+    bool *started = malloc(threads * sizeof(bool));
+    for (int t=0; t<threads; t++) {
+        int top = (long) b.height * t / threads, bottom = (long) b.height * (t+1) / threads;
+        bands[t] = (band) {ops, {{b.width, bottom - top, b.pixels + top}, top, 0, false}};
+        started[t] = thrd_create(&workers[t], drawBand, &bands[t]) == thrd_success;
+        // a band no thread could be started for is drawn on this one
+        if (!started[t]) drawBand(&bands[t]);
+    }
+    for (int t=0; t<threads; t++) {
+        if (started[t]) thrd_join(workers[t], NULL);
+    }
+    free(started);
+    free(workers);
+    free(bands);
+    freeOps(ops);
+    return true;
+}
+
+// writes to board one frame of a .sk file as the viewer shows it, drawing
+// only from the latest frame up to it that covers the canvas, as found in
+// the file's seek index. returns false if the frame is not in the index, a
+// diagonal line is drawn or the file can't be read whole
+bool convertSKFrameToBoard(FILE *in, FILE *index, long frame, board b) {
+    seekEntry e, start, next;
+    if (!readSeekEntry(index, frame, &e) || !readSeekEntry(index, e.keyframe, &start)) return false;
+    // the frame ends where the next one starts, or at the end of the file
+    bool last = !readSeekEntry(index, frame + 1, &next);
+
+    // the colour is carried into the first frame drawn, so is set again
+    char *commands;
+    size_t length;
+    FILE *sketch = open_memstream(&commands, &length);
+    if (start.coloured) writeColour(sketch, start.rgba);
+    fseeko(in, start.offset, SEEK_SET);
+    for (uint64_t at=start.offset; last || at < next.offset; at++) {
+        int ch = fgetc(in);
+        if (ch == EOF) break;
+        fputc(ch, sketch);
+    }
+    fclose(sketch);
+    bool drawn = !ferror(in);
+    if (drawn && length > 0) {
+        sketch = fmemopen(commands, length, "rb");
+        drawn = convertSKToBoard(sketch, b);
+        fclose(sketch);
+    }
+    free(commands);
+    return drawn;
+}
+
+// writes a board as a binary .pgm image
+void writeBoard(FILE *out, board b) {
+    fprintf(out, "P5 %d %d 255\n", b.width, b.height); // PGM File Header
     // output board into pgm output file
-    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {fputc(b[i][j], out);}}
-    
+    for(int i=0; i<b.height; i++) {for (int j=0; j<b.width; j++) {fputc(b.pixels[i][j], out);}}
+}
+
+// writes a board to a .pgm file
+static void writeBoardToPGM(char fileout[], board b) {
+    beginSpan("output write");
+    FILE *out = fopen(fileout, "wb");
+    writeBoard(out, b);
     fclose(out);
+    endSpan();
+}
+
+// converts one frame of a .sk file into a .pgm file of the given size, using
+// the seek index beside it to start near the frame
+void convertFrameToPGM(char filein[], bool confirmation, int width, int height, long frame) {
+    char indexFile[strlen(filein) + 2];
+    seekIndexName(filein, indexFile);
+    FILE *index = fopen(indexFile, "rb");
+    if (index == NULL) {
+        printf("Error: %s has no seek index, write one with --index\n", filein);
+        return;
+    }
+    FILE *in = openSK(filein);
+    char fileout[strlen(filein) + 2];
+    outputFiletype(filein, fileout, PGM);
+
+    board b = newBoard(width, height);
+    for(int i=0; i<height; i++) {for (int j=0; j<width; j++) {b.pixels[i][j] = 0xff;}}
+    beginSpan("convertSKFrameToBoard");
+    bool drawn = convertSKFrameToBoard(in, index, frame, b);
+    endSpan();
+    bool damaged = ferror(in);
+    fclose(in);
+    fclose(index);
+    if (damaged) {
+        printf("Error: %s is cut short or damaged\n", filein);
+        freeBoard(b);
+        return;
+    }
+    if (!drawn) {
+        printf("Error: frame %ld is not in %s or draws a diagonal line\n", frame, filein);
+        freeBoard(b);
+        return;
+    }
+    writeBoardToPGM(fileout, b);
+    freeBoard(b);
+    if (confirmation) printf("File %s has been written.\n", fileout);
+}
+
+// converts a .sk file into a .pgm file of the given size, drawn by THREADS
+// threads at once
+void convertToPGM(char filein[], bool confirmation, int width, int height, int threads) {
+    FILE *in = openSK(filein);
+    char fileout[strlen(filein) + 2];
+    outputFiletype(filein, fileout, PGM);
+
+    // initialise board with all white pixels
+    board b = newBoard(width, height);
+    for(int i=0; i<height; i++) {for (int j=0; j<width; j++) {b.pixels[i][j] = 0xff;}}
+    beginSpan("convertSKToBoard");
+    bool drawn = convertSKToBoardInBands(in, b, threads); // fill in the board with the correct pixels
+    endSpan();
+    bool damaged = ferror(in);
     fclose(in);
-    printf("File %s has been written.\n", fileout);
+    if (damaged) {
+        printf("Error: %s is cut short or damaged\n", filein);
+        freeBoard(b);
+        return;
+    }
+    if (!drawn) {
+        printf("Diagonal Lines are not supported.\n");
+        freeBoard(b);
+        return;
+    }
+    writeBoardToPGM(fileout, b);
+    freeBoard(b);
+    if (confirmation) printf("File %s has been written.\n", fileout);
+}
+
+// Include a main function only if we are not building the converter into
+// another program (make bench), which then provides its own main function.
+#ifndef LIBRARY
+// prints the counters for a conversion, counting the bytes of the .sk file
+// it read or wrote
+void reportStats(char skFile[]) {
+    FILE *sk = openSK(skFile);
+    if (sk != NULL) {
+        countCommandBytes(sk);
+        fclose(sk);
+    }
+    printStats(stdout);
+}
+
+// finds the algorithm for an effort level given by name, or NOT_FOUND
+int parseEffort(char name[]) {
+    if (strcmp(name, "fast") == 0) return RLE;
+    if (strcmp(name, "greedy") == 0) return BOX;
+    if (strcmp(name, "exhaustive") == 0) return EXHAUSTIVE;
+    if (strcmp(name, "largest") == 0) return LARGEST;
+    return NOT_FOUND;
+}
+
+// finds the filetype given by name to -i or -o, or INVALID
+int parseFormat(char name[]) {
+    if (strcmp(name, "pgm") == 0) return PGM;
+    if (strcmp(name, "sk") == 0) return SK;
+    return INVALID;
+}
+
+// converts a .pgm read from FILEIN into a .sk written to FILEOUT, or back,
+// where either can be - for stdin or stdout, so the converter can sit in a
+// pipe. the output is only opened once the input is known to be valid, and
+// only errors are printed, to stderr, so nothing else gets into the output.
+// returns the exit status
+int convertStream(char filein[], int typeIn, char fileout[], int typeOut, int method,
+                  int stripeHeight, int levels, bool dithering, bool packing, int width,
+                  int height, int threads) {
+    bool fromStdin = strcmp(filein, "-") == 0, toStdout = strcmp(fileout, "-") == 0;
+    FILE *in = fromStdin ? stdin : fopen(filein, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Error: %s could not be opened\n", filein);
+        return 1;
+    }
+
+    int pgmWidth, pgmHeight;
+    if (typeIn == PGM && !readPGMHeader(in, &pgmWidth, &pgmHeight)) {
+        fprintf(stderr, "Error: .pgm file header mismatch\n");
+        if (!fromStdin) fclose(in);
+        return 1;
+    }
+    if (typeIn == SK) {
+        FILE *sk = readSK(in);
+        if (sk == NULL) {
+            fprintf(stderr, "Error: %s is not a valid .sk file\n", filein);
+            if (!fromStdin) fclose(in);
+            return 1;
+        }
+        in = sk;
+    }
+    FILE *out = toStdout ? stdout : fopen(fileout, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Error: %s could not be written\n", fileout);
+        if (!fromStdin || typeIn == SK) fclose(in);
+        return 1;
+    }
+
+    bool valid = true;
+    if (typeIn == PGM) {
+        // an envelope is written a block at a time once every command is known
+        FILE *sketch = packing ? tmpfile() : out;
+        if (stripeHeight > 0) writePGMToSK(in, sketch, pgmWidth, pgmHeight, STRIPES, stripeHeight,
+                                           USING_LINES, 0, false);
+        else writePGMToSK(in, sketch, pgmWidth, pgmHeight, method, STRIPE_HEIGHT, USING_LINES,
+                          levels, dithering);
+        if (packing) {
+            rewind(sketch);
+            packSK(sketch, out);
+            fclose(sketch);
+        }
+    }
+    else if (typeOut == PGM) {
+        board b = newBoard(width, height);
+        for(int i=0; i<height; i++) {for (int j=0; j<width; j++) {b.pixels[i][j] = 0xff;}}
+        beginSpan("convertSKToBoard");
+        valid = convertSKToBoardInBands(in, b, threads);
+        endSpan();
+        if (valid) writeBoard(out, b);
+        else if (!ferror(in)) fprintf(stderr, "Diagonal Lines are not supported.\n");
+        freeBoard(b);
+    }
+    // a .sk to a .sk is only packed or unpacked on the way through
+    else if (packing) packSK(in, out);
+    else {
+        for (int ch = fgetc(in); ch != EOF; ch = fgetc(in)) fputc(ch, out);
+    }
+    if (typeIn == SK && ferror(in)) {
+        fprintf(stderr, "Error: %s is cut short or damaged\n", filein);
+        valid = false;
+    }
+
+    if (!fromStdin || typeIn == SK) fclose(in);
+    beginSpan("output write");
+    bool written = toStdout ? fflush(out) == 0 && !ferror(out) : fclose(out) == 0;
+    endSpan();
+    if (!written) fprintf(stderr, "Error: %s could not be written\n", fileout);
+    return (valid && written) ? 0 : 1;
 }
 
 int main(int n, char *args[n]) {
+    // read any options given before the filename
+    bool showingStats = false, validOptions = true;
+    int stripeHeight = 0; // set if converting in stripes
+    int method = BOX;
+    long deadlineMs = 0; // no time limit unless given
+    int levels = 0; // greys to reduce a .pgm to first, or 0 to keep every grey
+    bool dithering = false;
+    char *animation = NULL; // .sk file to animate the .pgm files after it into
+    char *update = NULL; // .sk file to update to draw the .pgm file instead
+    position regionStart = {0, 0}, regionEnd = {0, 0}; // where it changed, if known
+    int keyframeInterval = KEYFRAME_INTERVAL;
+    int width = WIDTH, height = HEIGHT; // size of the .pgm a .sk is decoded to
+    int threads = 0; // threads a .sk is decoded or a batch encoded on, or 0 for the default
+    long frame = -1; // frame of a .sk to decode, or -1 for the last one
+    bool indexing = false; // write the seek index of a .sk instead of decoding it
+    bool packing = false, unpacking = false; // put a .sk in an envelope, or take it out
+    bool batching = false; // convert every .pgm after the options
+    int typeIn = INVALID, typeOut = INVALID; // formats given to -i and -o
+    int files = 1; // filenames after the options, or 2 with -i or -o
+    int i = 1;
+    for (; i < n-files && validOptions; i++) {
+        if (strcmp(args[i], "--stats") == 0) showingStats = true;
+        else if (strcmp(args[i], "--trace") == 0 && i+1 < n-1) startTrace(args[++i]);
+        else if (strcmp(args[i], "--stripes") == 0 && i+1 < n-1) {
+            stripeHeight = atoi(args[++i]);
+            validOptions = stripeHeight > 0;
+        }
+        else if (strcmp(args[i], "--effort") == 0 && i+1 < n-1) {
+            method = parseEffort(args[++i]);
+            validOptions = method != NOT_FOUND;
+        }
+        else if (strcmp(args[i], "--deadline-ms") == 0 && i+1 < n-1) {
+            deadlineMs = atol(args[++i]);
+            validOptions = deadlineMs > 0;
+        }
+        else if (strcmp(args[i], "--levels") == 0 && i+1 < n-1) {
+            levels = atoi(args[++i]);
+            validOptions = 0 < levels && levels <= GREYSCALE_COLOURS;
+        }
+        else if (strcmp(args[i], "--dither") == 0) dithering = true;
+        else if (strcmp(args[i], "--keyframes") == 0 && i+1 < n-1) {
+            keyframeInterval = atoi(args[++i]);
+            validOptions = keyframeInterval > 0;
+        }
+        // every argument after the animation's filename is one of its frames
+        else if (strcmp(args[i], "--animate") == 0 && i+2 < n) {
+            animation = args[++i];
+            i++;
+            break;
+        }
+        // as is every argument after --batch
+        else if (strcmp(args[i], "--batch") == 0 && i+1 < n) {
+            batching = true;
+            i++;
+            break;
+        }
+        else if (strcmp(args[i], "--update") == 0 && i+1 < n-1) update = args[++i];
+        else if (strcmp(args[i], "--region") == 0 && i+1 < n-1) {
+            int regionWidth, regionHeight;
+            validOptions = sscanf(args[++i], "%dx%d+%d+%d", &regionWidth, &regionHeight,
+                                  &regionStart.x, &regionStart.y) == 4
+                && regionWidth > 0 && regionHeight > 0 && regionStart.x >= 0 && regionStart.y >= 0;
+            regionEnd = (position) {regionStart.x + regionWidth, regionStart.y + regionHeight};
+        }
+        else if (strcmp(args[i], "--frame") == 0 && i+1 < n-1) {
+            frame = atol(args[++i]);
+            validOptions = frame >= 0;
+        }
+        else if (strcmp(args[i], "--index") == 0) indexing = true;
+        else if (strcmp(args[i], "--pack") == 0) packing = true;
+        else if (strcmp(args[i], "--unpack") == 0) unpacking = true;
+        else if (strcmp(args[i], "--threads") == 0 && i+1 < n-1) {
+            threads = atoi(args[++i]);
+            validOptions = threads > 0;
+        }
+        else if (strcmp(args[i], "--size") == 0 && i+1 < n-1) {
+            validOptions = sscanf(args[++i], "%dx%d", &width, &height) == 2
+                && width > 0 && height > 0;
+        }
+        else if (strcmp(args[i], "-i") == 0 && i+1 < n-1) {
+            typeIn = parseFormat(args[++i]);
+            validOptions = typeIn != INVALID;
+            files = 2;
+        }
+        else if (strcmp(args[i], "-o") == 0 && i+1 < n-1) {
+            typeOut = parseFormat(args[++i]);
+            validOptions = typeOut != INVALID;
+            files = 2;
+        }
+        else validOptions = false;
+    }
+    // dithering needs levels to dither to, and stripes are never all in
+    // memory at once to find the levels from
+    if ((dithering && levels == 0) || (levels > 0 && stripeHeight > 0)) validOptions = false;
+    // and animations are only drawn with the BOX algorithm, on whole frames
+    if (animation != NULL && (method != BOX || levels > 0 || stripeHeight > 0)) {
+        validOptions = false;
+    }
+    // as are the changes to an image, and a region is only used to update
+    if (update != NULL && (method != BOX || levels > 0 || stripeHeight > 0 || animation != NULL)) {
+        validOptions = false;
+    }
+    if (update == NULL && regionEnd.x > 0) validOptions = false;
+    // and only a .sk file can be unpacked
+    if (unpacking && (packing || animation != NULL || parseFiletype(args[n-1]) != SK)) {
+        validOptions = false;
+    }
+    // a colour image is drawn whole, with every colour it has
+    int typeGiven = parseFiletype(args[n-1]);
+    if ((typeGiven == PPM || typeGiven == PAM) && files == 1
+        && (levels > 0 || update != NULL)) {
+        validOptions = false;
+    }
+
+    // an input and output given by name take their formats from their
+    // endings, and stdin or stdout from -i or -o. a .pgm is only ever
+    // converted to a .sk and back, and only one image at a time. colour
+    // images are only converted on their own, by name
+    if (files == 2 && validOptions && i == n-2) {
+        if (typeIn == INVALID) typeIn = parseFiletype(args[n-2]);
+        if (typeOut == INVALID) typeOut = parseFiletype(args[n-1]);
+        if (typeIn == INVALID || typeOut == INVALID || (typeIn == PGM && typeOut == PGM)
+            || typeIn == PPM || typeIn == PAM || typeOut == PPM || typeOut == PAM
+            || showingStats || animation != NULL || update != NULL || regionEnd.x > 0
+            || indexing || frame >= 0 || unpacking) {
+            validOptions = false;
+        }
+    }
+
+    // a batch only converts .pgm files, each to a .sk file beside it
+    if (batching) {
+        for (int j=i; j<n; j++) validOptions = validOptions && parseFiletype(args[j]) == PGM;
+        if (showingStats || update != NULL || regionEnd.x > 0 || indexing || frame >= 0 || unpacking) {
+            validOptions = false;
+        }
+    }
+
     if (n == 1) testConverter(); // runs tests if no arguments provided
-    // attempts to convert file if a filename is provided
-    else if (n == 2) { 
-        char filename[MAX_FILENAME_LENGTH];
-        strcpy (filename, args[1]);
+    else if (validOptions && batching) {
+        batchOptions options = {(stripeHeight > 0) ? STRIPES : method, stripeHeight, levels,
+                                dithering, packing, deadlineMs, threads};
+        int converted = convertBatch(n - i, &args[i], &options);
+        endTrace();
+        printf("%d of %d files have been converted.\n", converted, n - i);
+        return (converted == n - i) ? 0 : 1;
+    }
+    else if (validOptions && files == 2 && i == n-2) {
+        setDeadline(deadlineMs);
+        int status = convertStream(args[n-2], typeIn, args[n-1], typeOut, method, stripeHeight,
+                                   levels, dithering, packing, width, height, threads);
+        endTrace();
+        return status;
+    }
+    else if (validOptions && animation != NULL) {
+        setDeadline(deadlineMs);
+        bool converted = convertFramesToSK(n - i, &args[i], animation, true, keyframeInterval,
+                                           USING_LINES);
+        if (converted && packing) converted = packSKFile(animation, true);
+        endTrace();
+        if (converted && showingStats) reportStats(animation);
+        return converted ? 0 : 1;
+    }
+    // attempts to convert file if a filename is provided, after any options
+    else if (validOptions && files == 1 && i == n-1) { 
+        char *filename = args[n-1];
         int type = parseFiletype(filename);
 
         if (type == INVALID) {
-        printf("Error: File provided not a valid .pgm nor .sk file\n");
+            printf("Error: File provided not a valid .pgm, .ppm, .pam nor .sk file\n");
+            endTrace();
             return -1;
         }
+        else if (type == PPM || type == PAM) {
+            setDeadline(deadlineMs);
+            char sk[strlen(filename) + 1];
+            outputFiletype(filename, sk, SK);
+            convertColourToSK(filename, true, (stripeHeight > 0) ? STRIPES : method, USING_LINES);
+            if (packing) packSKFile(sk, true);
+            endTrace();
+            if (showingStats) reportStats(sk);
+            return 0;
+        }
         else if (type == PGM) {
-            convertToSK(filename, true, USING_LINES); 
+            setDeadline(deadlineMs);
+            char sk[strlen(filename) + 1];
+            outputFiletype(filename, sk, SK);
+            if (update != NULL) {
+                if (!updateSK(update, filename, true, regionStart, regionEnd, USING_LINES)) {
+                    endTrace();
+                    return 1;
+                }
+            }
+            else if (stripeHeight > 0) convertToSKInStripes(filename, true, stripeHeight);
+            else convertToSKLossy(filename, true, method, USING_LINES, levels, dithering); 
+            if (packing) packSKFile((update != NULL) ? update : sk, true);
+            endTrace();
+            if (showingStats) reportStats((update != NULL) ? update : sk);
             return 0;
         }
         else if (type == SK) {
-            convertToPGM(filename); 
+            if (packing || unpacking) {
+                if (packSKFile(filename, packing)) printf("File %s has been written.\n", filename);
+                else printf("Error: %s could not be %s\n", filename, packing ? "packed" : "unpacked");
+            }
+            else if (indexing) indexSK(filename, true, width, height);
+            else if (frame >= 0) convertFrameToPGM(filename, true, width, height, frame);
+            else convertToPGM(filename, true, width, height, threads); 
+            endTrace();
+            if (showingStats) reportStats(filename);
             return 0;
         }
     }
-    // if wrong number of arguments provided, print a usage hint
+    // if wrong arguments provided, print a usage hint
     else {
-        printf("Use ./converter [filename]\n"); 
+        printf("Use ./converter [--stats] [--trace trace.json] [--stripes rows] "
+               "[--effort fast|greedy|largest|exhaustive] [--deadline-ms ms] [--levels k [--dither]] "
+               "[--size WIDTHxHEIGHT] [--threads n] [--frame n | --index] [--pack | --unpack] "
+               "[filename]\n"
+               "or ./converter [--stats] [--effort ...] [--stripes rows] [--pack] image.ppm|image.pam\n"
+               "or ./converter --update old.sk [--region WIDTHxHEIGHT+X+Y] new.pgm\n"
+               "or ./converter [--keyframes n] --animate animation.sk frame.pgm...\n"
+               "or ./converter [--effort ...] [--levels k [--dither]] [--stripes rows] [--pack] "
+               "[--deadline-ms ms] [--threads n] --batch image.pgm...\n"
+               "or ./converter [options] [-i pgm|sk] [-o pgm|sk] in|- out|-\n"); 
+        endTrace();
         return -1;
     } 
 }
+#endif
@@ -13,13 +13,14 @@ enum { DX = 0, DY = 1, TOOL = 2, DATA = 3 }; // opcodes
 enum { NONE = 0, LINE = 1,BLOCK = 2, COLOUR = 3, TARGETX = 4, TARGETY = 5,
        SHOW = 6, PAUSE = 7, NEXTFRAME = 8 }; // TOOL operands
 
-enum { INVALID, PGM, SK }; // filetypes
-enum { RLE, BOX }; // algorithms
+enum { INVALID, PGM, SK, PPM, PAM }; // filetypes
+enum { RLE, BOX, STRIPES, EXHAUSTIVE, LARGEST }; // algorithms
+enum { FIRST_PIXEL, TOURED, LARGEST_FIRST }; // ways the BOX algorithm chooses boxes
 
 extern const int MAX_FILENAME_LENGTH;
 extern const int MAX_PGM_HEADER_CHARS;
-extern const int HEIGHT;
-extern const int WIDTH;
+extern const int HEIGHT; // size of the viewer's window, and of a decoded .sk
+extern const int WIDTH;  // unless told otherwise
 extern const int GREYSCALE_COLOURS;
 extern const int SKETCH_DATA_BITS;
 extern const unsigned char SKETCH_DATA_MAX;
@@ -30,19 +31,35 @@ extern const int CORRECT; // constants for BOX algorithm
 extern const int FIXED;
 extern const int NOT_FOUND;
 
-typedef int** board;
+extern const int STRIPE_HEIGHT; // rows read at a time by the STRIPES algorithm
+extern const int ORDER_PASSES; // most passes the exhaustive effort makes over the colour order
 
-typedef struct colourInfo {
-    unsigned char greyValue;
-    int count;
-} colourInfo;
+extern const int DIRTY_TILE; // size of the squares changes between frames are found in
+extern const int KEYFRAME_INTERVAL; // frames between each one drawn in full
+
+typedef struct board {
+    int width;
+    int height;
+    int **pixels; // pixels[y][x]
+    // the RGBA of each value a pixel can hold, or NULL if they are greys
+    unsigned int *palette;
+    int colours; // values a pixel can hold
+} board;
 
 typedef struct position {
-    unsigned char x;
-    unsigned char y;
+    int x;
+    int y;
 } position;
 
-// takes a filename and determines whether it is a .sk or a .pgm
+typedef struct colourInfo {
+    int value; // a grey, or a place in the board's palette
+    int count;
+    // the smallest box holding every pixel of the colour, from FROM up to
+    // but not including TO, so it is only ever looked for there
+    position from, to;
+} colourInfo;
+
+// takes a filename and determines whether it is a .sk, a .pgm, a .ppm or a .pam
 int parseFiletype(char filename[]);
 
 // changes a filename ending from .sk to .pgm, or vice versa
@@ -52,14 +69,37 @@ void outputFiletype(char filein[], char fileout[], int type);
 // converts a greyscale value to its associated RGBA value
 unsigned int greyscaleToRGBA(unsigned char g);
 
-// initialise 200x200 pixel grid based on sk file input stream
-board initialiseBoard(FILE *in);
+// finds the RGBA of a value a pixel of a board holds
+unsigned int boardRGBA(board b, int value);
+
+// reads the header of a .pgm file, finding the size of the image. returns
+// false unless it is a binary greyscale image with max greyscale value 255
+bool readPGMHeader(FILE *in, int *width, int *height);
+
+// reads the header of a .ppm or .pam file, finding the size of the image and
+// the CHANNELS of each pixel, 3 for RGB or 4 for RGB with alpha. returns
+// false unless it is a binary image with max value 255
+bool readColourHeader(FILE *in, int *width, int *height, int *channels);
+
+// allocates a board of greys of the given size with every pixel set to 0,
+// or one with no pixels if out of memory
+board newBoard(int width, int height);
 
-// free allocated memory of a board pointer
+// initialise pixel grid of the given size based on pgm file input stream
+board initialiseBoard(FILE *in, int width, int height);
+
+// initialise pixel grid of the given size based on a .ppm or .pam file input
+// stream with CHANNELS bytes a pixel. each distinct colour is given a place
+// in the board's palette, found in a hash table as the pixels are read, and
+// its pixels are set to that place
+board initialiseColourBoard(FILE *in, int width, int height, int channels);
+
+// free allocated memory of a board pointer, and of its palette
 void freeBoard(board b);
 
-// initialise all the counts of the 256 colours based on the values
-// currently stored in the board
+// initialise all the counts of the board's colours, the 256 greys unless it
+// has a palette, and the box each lies in, based on the values currently
+// stored in the board, not counting FIXED pixels
 colourInfo *initialiseColourInfo(board b);
 
 // free allocated memory of a pointer to a list of colourinfos
@@ -78,40 +118,168 @@ void move(FILE *out, int pixels, const int axisCode);
 // using run length encoding (RLE) algorithm
 void writeToSK_RLE(FILE *out, board b);
 
+// moves back to the left of the board, one row down from the current position
+void resetx(FILE *out);
+
+// writes to .sk file commands to draw one row of pixels from left to right,
+// as a line for each run of the same colour. COLOUR is the colour currently
+// set, and is updated as it changes. the pixels are places in PALETTE, or
+// greys if it is NULL
+void writeRowRuns(FILE *out, int row[], int width, int *colour, unsigned int palette[]);
+
+// writes to .sk file commands to draw an image from .pgm file using run
+// length encoding along rows, the same commands as writeToSK_Stripes
+void writeToSK_Rows(FILE *out, board b);
+
+// writes to .sk file commands to draw the pixels of a .pgm file, read after
+// its header, using run length encoding along rows. only STRIPEHEIGHT rows
+// are held in memory at a time, so images of any size can be converted
+void writeToSK_Stripes(FILE *in, FILE *out, int width, int height, int stripeHeight);
+
 // writes to .sk file commands to set location to POS in the x or y direction
-void set(FILE *out, unsigned char pos, int AxisCode);
+void set(FILE *out, int pos, int AxisCode);
 
 // writes to .sk file commands to move position, then updating the current
 // position to where you have just moved
 void changePosition(FILE *out, position *current, position next, bool drawingBox);
 
+// counts the bytes changePosition writes to move from CURRENT to NEXT,
+// without writing them
+long positionLength(position current, position next, bool drawingBox);
+
+// makes encoding finish MILLISECONDS from now, refining no further once out
+// of time, or removes the limit if 0
+void setDeadline(long milliseconds);
+
+// checks whether encoding has run out of time
+bool pastDeadline(void);
+
 // sets all CORRECT pixels in a board to be FIXED 
 void finalise(board b);
 
 // finds position in board of the first pixel of a colour, in reading order
 // assuming you read down to the end of the page first then go right
-position findPixel(unsigned char greyValue, board b);
+position findPixel(int value, board b);
 
 // finds the box with the most unfilled in pixels of a colour without 
 // overrwriting any fixed pixels
-position findBoxEnd(position startPos, board b, unsigned char greyValue);
+position findBoxEnd(position startPos, board b, int value);
 
 // updates board state given a box that has just been filled with a colour
-void updateBoxBoard(unsigned char colour, position start, position end, board b);
+void updateBoxBoard(int colour, position start, position end, board b);
+
+// writes to .sk file commands to draw a box from START to END, moving to its
+// start first if needed
+void writeBox(FILE *out, position *currentPos, position start, position end, bool usingLines);
 
 // writes to .sk file commands to fill all pixels of a certain colour 
-// making sure not to overwrite any fixed pixels
-void fillColour(FILE *out, board b, unsigned char greyValue, position *currentPos, bool usingLines);
+// making sure not to overwrite any fixed pixels. stops early once out of
+// time, leaving the rest to finishInRows
+void fillColour(FILE *out, board b, int value, position *currentPos, bool usingLines);
+
+// writes to .sk file commands to fill all pixels of a certain colour like
+// fillColour, but finds every box first, then draws them in a tour that
+// always goes to whichever box is fewest bytes away next
+void fillColourToured(FILE *out, board b, int value, position *currentPos, bool usingLines);
+
+// writes to .sk file commands to fill all pixels of a certain colour like
+// fillColour, but keeps a box from every corner of the pixels left in a
+// queue and always takes the one filling the most pixels per byte, finding
+// again only the boxes that overlap it. the boxes are then toured
+void fillColourLargestFirst(FILE *out, board b, int value, position *currentPos, bool usingLines);
+
+// writes to .sk file commands to draw every pixel not yet FIXED as a box
+// one pixel high for each run of the same colour along a row, the fastest
+// way to finish a board once out of time. the runs are drawn a colour at a
+// time, in the order the colours are first found, so each colour is only
+// set once
+void finishInRows(FILE *out, board b, position *currentPos, bool usingLines);
 
 int compareColourInfo(const void *p, const void *q);
 
+// writes to .sk file commands to draw each colour in the order given using
+// the BOX algorithm, choosing each colour's boxes by SELECTION. once out of
+// time, the rest of the board is finished in rows. C has an entry for each
+// of the board's colours
+void writeColours(FILE *out, board b, colourInfo c[], bool usingLines, int selection);
+
 // writes to .sk file commands to draw an image from .pgm file
 // using BOX algorithm
-void writeToSK_BOX(FILE *out, board b, colourInfo c[GREYSCALE_COLOURS], bool usingLines);
-
-void writeToSK(FILE *out, board b, colourInfo c[GREYSCALE_COLOURS], int method, bool usingLines);
-// converts a .pgm into a .sk file
-void convertToSK(char filein[], bool confirmation, bool usingLines);
+void writeToSK_BOX(FILE *out, board b, colourInfo c[], bool usingLines);
+
+// writes to .sk file commands to draw an image from .pgm file using the BOX
+// algorithm, taking each colour's boxes largest first
+void writeToSK_Largest(FILE *out, board b, colourInfo c[], bool usingLines);
+
+// writes to .sk file commands to draw an image from .pgm file using the BOX
+// algorithm, touring each colour's boxes, then keeps swapping neighbouring
+// colours in the drawing order while that writes fewer bytes, until no swap
+// helps, ORDER_PASSES passes have been made or it runs out of time. each swap
+// is judged only by the colours next to it, so a pass over the order costs
+// about eight drawings of the image
+void writeToSK_Exhaustive(FILE *out, board b, colourInfo c[], bool usingLines);
+
+void writeToSK(FILE *out, board b, colourInfo c[], int method, bool usingLines);
+
+// writes to .sk file commands to draw a board using the given algorithm,
+// then removes any overdraw if REMOVING_OVERDRAW and there is still time.
+// run length encoding only ever draws over the last pixel of each line,
+// which can't be removed without moving, so only boxes are checked
+void writeSketch(FILE *out, board b, int method, bool usingLines);
+
+// converts a .pgm into a .sk file using the STRIPES algorithm, reading
+// STRIPEHEIGHT rows of the image at a time
+void convertToSKInStripes(char filein[], bool confirmation, int stripeHeight);
+
+// converts a .pgm into a .sk file using the given algorithm
+void convertToSK(char filein[], bool confirmation, int method, bool usingLines);
+
+// converts a .pgm into a .sk file using the given algorithm, first reducing
+// the image to LEVELS greys unless LEVELS is 0. returns the PSNR of the image
+// drawn against the original, which is INFINITY if nothing was lost
+double convertToSKLossy(char filein[], bool confirmation, int method, bool usingLines,
+                        int levels, bool dithering);
+
+// converts a .ppm or .pam into a .sk file using the given algorithm, with
+// each distinct colour drawn as a layer of its own. the BOX algorithms set
+// each colour once, when its layer is drawn
+void convertColourToSK(char filein[], bool confirmation, int method, bool usingLines);
+
+// writes to .sk file commands to draw the pixels of a .pgm file of the given
+// size, read after its header, using the given algorithm, first reducing the
+// image to LEVELS greys unless LEVELS is 0. without that, the STRIPES
+// algorithm reads STRIPEHEIGHT rows at a time. returns the PSNR of the image
+// drawn against the original, which is INFINITY if nothing was lost
+double writePGMToSK(FILE *in, FILE *out, int width, int height, int method, int stripeHeight,
+                    bool usingLines, int levels, bool dithering);
+
+// marks every pixel of a frame FIXED except those inside the smallest box
+// around the pixels that changed since the last frame, found separately in
+// each DIRTY_TILE square, so only what changed is drawn again. returns the
+// number of pixels left to draw
+long maskUnchanged(board frame, board last);
+
+// converts a sequence of .pgm files of the same size into one animated .sk
+// file, with each frame after the first drawing only what changed since the
+// frame before, apart from every KEYFRAMEINTERVAL frames being drawn in full.
+// returns false, saying why, if a frame can't be read or the file written
+bool convertFramesToSK(int count, char *frames[], char fileout[], bool confirmation,
+                       int keyframeInterval, bool usingLines);
+
+// writes the seek index of a .sk file drawn on a canvas of the given size
+void indexSK(char skFile[], bool confirmation, int width, int height);
+
+// marks each DIRTY_TILE square of an image, counting along its rows, with
+// any pixel that differs from the last image
+void markChangedTiles(board image, board last, bool dirty[]);
+
+// rewrites a .sk file to draw a new .pgm image of the same size, keeping its
+// commands for every DIRTY_TILE square that hasn't changed and drawing only
+// the rest again. the changes are taken to lie in the box from START to END,
+// or if that is empty, are found by comparing against the image the file draws.
+// returns false, saying why, if a file can't be read or written
+bool updateSK(char skFile[], char filein[], bool confirmation, position start, position end,
+              bool usingLines);
 
 // signs an signed 6 bit two's complement number
 int sign(unsigned char x);
@@ -119,17 +287,38 @@ int sign(unsigned char x);
 // converts RGBA colour to its corresponding greyscale value
 unsigned char RGBAToGreyscale(unsigned int c);
 
-// updates board state when a line is drawn
-// does not support diagonal lines
-void drawLine(unsigned char c, position start, position end, int b[HEIGHT][WIDTH]);
+// updates board state when a line is drawn, ignoring any pixels off the board
+// does not support diagonal lines, returning false if given one
+bool drawLine(unsigned char c, position start, position end, board b);
+
+// updates board state when a box is drawn, ignoring any pixels off the board
+void drawBox(unsigned char c, position start, position end, board b);
+
+// writes to board the image drawn from the commands in a .sk file, returning
+// false if it draws a diagonal line or can't be read whole
+bool convertSKToBoard(FILE *in, board b);
+
+// writes to board one frame of a .sk file as the viewer shows it, drawing
+// only from the latest frame up to it that covers the canvas, as found in
+// the file's seek index. returns false if the frame is not in the index, a
+// diagonal line is drawn or the file can't be read whole
+bool convertSKFrameToBoard(FILE *in, FILE *index, long frame, board b);
+
+// writes a board as a binary .pgm image
+void writeBoard(FILE *out, board b);
 
-// updates board state when a box is drawn
-void drawBox(unsigned char c, position start, position end, int b[HEIGHT][WIDTH]);
+// converts one frame of a .sk file into a .pgm file of the given size, using
+// the seek index beside it to start near the frame
+void convertFrameToPGM(char filein[], bool confirmation, int width, int height, long frame);
 
-// writes to board the image drawn from the commands in a .sk file
-void convertSKToBoard(FILE *in, int b[HEIGHT][WIDTH]);
+// writes to board the image drawn from the commands in a .sk file like
+// convertSKToBoard, but reads every draw first and then splits the board
+// into THREADS bands of rows, each drawn by its own thread. every thread
+// draws in the file's order and only into its own rows, so none need locks
+bool convertSKToBoardInBands(FILE *in, board b, int threads);
 
-// converts a .sk file into a .pgm file
-void convertToPGM(char filein[]);
+// converts a .sk file into a .pgm file of the given size, drawn by THREADS
+// threads at once
+void convertToPGM(char filein[], bool confirmation, int width, int height, int threads);
 
 #endif
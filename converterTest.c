@@ -1,9 +1,26 @@
+#include "batch.h"
 #include "converter.h"
 #include "converterTest.h"
+#include "envelope.h"
+#include "interpreter.h"
+#include "overdraw.h"
+#include "quantise.h"
+#include "seekindex.h"
+#include "stats.h"
+#include "libsketch.h"
+#include <sys/stat.h>
+#include <unistd.h>
+
+// tests that encode fractal.pgm encode a copy of it, so the fractal.sk the
+// trace tests check is left as it is committed
+#define FRACTAL_COPY "fractalCopy.pgm"
+#define FRACTAL_COPY_SK "fractalCopy.sk"
 
 void testParseFiletype() {
     assert(parseFiletype("a.pgm") == PGM);
     assert(parseFiletype("b.sk") == SK);
+    assert(parseFiletype("c.ppm") == PPM);
+    assert(parseFiletype("d.pam") == PAM);
     assert(parseFiletype(".pgm") == INVALID);
     assert(parseFiletype("c.jpg") == INVALID);
     assert(parseFiletype("abcde") == INVALID);
@@ -51,7 +68,7 @@ void testInitialiseBoard() {
     // discard file header as this is a known correct format pgm file
     char discard[MAX_PGM_HEADER_CHARS];
     fgets(discard, MAX_PGM_HEADER_CHARS, in); 
-    board b = initialiseBoard(in);
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
 
     // close and reopen file so we can start reading from the beginning
     // of the file again to check it matches the generated board
@@ -62,7 +79,7 @@ void testInitialiseBoard() {
     for (int i=0; i<HEIGHT; i++) {
         for (int j=0; j<WIDTH; j++) {
             unsigned char ch = fgetc(in);
-            assert(b[i][j] == ch);
+            assert(b.pixels[i][j] == ch);
         }
     }
     freeBoard(b);
@@ -73,7 +90,7 @@ void testInitialiseColours() {
     FILE *in = fopen("bands.pgm", "r");
     char discard[MAX_PGM_HEADER_CHARS];
     fgets(discard, MAX_PGM_HEADER_CHARS, in); 
-    board b = initialiseBoard(in);
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
     fclose(in);
 
     // count all instances of each of the 256 colours, individually
@@ -83,7 +100,7 @@ void testInitialiseColours() {
         int count = 0;
         for (int j=0; j<HEIGHT; j++) {
             for (int k=0; k<WIDTH; k++) {
-                if (b[j][k] == i) count++;
+                if (b.pixels[j][k] == i) count++;
             }
         }
         assert(c[i].count == count);
@@ -153,6 +170,8 @@ void testSet() {
     set(out, 94, TARGETY);
     set(out, 128, TARGETY);
 
+    set(out, 5000, TARGETX); // positions past 4095 need a third data command
+
     fclose(out);
     unsigned char commands[40] = {
         0x84,
@@ -167,10 +186,12 @@ void testSet() {
         0xff, 0x85, 0x40,
         0xff, 0x85, 0x41,
         0xff, 0x85, 0x5f,
-        0xc2, 0xc0, 0x85, 0x40
+        0xc2, 0xc0, 0x85, 0x40,
+
+        0xc1, 0xce, 0xc8, 0x84
     };
     FILE *in = fopen("testing.txt", "r");
-    for (int i=0; i<32; i++) {
+    for (int i=0; i<36; i++) {
         unsigned char ch = fgetc(in);
         assert(commands[i] == ch);
     }
@@ -211,13 +232,31 @@ void testChangePosition() {
         assert(commands[i] == ch);
     }
     fclose(in);     
+
+    // and the bytes it writes can be counted without writing them
+    out = tmpfile();
+    int steps[] = {0, 1, 31, 32, 33, 62, 63, 64, 94, 95, 96, 200, 4095, 4096, 5000};
+    int n = sizeof(steps) / sizeof(steps[0]);
+    for (int a=0; a<n; a++) {
+        for (int b=0; b<n; b++) {
+            for (int k=0; k<4; k++) {
+                current = (position) {steps[a], steps[b]};
+                next = (position) {steps[(a + k) % n], steps[(b + 2 * k) % n]};
+                long length = positionLength(current, next, k % 2 == 1);
+                rewind(out);
+                changePosition(out, &current, next, k % 2 == 1);
+                assert(ftell(out) == length);
+            }
+        }
+    }
+    fclose(out);
 }
 
 void testFindPixel() {
     FILE *in = fopen("bands.pgm", "r");
     char discard[MAX_PGM_HEADER_CHARS];
     fgets(discard, MAX_PGM_HEADER_CHARS, in); 
-    board b = initialiseBoard(in);
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
     fclose(in);
     
     position pixel = findPixel(0, b);
@@ -226,7 +265,7 @@ void testFindPixel() {
     pixel = findPixel(255, b); 
     assert(pixel.x == 0 && pixel.y == 180);
 
-    b[199][167] = 254;
+    b.pixels[199][167] = 254;
     pixel = findPixel(254, b);
     assert(pixel.x == 167 && pixel.y == 199);
     freeBoard(b);
@@ -236,30 +275,30 @@ void testFindBoxEnd() {
     FILE *in = fopen("bands.pgm", "r");
     char discard[MAX_PGM_HEADER_CHARS];
     fgets(discard, MAX_PGM_HEADER_CHARS, in); 
-    board b = initialiseBoard(in);
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
     fclose(in);
 
     position start = (position) {0, 0};
     position end = findBoxEnd(start, b, 255);
     assert(end.x == 200 && end.y == 200);
 
-    b[150][100] = FIXED;
+    b.pixels[150][100] = FIXED;
     end = findBoxEnd(start, b, 255);
     assert(end.x == 100 && end.y == 200);
 
-    b[185][0] = FIXED;
+    b.pixels[185][0] = FIXED;
     end = findBoxEnd(start, b, 255);
     assert(end.x == 100 && end.y == 185);
     
-    b[100][0] = FIXED;
+    b.pixels[100][0] = FIXED;
     end = findBoxEnd(start, b, 113);
     assert(end.x == 200 && end.y == 100);
 
-    b[1][0] = FIXED;
+    b.pixels[1][0] = FIXED;
     end = findBoxEnd(start, b, 0);
     assert(end.x == 200 && end.y == 1);
 
-    b[0][1] = FIXED;
+    b.pixels[0][1] = FIXED;
     end = findBoxEnd(start, b, 0);
     assert(end.x == 1 && end.y == 1);
     freeBoard(b);
@@ -269,16 +308,16 @@ void testUpdateBoxBoard() {
     FILE *in = fopen("bands.pgm", "r");
     char discard[MAX_PGM_HEADER_CHARS];
     fgets(discard, MAX_PGM_HEADER_CHARS, in); 
-    board b = initialiseBoard(in);
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
     fclose(in);
 
     updateBoxBoard(226, (position) {10, 150}, (position) {50, 170}, b);
     for (int i=0; i<HEIGHT; i++) {
         for (int j=0; j<WIDTH; j++) {
             if (160 <= i && i < 170 && 10 <= j && j < 50) {
-                assert(b[i][j] == CORRECT);
+                assert(b.pixels[i][j] == CORRECT);
                 }
-            else assert(b[i][j] != CORRECT); 
+            else assert(b.pixels[i][j] != CORRECT); 
         }
     }
     freeBoard(b);
@@ -288,7 +327,7 @@ void testFinalise() {
     FILE *in = fopen("bands.pgm", "r");
     char discard[MAX_PGM_HEADER_CHARS];
     fgets(discard, MAX_PGM_HEADER_CHARS, in); 
-    board b = initialiseBoard(in);
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
     fclose(in);
 
     updateBoxBoard(226, (position) {10, 150}, (position) {50, 170}, b);
@@ -296,11 +335,11 @@ void testFinalise() {
     for (int i=0; i<HEIGHT; i++) {
         for (int j=0; j<WIDTH; j++) {
             if (160 <= i && i < 170 && 10 <= j && j < 50) {
-                assert(b[i][j] == FIXED);
+                assert(b.pixels[i][j] == FIXED);
                 }
             else {
-                assert(b[i][j] != CORRECT);
-                assert(b[i][j] != FIXED); 
+                assert(b.pixels[i][j] != CORRECT);
+                assert(b.pixels[i][j] != FIXED); 
             }
         }
     }
@@ -309,16 +348,16 @@ void testFinalise() {
 
 void testFillColour() {
     FILE *in = fopen("bands.pgm", "r");
-    board b = initialiseBoard(in);
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
     fclose(in);
 
     for(int i=0; i<HEIGHT; i++) {
-        for (int j=0; j<WIDTH; j++) {b[i][j] = 100;}
+        for (int j=0; j<WIDTH; j++) {b.pixels[i][j] = 100;}
     }
-    b[0][0] = 0;
-    b[31][31] = 0;
-    b[31][32] = 0;
-    b[32][33] = 1;
+    b.pixels[0][0] = 0;
+    b.pixels[31][31] = 0;
+    b.pixels[31][32] = 0;
+    b.pixels[32][33] = 1;
 
     FILE *out = fopen("testing.txt", "w");
     position currentPos = (position) {0, 0};
@@ -374,15 +413,15 @@ void testFillColour() {
 
 void testWriteToSK_BOX() {
     FILE *in = fopen("bands.pgm", "r");
-    board b = initialiseBoard(in);
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
     fclose(in);
     for(int i=0; i<HEIGHT; i++) {
-        for (int j=0; j<WIDTH; j++) {b[i][j] = 100;}
+        for (int j=0; j<WIDTH; j++) {b.pixels[i][j] = 100;}
     }
 
-    b[1][1] = 0;
-    b[198][197] = 255;
-    b[199][197] = 255;
+    b.pixels[1][1] = 0;
+    b.pixels[198][197] = 255;
+    b.pixels[199][197] = 255;
     colourInfo *c = initialiseColourInfo(b);
 
     FILE *out = fopen("testing.txt", "w");
@@ -428,6 +467,644 @@ void testWriteToSK_BOX() {
     fclose(in);
 }
 
+void testWriteToSK_RLE() {
+    FILE *in = fopen("bands.pgm", "r");
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
+    fclose(in);
+    for(int i=0; i<HEIGHT; i++) {
+        for (int j=0; j<WIDTH; j++) {b.pixels[i][j] = 255;}
+    }
+
+    FILE *out = fopen("testing.txt", "w");
+    writeToSK_RLE(out, b);
+    fclose(out);
+    freeBoard(b);
+
+    // the first colour has to be set even if it is white
+    unsigned char commands[19] = {
+        0xc3, 0xff, 0xff, 0xff, 0xff, 0xff, 0x83, // set colour to 255
+        0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x5f, 0x4e, // line down by 200
+        0x80, 0x85, 0x01, 0x40, 0x81 // reset to the top of the next column
+    };
+    in = fopen("testing.txt", "r");
+    for (int i=0; i<19; i++) {
+        unsigned char ch = fgetc(in);
+        assert(commands[i] == ch);
+    }
+    fclose(in);
+}
+
+void testWriteToSK_Stripes() {
+    // a 4x2 image, read a row at a time
+    unsigned char pixels[8] = {10, 10, 20, 20, 20, 20, 20, 20};
+    FILE *in = tmpfile();
+    fwrite(pixels, 1, 8, in);
+    rewind(in);
+    FILE *out = fopen("testing.txt", "w");
+    writeToSK_Stripes(in, out, 4, 2, 1);
+    fclose(out);
+    fclose(in);
+
+    unsigned char commands[22] = {
+        0xca, 0xc2, 0xe0, 0xeb, 0xff, 0x83, // set colour to 10
+        0x02, 0x40, // line right by 2
+        0xd4, 0xc5, 0xc1, 0xd3, 0xff, 0x83, // set colour to 20
+        0x02, 0x40, // line right by 2, off the end of the row
+        0x80, 0x84, 0x41, 0x81, // reset to the left of the next row
+        0x04, 0x40 // colour is still 20, so line right by 4
+    };
+    in = fopen("testing.txt", "r");
+    for (int i=0; i<22; i++) {
+        unsigned char ch = fgetc(in);
+        assert(commands[i] == ch);
+    }
+    assert(fgetc(in) == EOF);
+    fclose(in);
+
+    // stripes that don't divide the height still draw the whole image
+    in = fopen("fractal.pgm", "rb");
+    int width, height;
+    assert(readPGMHeader(in, &width, &height));
+    out = fopen("testing.txt", "wb");
+    writeToSK_Stripes(in, out, width, height, 7);
+    fclose(out);
+    rewind(in);
+    readPGMHeader(in, &width, &height);
+    board original = initialiseBoard(in, width, height);
+    fclose(in);
+
+    in = fopen("testing.txt", "rb");
+    board new = newBoard(width, height);
+    assert(convertSKToBoard(in, new));
+    fclose(in);
+    for(int i=0; i<height; i++) {
+        for(int j=0; j<width; j++) {
+            assert(original.pixels[i][j] == new.pixels[i][j]);
+        }
+    }
+    freeBoard(new);
+
+    // the same commands are written from a board already in memory
+    out = fopen("testing.txt", "wb");
+    writeToSK_Rows(out, original);
+    fclose(out);
+    in = fopen("testing.txt", "rb");
+    new = newBoard(width, height);
+    assert(convertSKToBoard(in, new));
+    fclose(in);
+    for(int i=0; i<height; i++) {
+        for(int j=0; j<width; j++) {
+            assert(original.pixels[i][j] == new.pixels[i][j]);
+        }
+    }
+    freeBoard(original);
+    freeBoard(new);
+}
+
+void testFinishInRows() {
+    board b = newBoard(3, 2);
+    b.pixels[0][0] = FIXED; b.pixels[0][1] = 5; b.pixels[0][2] = 5;
+    b.pixels[1][0] = 7; b.pixels[1][1] = FIXED; b.pixels[1][2] = 7;
+
+    FILE *out = fopen("testing.txt", "w");
+    position currentPos = (position) {0, 0};
+    finishInRows(out, b, &currentPos, true);
+    fclose(out);
+    freeBoard(b);
+
+    unsigned char commands[28] = {
+        0xc5, 0xc1, 0xd0, 0xd7, 0xff, 0x83, // set colour to 5
+        0x80, 0x01, 0x40, // move by (1, 0), around the fixed pixel
+        0x82, 0x02, 0x41, // box by (2, 1) to (3, 1)
+        0xc7, 0xc1, 0xf0, 0xdf, 0xff, 0x83, // set colour to 7
+        0x80, 0x3d, 0x40, // move by (-3, 0) to (0, 1)
+        0x81, 0x40, // fill in (0, 1)
+        0x80, 0x02, 0x40, // move by (2, 0), around the fixed pixel
+        0x81, 0x40 // fill in (2, 1)
+    };
+    FILE *in = fopen("testing.txt", "r");
+    for (int i=0; i<28; i++) {
+        unsigned char ch = fgetc(in);
+        assert(commands[i] == ch);
+    }
+    assert(fgetc(in) == EOF);
+    fclose(in);
+}
+
+void testFillColourToured() {
+    // two pixels of colour 1, found from the left but nearest from the right
+    board b = newBoard(40, 1);
+    for (int i=1; i<39; i++) b.pixels[0][i] = FIXED;
+    b.pixels[0][0] = 1;
+    b.pixels[0][39] = 1;
+    FILE *out = fopen("testing.txt", "w");
+    position currentPos = (position) {39, 0};
+    fillColourToured(out, b, 1, &currentPos, USING_LINES);
+    fclose(out);
+    freeBoard(b);
+
+    FILE *in = fopen("testing.txt", "r");
+    unsigned char commands[7] = {
+        0x81, 0x40, // fill in (39, 0) without moving
+        0x80, 0x84, 0x40, // set position to (0, 0)
+        0x81, 0x40 // fill in (0, 0)
+    };
+    for (int i=0; i<7; i++) {
+        unsigned char ch = fgetc(in);
+        assert(commands[i] == ch);
+    }
+    assert(fgetc(in) == EOF);
+    fclose(in);
+}
+
+void testDeadline() {
+    setDeadline(0);
+    assert(!pastDeadline());
+    setDeadline(1);
+    while (!pastDeadline());
+
+    // out of time before starting, so everything is drawn in rows
+    FILE *in = fopen("fractal.pgm", "rb");
+    char discard[MAX_PGM_HEADER_CHARS];
+    fgets(discard, MAX_PGM_HEADER_CHARS, in); 
+    board original = initialiseBoard(in, WIDTH, HEIGHT);
+    rewind(in);
+    fgets(discard, MAX_PGM_HEADER_CHARS, in); 
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
+    fclose(in);
+    FILE *out = fopen("testing.txt", "wb");
+    writeSketch(out, b, EXHAUSTIVE, USING_LINES);
+    fclose(out);
+    freeBoard(b);
+    setDeadline(0);
+
+    in = fopen("testing.txt", "rb");
+    board new = newBoard(WIDTH, HEIGHT);
+    assert(convertSKToBoard(in, new));
+    fclose(in);
+    for(int i=0; i<HEIGHT; i++) {
+        for(int j=0; j<WIDTH; j++) {
+            assert(original.pixels[i][j] == new.pixels[i][j]);
+        }
+    }
+    freeBoard(original);
+    freeBoard(new);
+}
+
+void testWriteToSK_Largest() {
+    // fractal.pgm, whose colours make many small boxes
+    FILE *in = fopen("fractal.pgm", "rb");
+    char discard[MAX_PGM_HEADER_CHARS];
+    fgets(discard, MAX_PGM_HEADER_CHARS, in);
+    board original = initialiseBoard(in, WIDTH, HEIGHT);
+    fclose(in);
+    board b = newBoard(WIDTH, HEIGHT);
+    long lengths[2];
+    for (int k=0; k<2; k++) {
+        for (int i=0; i<HEIGHT; i++) {
+            memcpy(b.pixels[i], original.pixels[i], WIDTH * sizeof(int));
+        }
+        colourInfo *c = initialiseColourInfo(b);
+        FILE *out = fopen("testing.txt", "wb");
+        if (k == 0) writeToSK_BOX(out, b, c, USING_LINES);
+        else writeToSK_Largest(out, b, c, USING_LINES);
+        lengths[k] = ftell(out);
+        fclose(out);
+        freeColourInfo(c);
+    }
+    // taking the boxes that fill the most per byte first writes fewer bytes
+    assert(lengths[1] < lengths[0]);
+    freeBoard(b);
+
+    in = fopen("testing.txt", "rb");
+    board new = newBoard(WIDTH, HEIGHT);
+    assert(convertSKToBoard(in, new));
+    fclose(in);
+    for (int i=0; i<HEIGHT; i++) {
+        for (int j=0; j<WIDTH; j++) assert(original.pixels[i][j] == new.pixels[i][j]);
+    }
+    freeBoard(original);
+    freeBoard(new);
+}
+
+void testWriteToSK_Exhaustive() {
+    // five bands with a few colours drawn over them, so there is an order
+    // to search
+    int size = 40;
+    board original = newBoard(size, size);
+    for (int i=0; i<size; i++) {
+        for (int j=0; j<size; j++) original.pixels[i][j] = 30 * (i / 8);
+    }
+    for (int i=4; i<36; i++) {
+        original.pixels[i][i] = 0;
+        original.pixels[i][20] = 128;
+        original.pixels[20][i] = 255;
+    }
+    board b = newBoard(size, size);
+    for (int i=0; i<size; i++) {
+        for (int j=0; j<size; j++) b.pixels[i][j] = original.pixels[i][j];
+    }
+
+    // never longer than the toured colours in order of count
+    colourInfo *c = initialiseColourInfo(b);
+    qsort(c, GREYSCALE_COLOURS, sizeof(colourInfo), compareColourInfo);
+    FILE *out = fopen("testing.txt", "wb");
+    writeColours(out, b, c, USING_LINES, TOURED);
+    long touredLength = ftell(out);
+    fclose(out);
+    freeColourInfo(c);
+
+    for (int i=0; i<size; i++) {
+        for (int j=0; j<size; j++) b.pixels[i][j] = original.pixels[i][j];
+    }
+    c = initialiseColourInfo(b);
+    out = fopen("testing.txt", "wb");
+    writeToSK_Exhaustive(out, b, c, USING_LINES);
+    assert(ftell(out) <= touredLength);
+    fclose(out);
+    freeColourInfo(c);
+    freeBoard(b);
+
+    FILE *in = fopen("testing.txt", "rb");
+    board new = newBoard(size, size);
+    assert(convertSKToBoard(in, new));
+    fclose(in);
+    for(int i=0; i<size; i++) {
+        for(int j=0; j<size; j++) {
+            assert(original.pixels[i][j] == new.pixels[i][j]);
+        }
+    }
+    freeBoard(original);
+    freeBoard(new);
+}
+
+void testFindPalette() {
+    // two clusters of greys, each taking its mean
+    board b = newBoard(2, 2);
+    b.pixels[0][0] = 10; b.pixels[0][1] = 12;
+    b.pixels[1][0] = 200; b.pixels[1][1] = 202;
+    unsigned char palette[256];
+    assert(findPalette(b, 2, palette) == 2);
+    assert(palette[0] == 11 && palette[1] == 201);
+
+    // never more levels than there are greys
+    assert(findPalette(b, 8, palette) == 4);
+    assert(palette[0] == 10 && palette[3] == 202);
+    assert(findPalette(b, 1, palette) == 1);
+    assert(palette[0] == 106);
+    freeBoard(b);
+
+    assert(nearestLevel((unsigned char[]) {0, 100, 255}, 3, 49) == 0);
+    assert(nearestLevel((unsigned char[]) {0, 100, 255}, 3, 51) == 100);
+    assert(nearestLevel((unsigned char[]) {0, 100, 255}, 3, 300) == 255);
+}
+
+void testQuantise() {
+    board b = newBoard(2, 2);
+    b.pixels[0][0] = 10; b.pixels[0][1] = 12;
+    b.pixels[1][0] = 200; b.pixels[1][1] = 202;
+    board original = newBoard(2, 2);
+    for (int i=0; i<2; i++) {
+        for (int j=0; j<2; j++) original.pixels[i][j] = b.pixels[i][j];
+    }
+    assert(isinf(psnr(original, b)));
+    quantise(b, 2, false);
+    assert(b.pixels[0][0] == 11 && b.pixels[0][1] == 11);
+    assert(b.pixels[1][0] == 201 && b.pixels[1][1] == 201);
+    // every pixel out by 1
+    assert(fabs(psnr(original, b) - 10 * log10(255.0 * 255.0)) < 1e-9);
+    freeBoard(b);
+    freeBoard(original);
+
+    // dithering a gradient down to two greys keeps its overall brightness
+    b = newBoard(64, 16);
+    long before = 0, after = 0;
+    for (int i=0; i<16; i++) {
+        for (int j=0; j<64; j++) {
+            b.pixels[i][j] = j * 4;
+            before += b.pixels[i][j];
+        }
+    }
+    quantise(b, 2, true);
+    unsigned char palette[256];
+    assert(findPalette(b, 256, palette) == 2);
+    for (int i=0; i<16; i++) {
+        for (int j=0; j<64; j++) after += b.pixels[i][j];
+    }
+    assert(labs(after - before) < 64 * 16);
+    freeBoard(b);
+}
+
+void testConvertToSKLossy() {
+    FILE *in = fopen("fractal.pgm", "rb");
+    char discard[MAX_PGM_HEADER_CHARS];
+    fgets(discard, MAX_PGM_HEADER_CHARS, in); 
+    board original = initialiseBoard(in, WIDTH, HEIGHT);
+    fclose(in);
+
+    // fewer greys draw in fewer bytes, and decode to the quantised image
+    convertToSK(FRACTAL_COPY, false, BOX, USING_LINES);
+    in = fopen(FRACTAL_COPY_SK, "rb");
+    fseek(in, 0, SEEK_END);
+    long losslessLength = ftell(in);
+    fclose(in);
+    assert(isinf(convertToSKLossy(FRACTAL_COPY, false, BOX, USING_LINES, 0, false)));
+    double quality = convertToSKLossy(FRACTAL_COPY, false, BOX, USING_LINES, 8, false);
+    assert(20 < quality && quality < INFINITY);
+    in = fopen(FRACTAL_COPY_SK, "rb");
+    fseek(in, 0, SEEK_END);
+    assert(ftell(in) < losslessLength / 2);
+    rewind(in);
+    board new = newBoard(WIDTH, HEIGHT);
+    assert(convertSKToBoard(in, new));
+    fclose(in);
+    assert(fabs(psnr(original, new) - quality) < 1e-9);
+
+    freeBoard(original);
+    freeBoard(new);
+    convertToSK(FRACTAL_COPY, false, BOX, USING_LINES);
+
+    // an image that can't be opened, or a .sk that can't be written, is
+    // reported rather than converted
+    convertToSKInStripes("missing.pgm", false, 4);
+    convertToSKLossy("missing.pgm", false, STRIPES, USING_LINES, 0, false);
+    mkdir(FRACTAL_COPY_SK ".d", 0755);
+    rename(FRACTAL_COPY_SK, FRACTAL_COPY_SK ".bak");
+    rename(FRACTAL_COPY_SK ".d", FRACTAL_COPY_SK);
+    convertToSKInStripes(FRACTAL_COPY, false, 4);
+    convertToSKLossy(FRACTAL_COPY, false, BOX, USING_LINES, 8, false);
+    rmdir(FRACTAL_COPY_SK);
+    rename(FRACTAL_COPY_SK ".bak", FRACTAL_COPY_SK);
+}
+
+void testMaskUnchanged() {
+    board last = newBoard(40, 40);
+    board frame = newBoard(40, 40);
+    frame.pixels[3][3] = 1;
+    frame.pixels[7][5] = 1;
+    frame.pixels[30][30] = 1;
+    // the smallest box around both changes in the first tile, and the one
+    // pixel changed in another
+    assert(maskUnchanged(frame, last) == 3 * 5 + 1);
+    assert(frame.pixels[3][3] == 1 && frame.pixels[3][5] == 0 && frame.pixels[7][4] == 0);
+    assert(frame.pixels[2][3] == FIXED && frame.pixels[3][6] == FIXED);
+    assert(frame.pixels[30][30] == 1 && frame.pixels[30][31] == FIXED);
+    assert(frame.pixels[39][39] == FIXED);
+    freeBoard(frame);
+
+    // nothing to draw again if nothing changed
+    frame = newBoard(40, 40);
+    assert(maskUnchanged(frame, last) == 0);
+    freeBoard(frame);
+    freeBoard(last);
+}
+
+// writes pixels to a .pgm file
+static void writeFrame(char filename[], board b) {
+    FILE *out = fopen(filename, "wb");
+    fprintf(out, "P5 %d %d 255\n", b.width, b.height);
+    for (int i=0; i<b.height; i++) {
+        for (int j=0; j<b.width; j++) fputc(b.pixels[i][j], out);
+    }
+    fclose(out);
+}
+
+// decodes a .sk file up to the end of frame LAST, counting from 0
+static board decodeFrames(char filename[], int last) {
+    FILE *in = fopen(filename, "rb");
+    char *commands = malloc(1 << 20);
+    size_t length = 0;
+    int frames = 0, ch = fgetc(in);
+    while (ch != EOF && !(ch == 0x88 && frames++ == last)) {
+        commands[length++] = ch;
+        ch = fgetc(in);
+    }
+    fclose(in);
+    FILE *sketch = tmpfile();
+    fwrite(commands, 1, length, sketch);
+    rewind(sketch);
+    free(commands);
+    board b = newBoard(WIDTH, HEIGHT);
+    assert(convertSKToBoard(sketch, b));
+    fclose(sketch);
+    return b;
+}
+
+void testConvertFramesToSK() {
+    // a still image, then a small square changing, then nothing changing
+    FILE *in = fopen("fractal.pgm", "rb");
+    char discard[MAX_PGM_HEADER_CHARS];
+    fgets(discard, MAX_PGM_HEADER_CHARS, in); 
+    board frames[3];
+    for (int f=0; f<3; f++) {
+        rewind(in);
+        fgets(discard, MAX_PGM_HEADER_CHARS, in); 
+        frames[f] = initialiseBoard(in, WIDTH, HEIGHT);
+    }
+    fclose(in);
+    for (int i=50; i<60; i++) {
+        for (int j=120; j<130; j++) frames[1].pixels[i][j] = frames[2].pixels[i][j] = 255 - i;
+    }
+    char *names[3] = {"testing0.pgm", "testing1.pgm", "testing2.pgm"};
+    for (int f=0; f<3; f++) writeFrame(names[f], frames[f]);
+
+    convertToSK(FRACTAL_COPY, false, BOX, USING_LINES);
+    in = fopen(FRACTAL_COPY_SK, "rb");
+    fseek(in, 0, SEEK_END);
+    long stillLength = ftell(in);
+    fclose(in);
+
+    // the changes take far fewer bytes than the first frame, and the last
+    // frame takes none at all
+    assert(convertFramesToSK(3, names, "testing.sk", false, KEYFRAME_INTERVAL, USING_LINES));
+    in = fopen("testing.sk", "rb");
+    fseek(in, 0, SEEK_END);
+    assert(ftell(in) < stillLength + 400);
+    fseek(in, -1, SEEK_END);
+    assert(fgetc(in) == 0x88);
+    fclose(in);
+    for (int f=0; f<3; f++) {
+        board b = decodeFrames("testing.sk", f);
+        for (int i=0; i<HEIGHT; i++) {
+            for (int j=0; j<WIDTH; j++) assert(b.pixels[i][j] == frames[f].pixels[i][j]);
+        }
+        freeBoard(b);
+    }
+
+    // a keyframe every other frame draws the last frame in full again
+    convertFramesToSK(3, names, "testing.sk", false, 2, USING_LINES);
+    in = fopen("testing.sk", "rb");
+    fseek(in, 0, SEEK_END);
+    assert(ftell(in) > stillLength * 3 / 2);
+    fclose(in);
+    board b = decodeFrames("testing.sk", 2);
+    for (int i=0; i<HEIGHT; i++) {
+        for (int j=0; j<WIDTH; j++) assert(b.pixels[i][j] == frames[2].pixels[i][j]);
+    }
+    freeBoard(b);
+
+    // but a frame that can't be read, or an animation that can't be written,
+    // fails the conversion
+    char *missing[] = {names[0], "missing.pgm"};
+    assert(!convertFramesToSK(2, missing, "testing.sk", false, 2, USING_LINES));
+    assert(!convertFramesToSK(3, names, "missing/testing.sk", false, 2, USING_LINES));
+
+    for (int f=0; f<3; f++) {
+        freeBoard(frames[f]);
+        remove(names[f]);
+    }
+    remove("testing.sk");
+    remove("testing.ski");
+}
+
+void testMarkChangedTiles() {
+    board last = newBoard(40, 40);
+    board image = newBoard(40, 40);
+    image.pixels[3][3] = 1;
+    image.pixels[39][20] = 1;
+    bool dirty[9] = {false};
+    markChangedTiles(image, last, dirty);
+    assert(dirty[0] && dirty[2 * 3 + 1]);
+    assert(!dirty[1] && !dirty[3] && !dirty[4] && !dirty[8]);
+    freeBoard(image);
+    freeBoard(last);
+}
+
+// copies a file byte for byte, returning its length
+static long copyFile(char from[], char to[]) {
+    FILE *in = fopen(from, "rb");
+    FILE *out = fopen(to, "wb");
+    long length = 0;
+    for (int ch = fgetc(in); ch != EOF; ch = fgetc(in), length++) fputc(ch, out);
+    fclose(in);
+    fclose(out);
+    return length;
+}
+
+void testUpdateSK() {
+    // a still image with a small square changed
+    FILE *in = fopen("fractal.pgm", "rb");
+    char discard[MAX_PGM_HEADER_CHARS];
+    fgets(discard, MAX_PGM_HEADER_CHARS, in); 
+    board image = initialiseBoard(in, WIDTH, HEIGHT);
+    fclose(in);
+    for (int i=50; i<60; i++) {
+        for (int j=120; j<130; j++) image.pixels[i][j] = 255 - i;
+    }
+    writeFrame("testing.pgm", image);
+    convertToSK(FRACTAL_COPY, false, BOX, USING_LINES);
+
+    // found by comparing against the old image, or given outright, only the
+    // tiles the square is in are drawn again
+    position regions[2][2] = {{{0, 0}, {0, 0}}, {{120, 50}, {130, 60}}};
+    for (int r=0; r<2; r++) {
+        long stillLength = copyFile(FRACTAL_COPY_SK, "testing.sk");
+        assert(updateSK("testing.sk", "testing.pgm", false, regions[r][0], regions[r][1], USING_LINES));
+        in = fopen("testing.sk", "rb");
+        fseek(in, 0, SEEK_END);
+        assert(ftell(in) < stillLength + 400);
+        fclose(in);
+        board b = decodeFrames("testing.sk", 0);
+        for (int i=0; i<HEIGHT; i++) {
+            for (int j=0; j<WIDTH; j++) assert(b.pixels[i][j] == image.pixels[i][j]);
+        }
+        freeBoard(b);
+    }
+
+    // and nothing is written again if nothing changed
+    long length = copyFile("testing.sk", "testing2.sk");
+    assert(updateSK("testing2.sk", "testing.pgm", false, (position) {0, 0}, (position) {0, 0},
+                    USING_LINES));
+    in = fopen("testing2.sk", "rb");
+    fseek(in, 0, SEEK_END);
+    assert(ftell(in) == length);
+    fclose(in);
+
+    // but an image or .sk that can't be opened, or a .sk that can't be
+    // written back, fails the update
+    position none = {0, 0};
+    assert(!updateSK("testing2.sk", "missing.pgm", false, none, none, USING_LINES));
+    assert(!updateSK("missing.sk", "testing.pgm", false, none, none, USING_LINES));
+    mkdir("testing.sk.d", 0755);
+    assert(!updateSK("testing.sk.d", "testing.pgm", false, none, none, USING_LINES));
+    rmdir("testing.sk.d");
+
+    freeBoard(image);
+    remove("testing.pgm");
+    remove("testing.sk");
+    remove("testing2.sk");
+}
+
+void testWriteSeekIndex() {
+    // a coloured frame covering a 10x10 canvas, a line, then another cover
+    FILE *sk = tmpfile();
+    writeColour(sk, 0xff);
+    long colourLength = ftell(sk);
+    unsigned char commands[] = {0x82, 0x0a, 0x4a, 0x88, 0x45, 0x88, 0x82, 0x0a, 0x4a};
+    fwrite(commands, 1, sizeof(commands), sk);
+    rewind(sk);
+    FILE *index = tmpfile();
+    assert(writeSeekIndex(sk, index, 10, 10) == 3);
+    fclose(sk);
+
+    seekEntry e;
+    assert(readSeekEntry(index, 0, &e) && e.offset == 0 && !e.coloured && e.keyframe == 0);
+    assert(readSeekEntry(index, 1, &e) && e.offset == colourLength + 4);
+    assert(e.coloured && e.rgba == 0xff && e.keyframe == 0);
+    assert(readSeekEntry(index, 2, &e) && e.offset == colourLength + 6 && e.keyframe == 2);
+    assert(!readSeekEntry(index, 3, &e) && !readSeekEntry(index, -1, &e));
+    fclose(index);
+}
+
+void testConvertSKFrameToBoard() {
+    // the frames of testConvertFramesToSK, with every other one a keyframe
+    FILE *in = fopen("fractal.pgm", "rb");
+    char discard[MAX_PGM_HEADER_CHARS];
+    board frames[3];
+    for (int f=0; f<3; f++) {
+        rewind(in);
+        fgets(discard, MAX_PGM_HEADER_CHARS, in); 
+        frames[f] = initialiseBoard(in, WIDTH, HEIGHT);
+    }
+    fclose(in);
+    for (int i=50; i<60; i++) {
+        for (int j=120; j<130; j++) frames[1].pixels[i][j] = frames[2].pixels[i][j] = 255 - i;
+    }
+    char *names[3] = {"testing0.pgm", "testing1.pgm", "testing2.pgm"};
+    for (int f=0; f<3; f++) writeFrame(names[f], frames[f]);
+
+    // the index is written with the animation, and any frame can be drawn
+    // from the keyframe before it
+    int intervals[2] = {KEYFRAME_INTERVAL, 2};
+    for (int k=0; k<2; k++) {
+        convertFramesToSK(3, names, "testing.sk", false, intervals[k], USING_LINES);
+        FILE *sk = fopen("testing.sk", "rb");
+        FILE *index = fopen("testing.ski", "rb");
+        seekEntry e;
+        assert(readSeekEntry(index, 2, &e) && e.keyframe == ((k == 0) ? 0 : 2));
+        for (int f=0; f<3; f++) {
+            board b = newBoard(WIDTH, HEIGHT);
+            assert(convertSKFrameToBoard(sk, index, f, b));
+            for (int i=0; i<HEIGHT; i++) {
+                for (int j=0; j<WIDTH; j++) assert(b.pixels[i][j] == frames[f].pixels[i][j]);
+            }
+            freeBoard(b);
+        }
+        board b = newBoard(WIDTH, HEIGHT);
+        assert(!convertSKFrameToBoard(sk, index, 3, b));
+        freeBoard(b);
+        fclose(index);
+        fclose(sk);
+    }
+
+    for (int f=0; f<3; f++) {
+        freeBoard(frames[f]);
+        remove(names[f]);
+    }
+    remove("testing.sk");
+    remove("testing.ski");
+}
+
 void testSign() {
     assert(sign(0) == 0);
     assert(sign(1) == 1);
@@ -445,66 +1122,940 @@ void testRGBAToGreyscale() {
 }
 
 void testDrawLine() {
-    int b[HEIGHT][WIDTH];
-    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {b[i][j] = 0xff;}}
+    board b = newBoard(WIDTH, HEIGHT);
+    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {b.pixels[i][j] = 0xff;}}
     position start = (position) {1, 1};
     position end = (position) {1, 11};
     drawLine(0, start, end, b);
     for(int i=0; i<HEIGHT; i++) {
         for(int j=0; j<WIDTH; j++) {
-            if (1 <= i && i <= 11 && j == 1) assert(b[i][j] == 0);
-            else assert(b[i][j] == 0xff); 
+            if (1 <= i && i <= 11 && j == 1) assert(b.pixels[i][j] == 0);
+            else assert(b.pixels[i][j] == 0xff); 
         }
     }
 
-    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {b[i][j] = 0xff;}}
+    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {b.pixels[i][j] = 0xff;}}
     end = (position) {11, 1};
     drawLine(100, start, end, b);
     for(int i=0; i<HEIGHT; i++) {
         for(int j=0; j<WIDTH; j++) {
-            if (i == 1 & 1 <= j && j <= 11) assert(b[i][j] == 100);
-            else assert(b[i][j] == 0xff); 
+            if (i == 1 & 1 <= j && j <= 11) assert(b.pixels[i][j] == 100);
+            else assert(b.pixels[i][j] == 0xff); 
         }
     }
+
+    // pixels past the edge of the board are not drawn
+    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {b.pixels[i][j] = 0xff;}}
+    start = (position) {199, 190};
+    end = (position) {199, 200};
+    drawLine(0, start, end, b);
+    for(int i=0; i<HEIGHT; i++) {
+        for(int j=0; j<WIDTH; j++) {
+            if (190 <= i && j == 199) assert(b.pixels[i][j] == 0);
+            else assert(b.pixels[i][j] == 0xff); 
+        }
+    }
+
+    // lines can be drawn backwards, and off the other edge of the board
+    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {b.pixels[i][j] = 0xff;}}
+    start = (position) {5, 2};
+    end = (position) {-5, 2};
+    drawLine(0, start, end, b);
+    for(int i=0; i<HEIGHT; i++) {
+        for(int j=0; j<WIDTH; j++) {
+            if (i == 2 && j <= 5) assert(b.pixels[i][j] == 0);
+            else assert(b.pixels[i][j] == 0xff); 
+        }
+    }
+
+    // diagonal lines are not drawn
+    end = (position) {6, 3};
+    assert(!drawLine(0, start, end, b));
+    freeBoard(b);
 }
 
 void testDrawBox() {
-    int b[HEIGHT][WIDTH];
-    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {b[i][j] = 0xff;}}
+    board b = newBoard(WIDTH, HEIGHT);
+    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {b.pixels[i][j] = 0xff;}}
     position start = (position) {1, 1};
     position end = (position) {11, 11};
 
     drawBox(0, start, end, b);
     for(int i=0; i<HEIGHT; i++) {
         for(int j=0; j<WIDTH; j++) {
-            if (1 <= i && i < 11 && 1 <= j && j < 11) assert(b[i][j] == 0);
-            else assert(b[i][j] == 0xff); 
+            if (1 <= i && i < 11 && 1 <= j && j < 11) assert(b.pixels[i][j] == 0);
+            else assert(b.pixels[i][j] == 0xff); 
+        }
+    }
+
+    // pixels past the edge of the board are not drawn
+    for(int i=0; i<HEIGHT; i++) {for (int j=0; j<WIDTH; j++) {b.pixels[i][j] = 0xff;}}
+    start = (position) {190, 195};
+    end = (position) {250, 210};
+    drawBox(0, start, end, b);
+    for(int i=0; i<HEIGHT; i++) {
+        for(int j=0; j<WIDTH; j++) {
+            if (195 <= i && 190 <= j) assert(b.pixels[i][j] == 0);
+            else assert(b.pixels[i][j] == 0xff); 
         }
     }
+    freeBoard(b);
 }
 
 void testConvertSKToBoard() {
     FILE *in = fopen("fractal.pgm", "rb");
     char discard[MAX_PGM_HEADER_CHARS];
     fgets(discard, MAX_PGM_HEADER_CHARS, in); 
-    board original = initialiseBoard(in);
+    board original = initialiseBoard(in, WIDTH, HEIGHT);
     fclose(in);
 
-    convertToSK("fractal.pgm", false, USING_LINES);
-    in = fopen("fractal.sk", "rb");
-    int new[HEIGHT][WIDTH];
-    convertSKToBoard(in, new);
+    convertToSK(FRACTAL_COPY, false, BOX, USING_LINES);
+    in = fopen(FRACTAL_COPY_SK, "rb");
+    board new = newBoard(WIDTH, HEIGHT);
+    assert(convertSKToBoard(in, new));
     for(int i=0; i<HEIGHT; i++) {
         for(int j=0; j<WIDTH; j++) {
-            assert(original[i][j] == new[i][j]);
+            assert(original.pixels[i][j] == new.pixels[i][j]);
         }
     }
     freeBoard(original);
+    freeBoard(new);
+    fclose(in);
+
+    // a block drawn back towards the origin covers what the viewer draws
+    in = tmpfile();
+    writeColour(in, 0xffffffff);
+    unsigned char commands[6] = {0x05, 0x80, 0x45, 0x82, 0x3e, 0x7e};
+    fwrite(commands, 1, 6, in);
+    rewind(in);
+    board b = newBoard(10, 10);
+    assert(convertSKToBoard(in, b));
+    for (int i=0; i<10; i++) {
+        for (int j=0; j<10; j++) assert(b.pixels[i][j] == ((3 <= i && i < 5 && 3 <= j && j < 5) ? 0xff : 0));
+    }
+    freeBoard(b);
+    fclose(in);
+}
+
+void testConvertSKToBoardInBands() {
+    FILE *in = fopen("fractal.pgm", "rb");
+    char discard[MAX_PGM_HEADER_CHARS];
+    fgets(discard, MAX_PGM_HEADER_CHARS, in); 
+    board original = initialiseBoard(in, WIDTH, HEIGHT);
+    fclose(in);
+
+    // the same image however many bands it is split into, even with more
+    // threads than rows
+    convertToSK(FRACTAL_COPY, false, BOX, USING_LINES);
+    int threads[4] = {1, 4, 7, HEIGHT + 1};
+    for (int t=0; t<4; t++) {
+        in = fopen(FRACTAL_COPY_SK, "rb");
+        board new = newBoard(WIDTH, HEIGHT);
+        assert(convertSKToBoardInBands(in, new, threads[t]));
+        fclose(in);
+        for(int i=0; i<HEIGHT; i++) {
+            for(int j=0; j<WIDTH; j++) assert(original.pixels[i][j] == new.pixels[i][j]);
+        }
+        freeBoard(new);
+    }
+    freeBoard(original);
+
+    // diagonal lines still can't be drawn
+    in = tmpfile();
+    fputc(0x05, in); fputc(0x45, in);
+    rewind(in);
+    board b = newBoard(10, 10);
+    assert(!convertSKToBoardInBands(in, b, 4));
+    freeBoard(b);
+    fclose(in);
+}
+
+void testReadDrawCommands() {
+    int count;
+    FILE *in = fopen("sketch06.sk", "rb");
+    drawCommand *d = readDrawCommands(in, &count);
+    fclose(in);
+
+    // three blocks then the colour left at the end
+    assert(count == 4);
+    assert(d[0].tool == BLOCK && d[0].rgba == 0x0000ffff);
+    assert(d[0].x == 0 && d[0].y == 0 && d[0].tx == 199 && d[0].ty == 199);
+    assert(d[1].tool == BLOCK && d[1].rgba == 0x00ff00ff);
+    assert(d[1].x == 0 && d[1].y == 139 && d[1].tx == 199 && d[1].ty == 199);
+    assert(d[2].tool == BLOCK && d[2].rgba == 0xff0000ff);
+    assert(d[2].x == 30 && d[2].y == 60 && d[2].tx == 135 && d[2].ty == 192);
+    assert(d[3].tool == COLOUR && d[3].rgba == 0xff0000ff);
+    free(d);
+
+    in = fopen("sketch09.sk", "rb");
+    d = readDrawCommands(in, &count);
+    fclose(in);
+    int tools[9] = {PAUSE, BLOCK, NEXTFRAME, PAUSE, BLOCK, NEXTFRAME, PAUSE, BLOCK, COLOUR};
+    assert(count == 9);
+    for (int i=0; i<count; i++) assert(d[i].tool == tools[i]);
+    assert(d[0].rgba == 192);
+    // the viewer starts every frame from (0, 0)
+    assert(d[4].x == 0 && d[4].y == 0 && d[4].tx == 199 && d[4].ty == 199);
+    free(d);
+}
+
+void testDecodeByte() {
+    sketchState s = newSketchState();
+    sketchOp op;
+    // DATA and TARGETX make no call, only moving the target
+    assert(!decodeByte(&s, 0xc1, &op) && s.data == 1);
+    assert(!decodeByte(&s, 0xc2, &op) && s.data == 66);
+    assert(!decodeByte(&s, 0x84, &op) && s.tx == 66 && s.data == 0);
+    // DX is signed, and DY draws with the LINE tool the sketch starts with
+    assert(!decodeByte(&s, 0x3e, &op) && s.tx == 64);
+    assert(decodeByte(&s, 0x45, &op));
+    assert(op.kind == OP_LINE && op.x == 0 && op.y == 0 && op.tx == 64 && op.ty == 5);
+    assert(s.x == 64 && s.y == 5);
+    // no call is made with the NONE tool
+    assert(!decodeByte(&s, 0x80, &op) && !decodeByte(&s, 0x41, &op) && s.y == 6);
+    // COLOUR and PAUSE use up the data before them
+    assert(!decodeByte(&s, 0xc7, &op));
+    assert(decodeByte(&s, 0x83, &op) && op.kind == OP_COLOUR && op.value == 7 && s.rgba == 7);
+    assert(!decodeByte(&s, 0xc3, &op));
+    assert(decodeByte(&s, 0x87, &op) && op.kind == OP_PAUSE && op.value == 3 && s.data == 0);
+    // a new frame starts afresh apart from the colour
+    assert(decodeByte(&s, 0x88, &op) && op.kind == OP_NEXTFRAME);
+    assert(s.x == 0 && s.y == 0 && s.tx == 0 && s.ty == 0 && s.tool == LINE);
+    assert(s.coloured && s.rgba == 7);
+}
+
+void testDecodeOps() {
+    FILE *in = fopen("sketch09.sk", "rb");
+    opTable t = decodeOps(in);
+    fclose(in);
+    int kinds[11] = {OP_PAUSE, OP_COLOUR, OP_BLOCK, OP_NEXTFRAME, OP_PAUSE, OP_COLOUR, OP_BLOCK,
+                     OP_NEXTFRAME, OP_PAUSE, OP_COLOUR, OP_BLOCK};
+    assert(t.count == 11);
+    for (int i=0; i<t.count; i++) assert(t.ops[i].kind == kinds[i]);
+    assert(t.ops[0].value == 192 && t.ops[1].value == 0x0000ffff);
+    assert(t.ops[3].end == 20 && t.ops[10].end == 59);
+
+    // frames are played up to and including their NEXTFRAME
+    opCounts counts = {{0}};
+    sketchBackend b = countingBackend(&counts);
+    assert(playFrame(t, 0, &b) == 4);
+    assert(counts.ops[OP_PAUSE] == 1 && counts.ops[OP_BLOCK] == 1 && counts.ops[OP_NEXTFRAME] == 1);
+    assert(playFrame(t, 8, &b) == 11);
+    playOps(t, 4, 8, &b);
+    assert(counts.ops[OP_COLOUR] == 3 && counts.ops[OP_BLOCK] == 3 && counts.ops[OP_NEXTFRAME] == 2);
+
+    // a frame starting at a byte is found from its first op
+    assert(opAt(t, 0) == 0 && opAt(t, 20) == 4 && opAt(t, 19) == 3 && opAt(t, 59) == 11);
+    freeOps(t);
+}
+
+void testFindOverdraw() {
+    drawCommand d[12] = {
+        {BLOCK, true, 0xff, 0, 0, 10, 10}, // under the next block
+        {BLOCK, true, 0xff, 0, 0, 20, 20},
+        {SHOW},
+        {BLOCK, true, 0xff, 0, 0, 20, 10}, // right half under the next block
+        {BLOCK, true, 0xff, 10, 0, 20, 10},
+        {LINE, true, 0xff, 50, 50, 50, 60}, // bottom under the next block
+        {LINE, true, 0xff, 60, 60, 60, 50}, // top under the next block
+        {BLOCK, true, 0xff, 40, 55, 70, 70},
+        {LINE, true, 0xff, 80, 80, 90, 90}, // diagonal, always kept
+        {BLOCK, true, 0xff, 80, 80, 90, 90}, // diagonal line not over it
+        {BLOCK, true, 0xff, 210, 0, 220, 10}, // off the board
+        {BLOCK, true, 0xff, 5, 5, 5, 15} // no width
+    };
+    findOverdraw(d, 12, WIDTH, HEIGHT);
+
+    assert(!d[0].visible);
+    assert(d[1].visible);
+    assert(d[1].vx == 0 && d[1].vy == 0 && d[1].vtx == 20 && d[1].vty == 20);
+    assert(d[3].visible);
+    assert(d[3].vx == 0 && d[3].vy == 0 && d[3].vtx == 10 && d[3].vty == 10);
+    assert(d[5].visible);
+    assert(d[5].vx == 50 && d[5].vy == 50 && d[5].vtx == 50 && d[5].vty == 54);
+    assert(d[6].visible);
+    assert(d[6].vx == 60 && d[6].vy == 54 && d[6].vtx == 60 && d[6].vty == 50);
+    assert(d[8].visible);
+    assert(d[8].vx == 80 && d[8].vy == 80 && d[8].vtx == 90 && d[8].vty == 90);
+    assert(d[9].visible);
+    assert(d[9].vx == 80 && d[9].vy == 80 && d[9].vtx == 90 && d[9].vty == 90);
+    assert(!d[10].visible);
+    assert(!d[11].visible);
+}
+
+void testWriteDrawCommands() {
+    drawCommand d[5] = {
+        // the end of the first line is drawn over, but moving back to
+        // carry on would cost more than it saves
+        {LINE, true, 0x000000ff, 0, 0, 0, 10},
+        {LINE, true, 0xffffffff, 0, 10, 0, 20},
+        {SHOW},
+        // shrinking the first block saves a byte, and makes the move to the
+        // next one a byte cheaper
+        {BLOCK, true, 0x000000ff, 0, 0, 100, 100},
+        {BLOCK, true, 0xffffffff, 0, 40, 100, 100}
+    };
+    findOverdraw(d, 5, WIDTH, HEIGHT);
+    FILE *out = fopen("testing.txt", "w");
+    writeDrawCommands(out, d, 5);
+    fclose(out);
+
+    unsigned char commands[49] = {
+        0xc0, 0xc0, 0xc0, 0xc3, 0xff, 0x83, // set colour to 0
+        0x4a, // line down to (0, 10)
+        0xc3, 0xff, 0xff, 0xff, 0xff, 0xff, 0x83, // set colour to 255
+        0x4a, // line down to (0, 20)
+        0x86, // show
+        0xc0, 0xc0, 0xc0, 0xc3, 0xff, 0x83, // set colour to 0
+        0x80, 0x6c, // move by (0, -20) to (0, 0)
+        0x82, 0xc1, 0xe4, 0x84, 0xe8, 0x85, 0x40, // box to (100, 40)
+        0xc3, 0xff, 0xff, 0xff, 0xff, 0xff, 0x83, // set colour to 255
+        0x80, 0x84, 0x40, // set position to (0, 40)
+        0x82, 0xc1, 0xe4, 0x84, 0xc1, 0xe4, 0x85, 0x40 // box to (100, 100)
+    };
+    FILE *in = fopen("testing.txt", "rb");
+    for (int i=0; i<49; i++) {
+        unsigned char ch = fgetc(in);
+        assert(commands[i] == ch);
+    }
     fclose(in);
 }
 
+void testRemoveOverdraw() {
+    FILE *in = fopen("fractal.pgm", "rb");
+    char discard[MAX_PGM_HEADER_CHARS];
+    fgets(discard, MAX_PGM_HEADER_CHARS, in);
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
+    fclose(in);
+    colourInfo *c = initialiseColourInfo(b);
+    FILE *sketch = tmpfile();
+    writeToSK_BOX(sketch, b, c, USING_LINES);
+    long before = ftell(sketch);
+    rewind(sketch);
+    FILE *out = tmpfile();
+    removeOverdraw(sketch, out, WIDTH, HEIGHT);
+    assert(ftell(out) < before);
+
+    // both files should still draw exactly the same image
+    board old = newBoard(WIDTH, HEIGHT);
+    board new = newBoard(WIDTH, HEIGHT);
+    rewind(sketch);
+    convertSKToBoard(sketch, old);
+    rewind(out);
+    convertSKToBoard(out, new);
+    for(int i=0; i<HEIGHT; i++) {
+        for(int j=0; j<WIDTH; j++) assert(old.pixels[i][j] == new.pixels[i][j]);
+    }
+    freeBoard(old);
+    freeBoard(new);
+    fclose(sketch);
+    fclose(out);
+    freeColourInfo(c);
+    freeBoard(b);
+}
+
+void testStats() {
+    FILE *in = fopen("bands.pgm", "r");
+    char discard[MAX_PGM_HEADER_CHARS];
+    fgets(discard, MAX_PGM_HEADER_CHARS, in);
+    board b = initialiseBoard(in, WIDTH, HEIGHT);
+    fclose(in);
+
+    resetStats();
+    findPixel(0, b); // first cell
+    findPixel(254, b); // not in bands.pgm, so every cell
+    assert(stats.findPixelCalls == 2);
+    assert(stats.findPixelCells == 1 + HEIGHT * WIDTH);
+
+    // the first column down to the bottom, then the FIXED pixel next to it
+    b.pixels[0][1] = FIXED;
+    findBoxEnd((position) {0, 0}, b, 0);
+    assert(stats.boxEndCells == 1 + HEIGHT + 1);
+
+    finalise(b);
+    finalise(b);
+    assert(stats.finalisePasses == 2);
+    freeBoard(b);
+}
+
+void testCountCommandBytes() {
+    FILE *out = fopen("testing.txt", "wb");
+    unsigned char commands[] = {
+        0x80, // NONE: tool change
+        0xc3, 0xc7, 0x84, // TARGETX 199: set
+        0x05, 0x45, // DX 5, DY 5: moves
+        0xff, 0xff, 0x83, // COLOUR: colour change
+        0x82, // BLOCK: tool change
+        0xc1 // unused DATA: counted as a tool change
+    };
+    fwrite(commands, 1, sizeof(commands), out);
+    fclose(out);
+
+    resetStats();
+    FILE *in = fopen("testing.txt", "rb");
+    countCommandBytes(in);
+    fclose(in);
+    assert(stats.bytes[MOVE_BYTES] == 2);
+    assert(stats.bytes[SET_BYTES] == 3);
+    assert(stats.bytes[COLOUR_BYTES] == 3);
+    assert(stats.bytes[TOOL_BYTES] == 3);
+}
+
+// reads the pixels of a .pgm file of the given size into rows STRIDE bytes apart
+static void readPixels(char filename[], uint8_t *pixels, int width, int height, int stride) {
+    FILE *in = fopen(filename, "rb");
+    char discard[MAX_PGM_HEADER_CHARS];
+    fgets(discard, MAX_PGM_HEADER_CHARS, in);
+    for (int i=0; i<height; i++) fread(&pixels[i * stride], 1, width, in);
+    fclose(in);
+}
+
+void testSkEncode() {
+    uint8_t pixels[HEIGHT * 256];
+    readPixels("fractal.pgm", pixels, WIDTH, HEIGHT, 256);
+    skContext *ctx = sk_newContext();
+    skOptions options = {SK_BOX, USING_LINES};
+    skBuffer sketch;
+    assert(sk_encode(ctx, pixels, WIDTH, HEIGHT, 256, &options, &sketch) == SK_OK);
+
+    // the same commands as the converter writes to a file
+    convertToSK(FRACTAL_COPY, false, BOX, USING_LINES);
+    FILE *in = fopen(FRACTAL_COPY_SK, "rb");
+    for (size_t i=0; i<sketch.length; i++) assert(fgetc(in) == sketch.data[i]);
+    assert(fgetc(in) == EOF);
+    fclose(in);
+    sk_freeBuffer(&sketch);
+    assert(sketch.data == NULL);
+
+    // streaming the file in stripes writes the same as encoding in memory
+    options.method = SK_STRIPES;
+    assert(sk_encode(ctx, pixels, WIDTH, HEIGHT, 256, &options, &sketch) == SK_OK);
+    convertToSK(FRACTAL_COPY, false, STRIPES, USING_LINES);
+    in = fopen(FRACTAL_COPY_SK, "rb");
+    for (size_t i=0; i<sketch.length; i++) assert(fgetc(in) == sketch.data[i]);
+    assert(fgetc(in) == EOF);
+    fclose(in);
+    sk_freeBuffer(&sketch);
+
+    assert(sk_encode(ctx, NULL, WIDTH, HEIGHT, 256, &options, &sketch) == SK_INVALID_ARGUMENT);
+    assert(sk_encode(ctx, pixels, WIDTH, HEIGHT, 100, &options, &sketch) == SK_INVALID_ARGUMENT);
+    assert(sk_encode(ctx, pixels, 0, HEIGHT, 256, &options, &sketch) == SK_INVALID_ARGUMENT);
+    options.method = 5;
+    assert(sk_encode(ctx, pixels, WIDTH, HEIGHT, 256, &options, &sketch) == SK_INVALID_ARGUMENT);
+    sk_freeContext(ctx);
+}
+
+void testSkDecode() {
+    skContext *ctx = sk_newContext();
+    uint8_t pixels[HEIGHT * WIDTH];
+    readPixels("fractal.pgm", pixels, WIDTH, HEIGHT, WIDTH);
+    skBuffer sketch;
+    assert(sk_encode(ctx, pixels, WIDTH, HEIGHT, WIDTH, NULL, &sketch) == SK_OK);
+
+    // anything drawn past the edge of the image stays white
+    uint8_t *decoded = malloc(250 * 300);
+    assert(sk_decode(ctx, sketch.data, sketch.length, decoded, 250, 300, 250) == SK_OK);
+    for (int i=0; i<300; i++) {
+        for (int j=0; j<250; j++) {
+            if (i < HEIGHT && j < WIDTH) assert(decoded[i * 250 + j] == pixels[i * WIDTH + j]);
+            else assert(decoded[i * 250 + j] == 0xff);
+        }
+    }
+    sk_freeBuffer(&sketch);
+    free(decoded);
+
+    // images of any size survive the round trip with either algorithm
+    int width = 300, height = 70;
+    uint8_t *image = malloc(width * height);
+    uint8_t *result = malloc(width * height);
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) image[i * width + j] = (j / 60 + i / 20) % 3 * 100;
+    }
+    for (int method=SK_RLE; method<=SK_BOX; method++) {
+        skOptions options = {method, USING_LINES};
+        assert(sk_encode(ctx, image, width, height, width, &options, &sketch) == SK_OK);
+        assert(sk_decode(ctx, sketch.data, sketch.length, result, width, height, width) == SK_OK);
+        assert(memcmp(image, result, width * height) == 0);
+        sk_freeBuffer(&sketch);
+    }
+    free(image);
+    free(result);
+
+    // a line from (0, 0) to (1, 1) is diagonal
+    uint8_t diagonal[2] = {0x01, 0x41};
+    assert(sk_decode(ctx, diagonal, 2, pixels, WIDTH, HEIGHT, WIDTH) == SK_UNSUPPORTED);
+    assert(sk_decode(ctx, NULL, 2, pixels, WIDTH, HEIGHT, WIDTH) == SK_INVALID_ARGUMENT);
+    sk_freeContext(ctx);
+}
+
+// reads a whole file into memory, returning its length
+static long readAll(FILE *in, unsigned char **bytes) {
+    long capacity = 4096, length = 0;
+    *bytes = malloc(capacity);
+    for (int ch = fgetc(in); ch != EOF; ch = fgetc(in)) {
+        if (length == capacity) *bytes = realloc(*bytes, capacity *= 2);
+        (*bytes)[length++] = ch;
+    }
+    return length;
+}
+
+void testPackSK() {
+    // fractal.sk several times over, so it takes more than one block
+    FILE *in = fopen("fractal.sk", "rb");
+    unsigned char *commands;
+    long length = readAll(in, &commands);
+    fclose(in);
+    FILE *plain = tmpfile();
+    for (int i=0; i<3; i++) fwrite(commands, 1, length, plain);
+    assert(3 * length > ENVELOPE_BLOCK);
+
+    // it packs to less than half, and unpacks to the same commands
+    rewind(plain);
+    FILE *packed = tmpfile();
+    packSK(plain, packed);
+    assert(ftell(packed) < 3 * length / 2);
+    rewind(packed);
+    FILE *unpacked = tmpfile();
+    assert(unpackSK(packed, unpacked));
+    rewind(unpacked);
+    unsigned char *bytes;
+    assert(readAll(unpacked, &bytes) == 3 * length);
+    for (int i=0; i<3; i++) assert(memcmp(bytes + i * length, commands, length) == 0);
+    free(bytes);
+    fclose(unpacked);
+
+    // a cut short envelope is not unpacked, nor is a plain .sk
+    rewind(packed);
+    FILE *cut = tmpfile();
+    for (int i=0; i<1000; i++) fputc(fgetc(packed), cut);
+    rewind(cut);
+    unpacked = tmpfile();
+    assert(!unpackSK(cut, unpacked));
+    rewind(plain);
+    assert(!unpackSK(plain, unpacked));
+    fclose(unpacked);
+    fclose(cut);
+    fclose(packed);
+
+    // commands that don't compress are stored as they are
+    unsigned char few[] = {0x82, 0x0a, 0x4a};
+    plain = freopen(NULL, "w+b", plain);
+    fwrite(few, 1, sizeof(few), plain);
+    rewind(plain);
+    packed = tmpfile();
+    packSK(plain, packed);
+    assert(ftell(packed) == 4 + 9 + (long) sizeof(few));
+    fclose(packed);
+    fclose(plain);
+    free(commands);
+}
+
+void testOpenSK() {
+    FILE *in = fopen("fractal.sk", "rb");
+    unsigned char *commands;
+    long length = readAll(in, &commands);
+    fclose(in);
+    FILE *out = fopen("testing.sk", "wb");
+    for (int i=0; i<2; i++) fwrite(commands, 1, length, out);
+    fclose(out);
+    assert(!packedSK("testing.sk"));
+    assert(packSKFile("testing.sk", true) && packedSK("testing.sk"));
+
+    // a packed file reads as the plain commands
+    in = openSK("testing.sk");
+    unsigned char *bytes;
+    assert(readAll(in, &bytes) == 2 * length);
+    assert(memcmp(bytes, commands, length) == 0 && memcmp(bytes + length, commands, length) == 0);
+    free(bytes);
+
+    // and can be seeked in, backwards, forwards past a block, and from the end
+    long offsets[] = {length + 5, 3, ENVELOPE_BLOCK + 1, ENVELOPE_BLOCK - 1, 2 * length - 1};
+    for (int i=0; i<5; i++) {
+        assert(fseek(in, offsets[i], SEEK_SET) == 0 && ftell(in) == offsets[i]);
+        assert(fgetc(in) == commands[offsets[i] % length]);
+    }
+    assert(fgetc(in) == EOF);
+    assert(fseek(in, -length, SEEK_END) == 0 && ftell(in) == length);
+    assert(fgetc(in) == commands[0]);
+    fclose(in);
+
+    // and decodes to the same image
+    board b = newBoard(WIDTH, HEIGHT);
+    board packedBoard = newBoard(WIDTH, HEIGHT);
+    in = fopen("fractal.sk", "rb");
+    assert(convertSKToBoard(in, b));
+    fclose(in);
+    in = openSK("testing.sk");
+    assert(convertSKToBoard(in, packedBoard));
+    fclose(in);
+    for (int i=0; i<HEIGHT; i++) {
+        for (int j=0; j<WIDTH; j++) assert(b.pixels[i][j] == packedBoard.pixels[i][j]);
+    }
+    freeBoard(b);
+    freeBoard(packedBoard);
+
+    // a packed file cut short part way through a block is an error, not a
+    // shorter sketch
+    in = fopen("testing.sk", "rb");
+    unsigned char *packed;
+    assert(readAll(in, &packed) > 20000);
+    fclose(in);
+    out = fopen("testing2.sk", "wb");
+    fwrite(packed, 1, 20000, out);
+    fclose(out);
+    free(packed);
+    in = openSK("testing2.sk");
+    while (fgetc(in) != EOF) {}
+    assert(ferror(in));
+    fclose(in);
+    b = newBoard(WIDTH, HEIGHT);
+    in = openSK("testing2.sk");
+    assert(!convertSKToBoard(in, b));
+    fclose(in);
+    in = openSK("testing2.sk");
+    assert(!convertSKToBoardInBands(in, b, 4));
+    fclose(in);
+    freeBoard(b);
+
+    // as is a packed block too short to hold its code lengths, or with more
+    // codes of a length than there are, here every symbol's code 1 bit long
+    unsigned char shortBlock[] = {0x89, 'S', 'K', 'Z', 1, 10, 0, 0, 0, 1, 0, 0, 0, 0xff};
+    unsigned char fullBlock[4 + 9 + 200] = {0x89, 'S', 'K', 'Z', 1, 10, 0, 0, 0, 200, 0, 0, 0};
+    memset(fullBlock + 4 + 9, 0x11, 200);
+    unsigned char *damaged[] = {shortBlock, fullBlock};
+    size_t damagedLength[] = {sizeof(shortBlock), sizeof(fullBlock)};
+    for (int d=0; d<2; d++) {
+        out = fopen("testing2.sk", "wb");
+        fwrite(damaged[d], 1, damagedLength[d], out);
+        fclose(out);
+        in = openSK("testing2.sk");
+        while (fgetc(in) != EOF) {}
+        assert(ferror(in));
+        fclose(in);
+        in = fopen("testing2.sk", "rb");
+        FILE *unpacked = tmpfile();
+        assert(!unpackSK(in, unpacked));
+        fclose(unpacked);
+        fclose(in);
+    }
+    remove("testing2.sk");
+
+    // unpacking gives back the plain file
+    assert(packSKFile("testing.sk", false) && !packedSK("testing.sk"));
+    in = fopen("testing.sk", "rb");
+    assert(readAll(in, &bytes) == 2 * length);
+    fclose(in);
+    free(bytes);
+    free(commands);
+    remove("testing.sk");
+}
+
+void testStreams() {
+    FILE *pgm = fopen("fractal.pgm", "rb");
+    unsigned char *image;
+    long imageLength = readAll(pgm, &image);
+    rewind(pgm);
+
+    // a .pgm read from a stream is written to a stream as a .sk
+    int width, height;
+    assert(readPGMHeader(pgm, &width, &height));
+    FILE *sketch = tmpfile();
+    assert(writePGMToSK(pgm, sketch, width, height, BOX, STRIPE_HEIGHT, USING_LINES, 0, false)
+           == INFINITY);
+    fclose(pgm);
+
+    // which read back packed or not is drawn and written as the same .pgm
+    for (int packing=0; packing<2; packing++) {
+        rewind(sketch);
+        FILE *in = sketch;
+        if (packing) {
+            in = tmpfile();
+            packSK(sketch, in);
+            rewind(in);
+        }
+        FILE *sk = readSK(in);
+        assert(sk != NULL);
+        board b = newBoard(width, height);
+        for (int i=0; i<height; i++) {for (int j=0; j<width; j++) {b.pixels[i][j] = 0xff;}}
+        assert(convertSKToBoard(sk, b));
+        FILE *out = tmpfile();
+        writeBoard(out, b);
+        rewind(out);
+        unsigned char *bytes;
+        assert(readAll(out, &bytes) == imageLength);
+        assert(memcmp(bytes, image, imageLength) == 0);
+        free(bytes);
+        fclose(out);
+        freeBoard(b);
+        if (packing) fclose(sk);
+    }
+    fclose(sketch);
+
+    // something that only starts like an envelope is not read
+    FILE *bad = tmpfile();
+    fputs("\x89SKY", bad);
+    rewind(bad);
+    assert(readSK(bad) == NULL);
+    fclose(bad);
+    free(image);
+}
+
+void testConvertBatch() {
+    // what a .sk of fractal.pgm should hold
+    FILE *pgm = fopen("fractal.pgm", "rb");
+    int width, height;
+    assert(readPGMHeader(pgm, &width, &height));
+    FILE *expected = tmpfile();
+    writePGMToSK(pgm, expected, width, height, BOX, STRIPE_HEIGHT, USING_LINES, 0, false);
+    rewind(expected);
+    unsigned char *commands;
+    long length = readAll(expected, &commands);
+    fclose(expected);
+
+    // more files than buffers, so every buffer is used again, and one of
+    // them not a .pgm at all
+    rewind(pgm);
+    unsigned char *image;
+    long imageLength = readAll(pgm, &image);
+    fclose(pgm);
+    char names[12][32];
+    char *files[12];
+    for (int i=0; i<12; i++) {
+        sprintf(names[i], "testing%d.pgm", i);
+        files[i] = names[i];
+        FILE *out = fopen(names[i], "wb");
+        if (i == 5) fputs("P2 not an image", out);
+        else fwrite(image, 1, imageLength, out);
+        fclose(out);
+    }
+    batchOptions options = {BOX, 0, 0, false, false, 0, 2};
+    assert(convertBatch(12, files, &options) == 11);
+
+    // every other file is written as it would be on its own
+    for (int i=0; i<12; i++) {
+        char sk[32];
+        outputFiletype(names[i], sk, SK);
+        FILE *in = fopen(sk, "rb");
+        assert((in == NULL) == (i == 5));
+        if (in != NULL) {
+            unsigned char *bytes;
+            assert(readAll(in, &bytes) == length);
+            assert(memcmp(bytes, commands, length) == 0);
+            free(bytes);
+            fclose(in);
+        }
+        remove(sk);
+        remove(names[i]);
+    }
+    free(image);
+    free(commands);
+}
+
+// counts the colour changes in a .sk file, each a COLOUR tool command
+static int colourChanges(FILE *in) {
+    int changes = 0;
+    for (int ch = fgetc(in); ch != EOF; ch = fgetc(in)) {
+        changes += ch == (TOOL << SKETCH_DATA_BITS) + COLOUR;
+    }
+    return changes;
+}
+
+// pixels drawn in full colour through the interpreter, as the viewer draws
+// them, where a board only keeps each colour's grey
+typedef struct colourCanvas {
+    unsigned int *pixels;
+    int width, height;
+    unsigned int rgba;
+} colourCanvas;
+
+static void paint(colourCanvas *c, int x, int y) {
+    if (0 <= x && x < c->width && 0 <= y && y < c->height) c->pixels[y * c->width + x] = c->rgba;
+}
+
+// the converter only draws lines along a row or column
+static void canvasLine(void *target, int x0, int y0, int x1, int y1) {
+    assert(x0 == x1 || y0 == y1);
+    for (int y = (y0 < y1) ? y0 : y1; y <= ((y0 < y1) ? y1 : y0); y++) {
+        for (int x = (x0 < x1) ? x0 : x1; x <= ((x0 < x1) ? x1 : x0); x++) paint(target, x, y);
+    }
+}
+
+static void canvasBlock(void *target, int x, int y, int w, int h) {
+    if (w < 0) { x += w; w = -w; }
+    if (h < 0) { y += h; h = -h; }
+    for (int i=y; i<y+h; i++) {
+        for (int j=x; j<x+w; j++) paint(target, j, i);
+    }
+}
+
+static void canvasColour(void *target, unsigned int rgba) {
+    ((colourCanvas *) target)->rgba = rgba;
+}
+
+// draws a .sk file read from the start in full colour and checks every
+// pixel has the RGBA of its colour in the image
+static void checkColourSketch(FILE *sketch, board image) {
+    rewind(sketch);
+    colourCanvas c = {calloc((size_t) image.width * image.height, sizeof(unsigned int)),
+                      image.width, image.height, 0};
+    sketchBackend b = {&c, canvasLine, canvasBlock, canvasColour, NULL, NULL, NULL};
+    opTable t = decodeOps(sketch);
+    playOps(t, 0, t.count, &b);
+    freeOps(t);
+    for (int i=0; i<image.height; i++) {
+        for (int j=0; j<image.width; j++) {
+            assert(c.pixels[i * image.width + j] == boardRGBA(image, image.pixels[i][j]));
+        }
+    }
+    free(c.pixels);
+}
+
+void testReadColourHeader() {
+    int width, height, channels;
+    char *headers[] = {
+        "P6 3 2 255\n",
+        "P7\nWIDTH 3\nHEIGHT 2\n# a comment\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n",
+        "P6 3 2 65535\n", // two bytes a channel
+        "P5 3 2 255\n", // greyscale
+        "P7\nWIDTH 3\nHEIGHT 2\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n", // depth mismatch
+        "P7\nWIDTH 3\nHEIGHT 2\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\n" // no end
+    };
+    for (int h=0; h<6; h++) {
+        FILE *in = tmpfile();
+        fputs(headers[h], in);
+        fputc('x', in);
+        rewind(in);
+        assert(readColourHeader(in, &width, &height, &channels) == (h < 2));
+        if (h < 2) {
+            assert(width == 3 && height == 2 && channels == 3 + h);
+            assert(fgetc(in) == 'x');
+        }
+        fclose(in);
+    }
+}
+
+void testInitialiseColourBoard() {
+    // rows of red, green and blue, with alpha on the last row's middle pixel
+    unsigned char pixels[2][3][4] = {
+        {{0xff, 0, 0, 0xff}, {0, 0xff, 0, 0xff}, {0xff, 0, 0, 0xff}},
+        {{0, 0, 0xff, 0xff}, {0, 0, 0xff, 0x80}, {0, 0, 0xff, 0xff}}
+    };
+    for (int channels=3; channels<=4; channels++) {
+        FILE *in = tmpfile();
+        for (int i=0; i<2; i++) {
+            for (int j=0; j<3; j++) fwrite(pixels[i][j], 1, channels, in);
+        }
+        rewind(in);
+        board b = initialiseColourBoard(in, 3, 2, channels);
+        fclose(in);
+        assert(b.colours == channels);
+        for (int i=0; i<2; i++) {
+            for (int j=0; j<3; j++) {
+                unsigned int alpha = (channels == 4) ? pixels[i][j][3] : 0xff;
+                unsigned int rgba = (unsigned int) pixels[i][j][0] << 24 | pixels[i][j][1] << 16
+                    | pixels[i][j][2] << 8 | alpha;
+                assert(boardRGBA(b, b.pixels[i][j]) == rgba);
+            }
+        }
+        // colours are given places in the order they are found
+        assert(b.pixels[0][0] == 0 && b.pixels[0][1] == 1 && b.pixels[0][2] == 0);
+        freeBoard(b);
+    }
+
+    // more colours than the table starts with slots for, so it grows
+    int width = 64, height = 48;
+    FILE *in = tmpfile();
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) {
+            unsigned char rgb[3] = {i, j, i ^ j};
+            fwrite(rgb, 1, 3, in);
+        }
+    }
+    rewind(in);
+    board b = initialiseColourBoard(in, width, height, 3);
+    fclose(in);
+    assert(b.colours == width * height);
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) {
+            unsigned int rgba = (unsigned int) i << 24 | j << 16 | (i ^ j) << 8 | 0xff;
+            assert(boardRGBA(b, b.pixels[i][j]) == rgba);
+        }
+    }
+    freeBoard(b);
+}
+
+void testWriteColourSketch() {
+    // bands of four colours, with a patch of the first inside the third
+    int width = 40, height = 30;
+    unsigned int colours[4] = {0x204080ff, 0xff000010, 0x00ff00ff, 0x0000ffff};
+    FILE *in = tmpfile();
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) {
+            int band = (10 <= i && i < 14 && 25 <= j && j < 30) ? 0 : j / 10;
+            unsigned char rgba[4] = {colours[band] >> 24, colours[band] >> 16, colours[band] >> 8,
+                                     colours[band]};
+            fwrite(rgba, 1, 4, in);
+        }
+    }
+
+    int methods[5] = {RLE, BOX, STRIPES, EXHAUSTIVE, LARGEST};
+    for (int m=0; m<5; m++) {
+        // one board to draw, which drawing uses up, and one to check against
+        rewind(in);
+        board b = initialiseColourBoard(in, width, height, 4);
+        rewind(in);
+        board image = initialiseColourBoard(in, width, height, 4);
+        FILE *sketch = tmpfile();
+        writeSketch(sketch, b, methods[m], USING_LINES);
+        freeBoard(b);
+        checkColourSketch(sketch, image);
+        // the BOX algorithms set each colour once, when its layer is drawn
+        rewind(sketch);
+        if (methods[m] != RLE && methods[m] != STRIPES) assert(colourChanges(sketch) == 4);
+        fclose(sketch);
+        freeBoard(image);
+    }
+    fclose(in);
+
+    // and once out of time, the rows left are still drawn a colour at a time
+    board b = newBoard(4, 2);
+    int values[2][4] = {{5, 7, 5, 7}, {7, FIXED, 5, 5}};
+    for (int i=0; i<2; i++) {
+        for (int j=0; j<4; j++) b.pixels[i][j] = values[i][j];
+    }
+    FILE *sketch = tmpfile();
+    position currentPos = {0, 0};
+    finishInRows(sketch, b, &currentPos, true);
+    rewind(sketch);
+    assert(colourChanges(sketch) == 2);
+    fclose(sketch);
+    freeBoard(b);
+}
+
+void testConvertColourToSK() {
+    FILE *out = fopen("testing.pam", "wb");
+    fprintf(out, "P7\nWIDTH 2\nHEIGHT 2\nDEPTH 3\nMAXVAL 255\nTUPLTYPE RGB\nENDHDR\n");
+    unsigned char pixels[12] = {1, 2, 3, 4, 5, 6, 1, 2, 3, 7, 8, 9};
+    fwrite(pixels, 1, 12, out);
+    fclose(out);
+    convertColourToSK("testing.pam", false, BOX, USING_LINES);
+
+    FILE *in = fopen("testing.pam", "rb");
+    int width, height, channels;
+    assert(readColourHeader(in, &width, &height, &channels));
+    board image = initialiseColourBoard(in, width, height, channels);
+    fclose(in);
+    FILE *sketch = fopen("testing.sk", "rb");
+    checkColourSketch(sketch, image);
+    fclose(sketch);
+    freeBoard(image);
+    remove("testing.pam");
+    remove("testing.sk");
+}
+
 void testConverter() {
     printf("Running Tests\n");
+    copyFile("fractal.pgm", FRACTAL_COPY);
     // basic function tests
     testParseFiletype();
     testOutputFiletype();
@@ -524,14 +2075,89 @@ void testConverter() {
     testFinalise();
     testFillColour();
     testWriteToSK_BOX();
+    testWriteToSK_RLE();
     printf(".pgm -> .sk 2D RLE Conversion Algorithm Tests Passed\n");
 
+    // streaming row-major RLE tests
+    testWriteToSK_Stripes();
+    printf(".pgm -> .sk Striped RLE Conversion Tests Passed\n");
+
+    // effort level and deadline tests
+    testFinishInRows();
+    testFillColourToured();
+    testDeadline();
+    testWriteToSK_Largest();
+    testWriteToSK_Exhaustive();
+    printf("Effort Level and Deadline Tests Passed\n");
+
     // backwards conversion tests
     testSign();
     testRGBAToGreyscale();
     testDrawLine();
     testDrawBox();
     testConvertSKToBoard();
+    testConvertSKToBoardInBands();
     printf(".sk -> .pgm Reverse Conversion Tests Passed\n");
+
+    // overdraw elimination tests
+    testReadDrawCommands();
+    testFindOverdraw();
+    testWriteDrawCommands();
+    testRemoveOverdraw();
+    printf("Overdraw Elimination Tests Passed\n");
+
+    // lossy quantisation tests
+    testFindPalette();
+    testQuantise();
+    testConvertToSKLossy();
+    printf("Quantisation Tests Passed\n");
+
+    // animation tests
+    testMaskUnchanged();
+    testConvertFramesToSK();
+    printf("Animation Tests Passed\n");
+
+    // incremental update tests
+    testMarkChangedTiles();
+    testUpdateSK();
+    printf("Incremental Update Tests Passed\n");
+
+    // seek index tests
+    testWriteSeekIndex();
+    testConvertSKFrameToBoard();
+    printf("Seek Index Tests Passed\n");
+
+    // --stats counter tests
+    testStats();
+    testCountCommandBytes();
+    printf("Statistics Tests Passed\n");
+
+    // in-memory library tests
+    testSkEncode();
+    testSkDecode();
+    printf("Library Tests Passed\n");
+
+    // packed envelope tests
+    testPackSK();
+    testOpenSK();
+    printf("Envelope Tests Passed\n");
+    testStreams();
+    printf("Stream Tests Passed\n");
+    testConvertBatch();
+    printf("Batch Tests Passed\n");
+
+    // colour image tests
+    testReadColourHeader();
+    testInitialiseColourBoard();
+    testWriteColourSketch();
+    testConvertColourToSK();
+    printf("Colour Image Tests Passed\n");
+
+    // shared interpreter tests
+    testDecodeByte();
+    testDecodeOps();
+    printf("Interpreter Tests Passed\n");
+    remove(FRACTAL_COPY);
+    remove(FRACTAL_COPY_SK);
     printf("All Tests Passed\n");
 }
@@ -21,6 +21,22 @@ void testUpdateBoxBoard();
 void testFinalise();
 void testFillColour();
 void testWriteToSK_BOX();
+void testWriteToSK_RLE();
+void testWriteToSK_Stripes();
+void testFinishInRows();
+void testFillColourToured();
+void testDeadline();
+void testWriteToSK_Largest();
+void testWriteToSK_Exhaustive();
+void testFindPalette();
+void testQuantise();
+void testConvertToSKLossy();
+void testMaskUnchanged();
+void testConvertFramesToSK();
+void testMarkChangedTiles();
+void testUpdateSK();
+void testWriteSeekIndex();
+void testConvertSKFrameToBoard();
 
     // backwards conversion tests
 void testSign();
@@ -28,5 +44,40 @@ void testRGBAToGreyscale();
 void testDrawLine();
 void testDrawBox();
 void testConvertSKToBoard();
+void testConvertSKToBoardInBands();
+
+    // overdraw elimination tests
+void testReadDrawCommands();
+void testFindOverdraw();
+void testWriteDrawCommands();
+void testRemoveOverdraw();
+
+    // --stats counter tests
+void testStats();
+void testCountCommandBytes();
+
+    // in-memory library tests
+void testSkEncode();
+void testSkDecode();
+
+    // packed envelope tests
+void testPackSK();
+void testOpenSK();
+
+    // stdin and stdout conversion tests
+void testStreams();
+
+    // batch pipeline tests
+void testConvertBatch();
+
+    // colour image tests
+void testReadColourHeader();
+void testInitialiseColourBoard();
+void testWriteColourSketch();
+void testConvertColourToSK();
+
+    // shared interpreter tests
+void testDecodeByte();
+void testDecodeOps();
 
 #endif
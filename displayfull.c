@@ -2,19 +2,53 @@
 // ----------------------------------------------------------------------------------------------------
 // Full comments on how to use the module can be found in the header file.
 #include "displayfull.h"
+#include "trace.h"
+#include <stdatomic.h>
 #define SDL_MAIN_HANDLED
 #define FAILURE_CODE 1 // exit code at program failure
+#define FRAME_MS 10 // shortest time between frames being shown
+#define QUEUED_FRAMES 4 // frames that can be drawn ahead of the one on screen
+#define DRAWING_THREAD 2 // the drawing thread's number in a trace
+
+// a frame drawn ahead, waiting to be shown
+typedef struct framebuffer {
+  Uint32 *pixels;
+  // how much later it is due, from pauses after the frame before it, which
+  // that frame stays on screen for
+  Uint64 paused;
+} framebuffer;
 
 // display object needed for a managing a graphics window
 struct display {
   SDL_Window *window;
   SDL_Renderer *renderer;
+  SDL_Texture *texture;      // the frame on screen
+  Uint32 *canvas;            // drawn on, and kept from one frame to the next
   char *name;
   int width;
   int height;
-  Uint8 r, g, b, a;
+  Uint32 rgba;               // the drawing colour
+  Uint64 paused;             // pauses since the last frame was drawn
+  // frames passed from the drawing thread to the main thread without locks:
+  // only the drawing thread moves the tail, and only the main thread the head
+  framebuffer frames[QUEUED_FRAMES];
+  atomic_size_t head, tail;  // frames ever taken, and ever queued
+  bool running;              // set while the action runs on the drawing thread
+  Uint64 due, frame;         // when the next frame is due, and the time between frames
+  atomic_char key;           // last key pressed, waiting to be passed to the action
+  atomic_bool quit;          // set once the window has been closed or the action is done
+  bool dropping;             // whether the last frame was dropped
+  int shown, late, dropped;  // frame counts reported when the display is freed
 };
 
+// the action run on the drawing thread, and what it is given
+typedef struct drawing {
+  display *d;
+  void *data;
+  bool (*action)(display *, const char, void *);
+  FILE *trace;
+} drawing;
+
 // If SDL fails, print the SDL error message, and stop the program immediately.
 static void fail() {
   fprintf(stderr, "Error: %s\n", SDL_GetError());
@@ -28,8 +62,9 @@ static void fail() {
 static int safeI(int n) { if (n < 0) fail(); return n; }
 static void *safeP(void *p) { if (p == NULL) fail(); return p; }
 
+// Rather than blocking, a pause pushes back the time the next frame is shown.
 void pause(display *d, int ms) {
-  SDL_Delay(ms);
+  if (ms > 0) d->paused += ms * SDL_GetPerformanceFrequency() / 1000;
 }
 
 int getWidth(display *d) {
@@ -44,33 +79,116 @@ char *getName(display *d) {
   return d->name;
 }
 
+// Set a pixel to the drawing colour, if it is on the canvas.
+static void plot(display *d, int x, int y) {
+  if (x >= 0 && x < d->width && y >= 0 && y < d->height) d->canvas[y * d->width + x] = d->rgba;
+}
+
+// Lines are drawn with Bresenham's algorithm, both ends included, as SDL
+// draws them. A line wholly off one side of the canvas is skipped.
 void line(display *d, int x0, int y0, int x1, int y1) {
-  safeI(SDL_RenderDrawLine(d->renderer, x0, y0, x1, y1));
+  if ((x0 < 0 && x1 < 0) || (y0 < 0 && y1 < 0)) return;
+  if ((x0 >= d->width && x1 >= d->width) || (y0 >= d->height && y1 >= d->height)) return;
+  int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+  int sx = (x0 < x1) ? 1 : -1, sy = (y0 < y1) ? 1 : -1;
+  int error = dx + dy;
+  while (true) {
+    plot(d, x0, y0);
+    if (x0 == x1 && y0 == y1) break;
+    int twice = 2 * error;
+    if (twice >= dy) { error += dy; x0 += sx; }
+    if (twice <= dx) { error += dx; y0 += sy; }
+  }
 }
 
+// A block of negative size covers the same pixels as one the right way round.
 void block(display *d, int x, int y, int w, int h) {
-  SDL_Rect r = (SDL_Rect) {x, y, w, h};
-  safeI(SDL_RenderFillRect(d->renderer, &r));
+  if (w < 0) { x += w; w = -w; }
+  if (h < 0) { y += h; h = -h; }
+  int left = (x < 0) ? 0 : x, top = (y < 0) ? 0 : y;
+  int right = (x + w > d->width) ? d->width : x + w;
+  int bottom = (y + h > d->height) ? d->height : y + h;
+  for (int j = top; j < bottom; j++) {
+    for (int i = left; i < right; i++) d->canvas[j * d->width + i] = d->rgba;
+  }
 }
 
 void pixel(display *d, int x, int y) {
-  safeI(SDL_RenderDrawPoint(d->renderer, x, y));
+  plot(d, x, y);
 }
 
+// Pixels are held as RGBA8888, so a colour is stored just as it is given.
 void colour(display *d, int rgba) {
-  d->r = (rgba >> 24) & 0xFF;
-  d->g = (rgba >> 16) & 0xFF;
-  d->b = (rgba >> 8) & 0xFF;
-  d->a = rgba & 0xFF;
-  safeI(SDL_SetRenderDrawColor(d->renderer, d->r, d->g, d->b, d->a));
+  d->rgba = (Uint32) rgba;
+}
+
+// Record a key press or the window being closed.
+static void handle(display *d, SDL_Event *e) {
+  if (e->type == SDL_KEYDOWN) atomic_store(&d->key, (char) e->key.keysym.sym);
+  if (e->type == SDL_QUIT) atomic_store(&d->quit, true);
+}
+
+// Handle input until the next frame is due, or straight away once closed.
+static void waitUntilDue(display *d) {
+  SDL_Event e;
+  Uint64 ms = SDL_GetPerformanceFrequency() / 1000;
+  Uint64 now = SDL_GetPerformanceCounter();
+  while (!atomic_load(&d->quit) && now + ms <= d->due) {
+    if (SDL_WaitEventTimeout(&e, (d->due - now) / ms)) handle(d, &e);
+    while (SDL_PollEvent(&e)) handle(d, &e);
+    now = SDL_GetPerformanceCounter();
+  }
+}
+
+// Show a frame when it is due, on the main thread. A frame that is a whole
+// frame late is dropped to catch up if a later one is already waiting, but
+// never two in a row, so something is always shown. WAITING is false for a
+// frame with a pause after it, which is never dropped, as it is meant to stay
+// on screen for the pause.
+static void present(display *d, Uint32 *pixels, Uint64 paused, bool waiting) {
+  d->due += paused;
+  waitUntilDue(d);
+  beginSpan("show");
+  Uint64 now = SDL_GetPerformanceCounter();
+  Uint64 ms = SDL_GetPerformanceFrequency() / 1000;
+  bool behind = now > d->due + d->frame;
+  if (behind && waiting && !d->dropping && !atomic_load(&d->quit)) {
+    d->dropped++;
+    d->dropping = true;
+  }
+  else {
+    safeI(SDL_UpdateTexture(d->texture, NULL, pixels, d->width * sizeof(Uint32)));
+    safeI(SDL_RenderClear(d->renderer));
+    safeI(SDL_RenderCopy(d->renderer, d->texture, NULL, NULL));
+    SDL_RenderPresent(d->renderer);
+    d->shown++;
+    if (now > d->due + ms) d->late++;
+    d->dropping = false;
+  }
+  // keep to the schedule unless too far behind to catch up
+  d->due = behind ? now + d->frame : d->due + d->frame;
+  endSpan();
 }
 
+// While the action runs, a frame is copied into the queue for the main
+// thread to show, waiting for room if the queue is full. Otherwise it is
+// shown straight away.
 void show(display *d) {
-  SDL_RenderPresent(d->renderer);
-  SDL_Delay(10);
-  safeI(SDL_SetRenderDrawColor(d->renderer, 0, 0, 0, 0xFF));
-  block(d, 0, 0, d->width, d->height);
-  safeI(SDL_SetRenderDrawColor(d->renderer, d->r, d->g, d->b, d->a));
+  if (!d->running) {
+    present(d, d->canvas, d->paused, false);
+    d->paused = 0;
+    return;
+  }
+  size_t tail = atomic_load_explicit(&d->tail, memory_order_relaxed);
+  while (tail - atomic_load_explicit(&d->head, memory_order_acquire) == QUEUED_FRAMES) {
+    if (atomic_load(&d->quit)) return;
+    SDL_Delay(1);
+  }
+  framebuffer *f = &d->frames[tail % QUEUED_FRAMES];
+  memcpy(f->pixels, d->canvas, d->width * d->height * sizeof(Uint32));
+  f->paused = d->paused;
+  d->paused = 0;
+  atomic_store_explicit(&d->tail, tail + 1, memory_order_release);
 }
 
 display *newDisplay(char *name, int width, int height) {
@@ -80,10 +198,31 @@ display *newDisplay(char *name, int width, int height) {
   d->name = name;
   d->width = width;
   d->height = height;
+  d->frame = FRAME_MS * SDL_GetPerformanceFrequency() / 1000;
+  d->due = SDL_GetPerformanceCounter();
+  d->paused = 0;
+  atomic_init(&d->head, 0);
+  atomic_init(&d->tail, 0);
+  d->running = false;
+  atomic_init(&d->key, 0);
+  atomic_init(&d->quit, false);
+  d->dropping = false;
+  d->shown = d->late = d->dropped = 0;
+  // frames can be synced to the screen's refresh by setting SKETCH_VSYNC
+  Uint32 flags = SDL_RENDERER_ACCELERATED;
+  if (getenv("SKETCH_VSYNC") != NULL) flags |= SDL_RENDERER_PRESENTVSYNC;
   d->window = safeP(SDL_CreateWindow(name, SDL_WINDOWPOS_UNDEFINED,
                  SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_SHOWN));
-  d->renderer = safeP(SDL_CreateRenderer(d->window, -1, SDL_RENDERER_ACCELERATED));
-  safeI(SDL_RenderClear(d->renderer));
+  d->renderer = safeP(SDL_CreateRenderer(d->window, -1, flags));
+  safeI(SDL_SetRenderDrawColor(d->renderer, 0, 0, 0, 0xFF));
+  // drawing is done in memory, so it can happen on any thread, and each
+  // frame is uploaded whole to the texture when it is shown
+  d->texture = safeP(SDL_CreateTexture(d->renderer, SDL_PIXELFORMAT_RGBA8888,
+                                       SDL_TEXTUREACCESS_STREAMING, width, height));
+  d->canvas = safeP(malloc(width * height * sizeof(Uint32)));
+  for (int i = 0; i < QUEUED_FRAMES; i++) {
+    d->frames[i].pixels = safeP(malloc(width * height * sizeof(Uint32)));
+  }
   colour(d,0xFF);
   block(d, 0, 0, width, height);
   colour(d,0xFFFFFFFF);
@@ -91,21 +230,56 @@ display *newDisplay(char *name, int width, int height) {
   return d;
 }
 
+// Run the action over and over on the drawing thread until it or the window
+// is done.
+static int draw(void *data) {
+  drawing *job = data;
+  display *d = job->d;
+  followTrace(job->trace, DRAWING_THREAD);
+  while (!atomic_load(&d->quit)) {
+    char key = atomic_exchange(&d->key, 0);
+    if (job->action(d, key, job->data)) atomic_store(&d->quit, true);
+  }
+  return 0;
+}
+
+// The action draws on a thread of its own, up to QUEUED_FRAMES frames ahead,
+// while this thread only shows each frame as it is due and handles input, so
+// a frame that is slow to draw never holds up the window.
 void run(display *d, void *data, bool action(display *, const char, void*)) {
-  bool quit = false;
-  char key = 0;
+  drawing job = {d, data, action, currentTrace()};
+  d->running = true;
+  SDL_Thread *drawer = safeP(SDL_CreateThread(draw, "draw", &job));
   SDL_Event e;
-  while (!quit) {
-    quit = action(d, key, data);
-    key = 0;
-    while (SDL_PollEvent(&e)) {
-      if (e.type == SDL_KEYDOWN) key = (char) e.key.keysym.sym;
-      if (e.type == SDL_QUIT) quit = true;
+  while (!atomic_load(&d->quit)) {
+    size_t head = atomic_load_explicit(&d->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&d->tail, memory_order_acquire);
+    // with nothing to show yet, wait for the drawing thread or for input
+    if (head == tail) {
+      if (SDL_WaitEventTimeout(&e, 1)) handle(d, &e);
+    }
+    else {
+      framebuffer *f = &d->frames[head % QUEUED_FRAMES];
+      // a pause after this frame is carried by the next one queued
+      bool waiting = tail - head > 1;
+      bool held = waiting && d->frames[(head + 1) % QUEUED_FRAMES].paused > 0;
+      present(d, f->pixels, f->paused, waiting && !held);
+      atomic_store_explicit(&d->head, head + 1, memory_order_release);
     }
+    while (SDL_PollEvent(&e)) handle(d, &e);
   }
+  SDL_WaitThread(drawer, NULL);
+  d->running = false;
 }
 
 void freeDisplay(display *d) {
+  if (d->late > 0 || d->dropped > 0) {
+    fprintf(stderr, "%d frames shown, %d of them late, %d dropped\n",
+            d->shown, d->late, d->dropped);
+  }
+  for (int i = 0; i < QUEUED_FRAMES; i++) free(d->frames[i].pixels);
+  free(d->canvas);
+  SDL_DestroyTexture(d->texture);
   SDL_DestroyRenderer(d->renderer);
   SDL_DestroyWindow(d->window);
   SDL_Quit();
@@ -42,10 +42,17 @@ int getHeight(display *d);
 // (For the sketch assignment this also retrieves the filename of the displayed sketch file.)
 char *getName(display *d);
 
-// Pauses processing for ms milliseconds
+// Delays the next frame being shown by ms milliseconds, without blocking.
 void pause(display *d, int ms);
 
-// Make all recent changes appear on screen.
+// Make all recent changes appear on screen. Frames are shown no more than one
+// every 10ms, plus any pauses since the last frame, handling input while
+// waiting. While run is going, the frame is queued for the main thread to
+// show, and drawing carries on up to 4 frames ahead. A frame more than a frame
+// late is dropped if a later one is ready, and the number of late and dropped
+// frames is printed when the display is freed. Set SKETCH_VSYNC in the
+// environment to also sync frames to the screen's refresh. Nothing is
+// cleared once shown, so the next frame is drawn on top of this one.
 void show(display *d);
 
 // Draw a line from (x0,y0) to (x1,y1) with current drawing colour. (must call show to make it appear)
@@ -62,4 +69,6 @@ void colour(display *d, int rgba);
 // Runs the (drawing) function action repeatedly until the display is closed or action returns true.
 // The function action is provided with a pointer to the display, a pointer to the data,
 // and a char representing the currently pressed key on the keyboard.
+// The action runs on a thread of its own, drawing in memory, while the calling thread only
+// shows frames and handles input, so a frame that is slow to draw never holds up the window.
 void run(display *d, void *data, bool action(display*, const char, void*));
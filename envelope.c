@@ -0,0 +1,565 @@
+#define _GNU_SOURCE // for fopencookie and fseeko
+#include "envelope.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 0x89 is TOOL 9, which is not a tool, so no plain .sk starts with it
+static const unsigned char MAGIC[4] = {0x89, 'S', 'K', 'Z'};
+enum { STORED = 0, HUFFMAN = 1 }; // block types
+#define HEADER_BYTES 9 // type, then length unpacked and packed, 4 bytes each
+
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define LITERALS 256
+#define LENGTH_CODES 9 // a match's length less 2 takes 1 to 9 bits
+#define SYMBOLS (LITERALS + LENGTH_CODES) // literal bytes, then match lengths
+#define DISTANCE_CODES 17 // a match's distance takes 1 to 17 bits
+#define MAX_CODE_BITS 15
+#define HASH_BITS 14
+#define MAX_CHAIN 128 // earlier places tried for a match at each byte
+
+// a literal byte, or a match of LENGTH bytes DISTANCE bytes back
+typedef struct token {
+    uint16_t length; // 0 for a literal
+    uint16_t value; // the byte, or the distance
+} token;
+
+// the Huffman codes of a block, as needed to decode them
+typedef struct huffman {
+    short count[MAX_CODE_BITS + 1]; // codes of each length
+    short symbol[SYMBOLS]; // symbols in order of their codes
+} huffman;
+
+// bits written to a buffer from the lowest up, ignoring any past LIMIT bytes
+typedef struct bitWriter {
+    unsigned char *out;
+    size_t length, limit;
+    int bit;
+    bool full; // set once a bit didn't fit
+} bitWriter;
+
+typedef struct bitReader {
+    const unsigned char *in;
+    size_t length, at;
+    int bit;
+} bitReader;
+
+// a packed .sk file being read through a FILE, one block at a time
+typedef struct packedReader {
+    FILE *file;
+    unsigned char *packed; // the packed bytes of the current block
+    unsigned char *block; // the current block unpacked
+    size_t length, at; // bytes in the current block, and bytes of it read
+    int64_t start; // where the current block starts in the plain commands
+    bool broken; // set once a block is cut short or can't be unpacked
+} packedReader;
+
+// the number of bits needed to write a value
+static int bitsIn(unsigned int v) {
+    int n = 0;
+    for (; v != 0; v >>= 1) n++;
+    return n;
+}
+
+static unsigned int hash(const unsigned char *p) {
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << HASH_BITS) - 1);
+}
+
+// splits a block into literals and matches of earlier bytes in the block,
+// taking the longest match at each byte. returns the number of tokens
+static int findTokens(const unsigned char *in, int length, token *tokens) {
+    int *head = malloc((1 << HASH_BITS) * sizeof(int));
+    int *previous = malloc(length * sizeof(int));
+    for (int i=0; i < 1 << HASH_BITS; i++) head[i] = -1;
+
+    int count = 0;
+    for (int i=0; i<length; ) {
+        int best = 0, distance = 0;
+        if (i + MIN_MATCH <= length) {
+            int most = (length - i < MAX_MATCH) ? length - i : MAX_MATCH;
+            int tries = MAX_CHAIN;
+            for (int j=head[hash(in + i)]; j >= 0 && tries > 0 && best < most; j=previous[j], tries--) {
+                int n = 0;
+                while (n < most && in[j + n] == in[i + n]) n++;
+                if (n > best) {best = n; distance = i - j;}
+            }
+        }
+        if (best >= MIN_MATCH) tokens[count++] = (token) {best, distance};
+        else {tokens[count++] = (token) {0, in[i]}; best = 1;}
+        // every byte passed can be matched from later on
+        for (int end=i+best; i<end; i++) {
+            if (i + MIN_MATCH > length) continue;
+            unsigned int h = hash(in + i);
+            previous[i] = head[h];
+            head[h] = i;
+        }
+    }
+    free(previous);
+    free(head);
+    return count;
+}
+
+// finds the length of each symbol's Huffman code from how often it is used,
+// none longer than MAX_CODE_BITS. unused symbols get no code, of length 0
+static void codeLengths(const long *used, int symbols, unsigned char *lengths) {
+    long weight[2 * SYMBOLS], scaled[SYMBOLS];
+    int parent[2 * SYMBOLS], leaves[SYMBOLS];
+    memcpy(scaled, used, symbols * sizeof(long));
+    while (true) {
+        memset(lengths, 0, symbols);
+        int leafCount = 0;
+        for (int s=0; s<symbols; s++) {
+            if (scaled[s] == 0) continue;
+            weight[leafCount] = scaled[s];
+            parent[leafCount] = -1;
+            leaves[leafCount++] = s;
+        }
+        if (leafCount == 0) return;
+        if (leafCount == 1) {lengths[leaves[0]] = 1; return;}
+
+        // join the two lightest nodes left until only the root is
+        int nodes = leafCount;
+        bool joined[2 * SYMBOLS] = {false};
+        for (int k=1; k<leafCount; k++) {
+            int a = -1, b = -1;
+            for (int n=0; n<nodes; n++) {
+                if (joined[n]) continue;
+                if (a < 0 || weight[n] < weight[a]) {b = a; a = n;}
+                else if (b < 0 || weight[n] < weight[b]) b = n;
+            }
+            weight[nodes] = weight[a] + weight[b];
+            parent[nodes] = -1;
+            parent[a] = parent[b] = nodes;
+            joined[a] = joined[b] = true;
+            nodes++;
+        }
+        int longest = 0;
+        for (int k=0; k<leafCount; k++) {
+            int depth = 0;
+            for (int n=k; parent[n] >= 0; n=parent[n]) depth++;
+            lengths[leaves[k]] = depth;
+            if (depth > longest) longest = depth;
+        }
+        if (longest <= MAX_CODE_BITS) return;
+        // too deep, so even out the counts and try again
+        for (int s=0; s<symbols; s++) scaled[s] = (scaled[s] + 1) / 2;
+    }
+}
+
+// gives each symbol the canonical code of its length, as in DEFLATE
+static void canonicalCodes(const unsigned char *lengths, int symbols, unsigned int *codes) {
+    int count[MAX_CODE_BITS + 1] = {0};
+    for (int s=0; s<symbols; s++) count[lengths[s]]++;
+    count[0] = 0;
+    unsigned int next[MAX_CODE_BITS + 1], code = 0;
+    for (int n=1; n <= MAX_CODE_BITS; n++) {
+        code = (code + count[n - 1]) << 1;
+        next[n] = code;
+    }
+    for (int s=0; s<symbols; s++) {
+        if (lengths[s] > 0) codes[s] = next[lengths[s]]++;
+    }
+}
+
+static void putBit(bitWriter *w, int bit) {
+    if (w->length >= w->limit) {w->full = true; return;}
+    if (w->bit == 0) w->out[w->length] = 0;
+    w->out[w->length] |= bit << w->bit;
+    if (++w->bit == 8) {w->bit = 0; w->length++;}
+}
+
+// writes the lowest N bits of a value, lowest first
+static void putBits(bitWriter *w, unsigned int value, int n) {
+    for (int k=0; k<n; k++) putBit(w, (value >> k) & 1);
+}
+
+// writes a Huffman code, highest bit first, so it can be read a bit at a time
+static void putCode(bitWriter *w, unsigned int code, int length) {
+    for (int k=length-1; k>=0; k--) putBit(w, (code >> k) & 1);
+}
+
+// packs a block with LZ77 and Huffman codes into OUT, returning how many
+// bytes that takes, or 0 if it takes at least as many as the block itself
+static size_t packBlock(const unsigned char *in, int length, unsigned char *out, token *tokens) {
+    int count = findTokens(in, length, tokens);
+    long used[SYMBOLS] = {0}, distancesUsed[DISTANCE_CODES] = {0};
+    for (int i=0; i<count; i++) {
+        if (tokens[i].length == 0) {used[tokens[i].value]++; continue;}
+        used[LITERALS + bitsIn(tokens[i].length - 2) - 1]++;
+        distancesUsed[bitsIn(tokens[i].value) - 1]++;
+    }
+    unsigned char lengths[SYMBOLS], distanceLengths[DISTANCE_CODES];
+    unsigned int codes[SYMBOLS], distanceCodes[DISTANCE_CODES];
+    codeLengths(used, SYMBOLS, lengths);
+    codeLengths(distancesUsed, DISTANCE_CODES, distanceLengths);
+    canonicalCodes(lengths, SYMBOLS, codes);
+    canonicalCodes(distanceLengths, DISTANCE_CODES, distanceCodes);
+
+    bitWriter w = {out, 0, length - 1, 0, false};
+    for (int s=0; s<SYMBOLS; s++) putBits(&w, lengths[s], 4);
+    for (int s=0; s<DISTANCE_CODES; s++) putBits(&w, distanceLengths[s], 4);
+    for (int i=0; i<count && !w.full; i++) {
+        token t = tokens[i];
+        if (t.length == 0) {
+            putCode(&w, codes[t.value], lengths[t.value]);
+            continue;
+        }
+        // each length and distance is its number of bits, then the bits
+        // below its top one as they are
+        int lengthBits = bitsIn(t.length - 2), distanceBits = bitsIn(t.value);
+        int symbol = LITERALS + lengthBits - 1;
+        putCode(&w, codes[symbol], lengths[symbol]);
+        putBits(&w, t.length - 2, lengthBits - 1);
+        putCode(&w, distanceCodes[distanceBits - 1], distanceLengths[distanceBits - 1]);
+        putBits(&w, t.value, distanceBits - 1);
+    }
+    if (w.bit > 0) w.length++;
+    if (w.full || w.length > w.limit) return 0;
+    return w.length;
+}
+
+static void putLength(FILE *out, uint32_t v) {
+    for (int i=0; i<4; i++) fputc((v >> (8 * i)) & 0xff, out);
+}
+
+// writes the commands read from IN to OUT in an envelope
+void packSK(FILE *in, FILE *out) {
+    unsigned char *block = malloc(ENVELOPE_BLOCK);
+    unsigned char *packed = malloc(ENVELOPE_BLOCK);
+    token *tokens = malloc(ENVELOPE_BLOCK * sizeof(token));
+    fwrite(MAGIC, 1, sizeof(MAGIC), out);
+    size_t length = fread(block, 1, ENVELOPE_BLOCK, in);
+    while (length > 0) {
+        size_t packedLength = packBlock(block, length, packed, tokens);
+        fputc((packedLength > 0) ? HUFFMAN : STORED, out);
+        putLength(out, length);
+        if (packedLength > 0) {
+            putLength(out, packedLength);
+            fwrite(packed, 1, packedLength, out);
+        }
+        else {
+            putLength(out, length);
+            fwrite(block, 1, length, out);
+        }
+        length = fread(block, 1, ENVELOPE_BLOCK, in);
+    }
+    free(tokens);
+    free(packed);
+    free(block);
+}
+
+// reads the next bit, or -1 past the end
+static int getBit(bitReader *r) {
+    if (r->at >= r->length) return -1;
+    int bit = (r->in[r->at] >> r->bit) & 1;
+    if (++r->bit == 8) {r->bit = 0; r->at++;}
+    return bit;
+}
+
+// reads N bits written lowest first, or -1 past the end
+static long getBits(bitReader *r, int n) {
+    long value = 0;
+    for (int k=0; k<n; k++) {
+        int bit = getBit(r);
+        if (bit < 0) return -1;
+        value |= (long) bit << k;
+    }
+    return value;
+}
+
+// builds the codes for LENGTHS of at most MAX_CODE_BITS, returning false if
+// there are more codes of some length than fit, as only a damaged block has
+static bool buildHuffman(huffman *h, const unsigned char *lengths, int symbols) {
+    memset(h->count, 0, sizeof(h->count));
+    for (int s=0; s<symbols; s++) h->count[lengths[s]]++;
+    long left = 1; // codes of the current length still free
+    for (int n=1; n <= MAX_CODE_BITS; n++) {
+        left = 2 * left - h->count[n];
+        if (left < 0) return false;
+    }
+    short offset[MAX_CODE_BITS + 1];
+    offset[1] = 0;
+    for (int n=1; n < MAX_CODE_BITS; n++) offset[n + 1] = offset[n] + h->count[n];
+    for (int s=0; s<symbols; s++) {
+        if (lengths[s] > 0) h->symbol[offset[lengths[s]]++] = s;
+    }
+    return true;
+}
+
+// reads a symbol a bit at a time, using that shorter canonical codes come
+// first. returns -1 if there is no such code
+static int getSymbol(bitReader *r, const huffman *h) {
+    int code = 0, first = 0, index = 0;
+    for (int n=1; n <= MAX_CODE_BITS; n++) {
+        int bit = getBit(r);
+        if (bit < 0) return -1;
+        code |= bit;
+        int count = h->count[n];
+        if (code - first < count) return h->symbol[index + code - first];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+// unpacks a block packed by packBlock into LENGTH bytes of OUT, returning
+// false if it doesn't hold that many
+static bool unpackBlock(const unsigned char *in, size_t packedLength, unsigned char *out,
+                        size_t length) {
+    bitReader r = {in, packedLength, 0, 0};
+    unsigned char lengths[SYMBOLS], distanceLengths[DISTANCE_CODES];
+    // a block cut short in its code lengths is damaged, as is one whose
+    // lengths don't make a code
+    for (int s=0; s<SYMBOLS + DISTANCE_CODES; s++) {
+        long bits = getBits(&r, 4);
+        if (bits < 0) return false;
+        if (s < SYMBOLS) lengths[s] = bits;
+        else distanceLengths[s - SYMBOLS] = bits;
+    }
+    huffman codes, distanceCodes;
+    if (!buildHuffman(&codes, lengths, SYMBOLS)) return false;
+    if (!buildHuffman(&distanceCodes, distanceLengths, DISTANCE_CODES)) return false;
+
+    size_t at = 0;
+    while (at < length) {
+        int symbol = getSymbol(&r, &codes);
+        if (symbol < 0) return false;
+        if (symbol < LITERALS) {out[at++] = symbol; continue;}
+        int lengthBits = symbol - LITERALS + 1;
+        long extra = getBits(&r, lengthBits - 1);
+        int distanceBits = getSymbol(&r, &distanceCodes) + 1;
+        long distanceExtra = getBits(&r, distanceBits - 1);
+        if (extra < 0 || distanceBits <= 0 || distanceExtra < 0) return false;
+        size_t matchLength = ((1L << (lengthBits - 1)) | extra) + 2;
+        size_t distance = (1L << (distanceBits - 1)) | distanceExtra;
+        if (distance > at || matchLength > length - at) return false;
+        // copied a byte at a time, as a match can overlap itself
+        for (size_t k=0; k<matchLength; k++, at++) out[at] = out[at - distance];
+    }
+    return true;
+}
+
+// reads a block's header, returning false at the end of the envelope or if
+// the header is cut short or the block is too long
+static bool readHeader(FILE *in, int *type, size_t *length, size_t *packedLength) {
+    unsigned char header[HEADER_BYTES];
+    if (fread(header, 1, HEADER_BYTES, in) != HEADER_BYTES) return false;
+    *type = header[0];
+    *length = *packedLength = 0;
+    for (int i=3; i>=0; i--) {
+        *length = (*length << 8) | header[1 + i];
+        *packedLength = (*packedLength << 8) | header[5 + i];
+    }
+    if (*type == STORED && *packedLength != *length) return false;
+    return (*type == STORED || *type == HUFFMAN) && *length <= ENVELOPE_BLOCK
+        && *packedLength <= ENVELOPE_BLOCK;
+}
+
+// reads a block's packed bytes after its header and unpacks it into OUT
+static bool readBlock(FILE *in, unsigned char *packed, unsigned char *out, int type,
+                      size_t length, size_t packedLength) {
+    if (type == STORED) return fread(out, 1, length, in) == length;
+    if (fread(packed, 1, packedLength, in) != packedLength) return false;
+    return unpackBlock(packed, packedLength, out, length);
+}
+
+static bool hasMagic(FILE *in) {
+    unsigned char magic[sizeof(MAGIC)];
+    return fread(magic, 1, sizeof(MAGIC), in) == sizeof(MAGIC)
+        && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+// writes the commands in an envelope read from IN to OUT, returning false
+// if IN is not a whole envelope
+bool unpackSK(FILE *in, FILE *out) {
+    if (!hasMagic(in)) return false;
+    unsigned char *packed = malloc(ENVELOPE_BLOCK);
+    unsigned char *block = malloc(ENVELOPE_BLOCK);
+    int type;
+    size_t length, packedLength;
+    bool whole = true;
+    while (whole && readHeader(in, &type, &length, &packedLength)) {
+        whole = readBlock(in, packed, block, type, length, packedLength);
+        if (whole) fwrite(block, 1, length, out);
+    }
+    whole = whole && feof(in);
+    free(block);
+    free(packed);
+    return whole;
+}
+
+// checks whether a .sk file is packed, from its first bytes
+bool packedSK(char filename[]) {
+    FILE *in = fopen(filename, "rb");
+    if (in == NULL) return false;
+    bool packed = hasMagic(in);
+    fclose(in);
+    return packed;
+}
+
+// moves on to the next block of a packed .sk file, returning false at the
+// end of it or if the block can't be unpacked, when the reader is broken
+static bool nextBlock(packedReader *r) {
+    r->start += r->length;
+    r->length = r->at = 0;
+    // the envelope ends cleanly only where a block would start
+    int first = fgetc(r->file);
+    if (first == EOF) {
+        r->broken = ferror(r->file);
+        return false;
+    }
+    ungetc(first, r->file);
+    int type;
+    size_t length, packedLength;
+    r->broken = !readHeader(r->file, &type, &length, &packedLength)
+        || !readBlock(r->file, r->packed, r->block, type, length, packedLength);
+    if (r->broken) return false;
+    r->length = length;
+    return true;
+}
+
+// reads the plain commands, failing with EIO once a block is cut short or
+// can't be unpacked, so a damaged file is never mistaken for a shorter one
+static ssize_t readPacked(void *cookie, char *buffer, size_t size) {
+    packedReader *r = cookie;
+    size_t done = 0;
+    while (done < size && !r->broken) {
+        if (r->at == r->length && !nextBlock(r)) break;
+        size_t n = (r->length - r->at < size - done) ? r->length - r->at : size - done;
+        memcpy(buffer + done, r->block + r->at, n);
+        r->at += n;
+        done += n;
+    }
+    if (!r->broken) return done;
+    errno = EIO;
+    return -1;
+}
+
+// goes back to the first block of a packed .sk file
+static void restart(packedReader *r) {
+    fseeko(r->file, sizeof(MAGIC), SEEK_SET);
+    r->start = 0;
+    r->length = r->at = 0;
+    r->broken = false;
+}
+
+// seeks by unpacking only the block the new position is in, skipping the
+// packed bytes of every block between
+static int seekPacked(void *cookie, off64_t *offset, int whence) {
+    packedReader *r = cookie;
+    int64_t target = *offset;
+    int type;
+    size_t length, packedLength;
+    if (whence == SEEK_CUR) target += r->start + r->at;
+    else if (whence == SEEK_END) {
+        restart(r);
+        while (readHeader(r->file, &type, &length, &packedLength)) {
+            fseeko(r->file, packedLength, SEEK_CUR);
+            target += length;
+        }
+        restart(r);
+    }
+    if (target < 0) return -1;
+    if (target < r->start) restart(r);
+
+    if (target <= r->start + (int64_t) r->length) r->at = target - r->start;
+    else {
+        r->start += r->length;
+        r->length = r->at = 0;
+        while (true) {
+            if (!readHeader(r->file, &type, &length, &packedLength)) {
+                // past the end, where reading finds nothing
+                r->start = target;
+                break;
+            }
+            if (target >= r->start + (int64_t) length) {
+                fseeko(r->file, packedLength, SEEK_CUR);
+                r->start += length;
+                continue;
+            }
+            if (!readBlock(r->file, r->packed, r->block, type, length, packedLength)) {
+                r->broken = true;
+                return -1;
+            }
+            r->length = length;
+            r->at = target - r->start;
+            break;
+        }
+    }
+    *offset = target;
+    return 0;
+}
+
+static int closePacked(void *cookie) {
+    packedReader *r = cookie;
+    int result = fclose(r->file);
+    free(r->block);
+    free(r->packed);
+    free(r);
+    return result;
+}
+
+// reads a .sk file from a stream already open, unpacking it block by block
+// as it is read if it is packed. only its first byte is read to tell, so
+// this works on pipes too. returns NULL, leaving the stream open, if it
+// starts like an envelope but isn't one. otherwise the stream returned
+// closes this one when closed
+FILE *readSK(FILE *file) {
+    int first = fgetc(file);
+    if (first != MAGIC[0]) {
+        ungetc(first, file);
+        return file;
+    }
+    unsigned char rest[sizeof(MAGIC) - 1];
+    if (fread(rest, 1, sizeof(rest), file) != sizeof(rest)) return NULL;
+    if (memcmp(rest, MAGIC + 1, sizeof(rest)) != 0) return NULL;
+    packedReader *r = malloc(sizeof(packedReader));
+    *r = (packedReader) {file, malloc(ENVELOPE_BLOCK), malloc(ENVELOPE_BLOCK), 0, 0, 0, false};
+    cookie_io_functions_t functions = {readPacked, NULL, seekPacked, closePacked};
+    FILE *in = fopencookie(r, "rb", functions);
+    if (in == NULL) {
+        free(r->block);
+        free(r->packed);
+        free(r);
+    }
+    return in;
+}
+
+// opens a .sk file for reading like fopen, unpacking it block by block as
+// it is read if it is packed, so the rest of the program reads the plain
+// commands either way. seeking is supported. returns NULL if it can't be
+// opened
+FILE *openSK(char filename[]) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return NULL;
+    FILE *in = readSK(file);
+    if (in == NULL) fclose(file);
+    return in;
+}
+
+// packs or unpacks a .sk file where it is, doing nothing if it is already
+// the way asked for. returns false if it can't be read or written
+bool packSKFile(char filename[], bool packing) {
+    FILE *in = fopen(filename, "rb");
+    if (in == NULL) return false;
+    if (hasMagic(in) == packing) {
+        fclose(in);
+        return true;
+    }
+    rewind(in);
+    char *temporary = malloc(strlen(filename) + sizeof(".tmp"));
+    sprintf(temporary, "%s.tmp", filename);
+    FILE *out = fopen(temporary, "wb");
+    bool written = out != NULL;
+    if (written && packing) packSK(in, out);
+    else if (written) written = unpackSK(in, out);
+    fclose(in);
+    if (out != NULL) written = fclose(out) == 0 && written;
+    if (written) written = rename(temporary, filename) == 0;
+    else remove(temporary);
+    free(temporary);
+    return written;
+}
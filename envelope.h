@@ -0,0 +1,44 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+// A packed .sk file holds the same commands as a plain one, compressed in
+// an envelope: a magic number, then blocks of up to ENVELOPE_BLOCK bytes of
+// commands, each compressed on its own with LZ77 and Huffman codes, or
+// stored as they are if that is no smaller. Every block starts with its
+// type, its length unpacked and its length packed, so a reader can skip
+// whole blocks to seek, and never holds more than one block unpacked.
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define ENVELOPE_BLOCK 65536 // most bytes of commands in a block
+
+// checks whether a .sk file is packed, from its first bytes
+bool packedSK(char filename[]);
+
+// opens a .sk file for reading like fopen, unpacking it block by block as
+// it is read if it is packed, so the rest of the program reads the plain
+// commands either way. seeking is supported. returns NULL if it can't be
+// opened. a packed block that is cut short or can't be unpacked sets the
+// stream's error indicator, so readers check ferror as well as EOF
+FILE *openSK(char filename[]);
+
+// reads a .sk file from a stream already open, unpacking it block by block
+// as it is read if it is packed. only its first byte is read to tell, so
+// this works on pipes too. returns NULL, leaving the stream open, if it
+// starts like an envelope but isn't one. otherwise the stream returned
+// closes this one when closed
+FILE *readSK(FILE *file);
+
+// writes the commands read from IN to OUT in an envelope
+void packSK(FILE *in, FILE *out);
+
+// writes the commands in an envelope read from IN to OUT, returning false
+// if IN is not a whole envelope
+bool unpackSK(FILE *in, FILE *out);
+
+// packs or unpacks a .sk file where it is, doing nothing if it is already
+// the way asked for. returns false if it can't be read or written
+bool packSKFile(char filename[], bool packing);
+
+#endif
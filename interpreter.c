@@ -0,0 +1,163 @@
+#include "interpreter.h"
+#include <stdlib.h>
+
+// the same values as in sketch.h
+enum { DX = 0, DY = 1, TOOL = 2, DATA = 3 };
+enum { NONE = 0, LINE = 1, BLOCK = 2, COLOUR = 3, TARGETX = 4, TARGETY = 5,
+       SHOW = 6, PAUSE = 7, NEXTFRAME = 8 };
+
+// the state a sketch starts in, with the LINE tool and no colour set
+sketchState newSketchState(void) {
+    return (sketchState) {0, 0, 0, 0, LINE, 0, false, 0};
+}
+
+// decodes one byte of a sketch, returning true and filling in OP if the
+// byte makes a call. a NEXTFRAME starts the state afresh for the next frame
+bool decodeByte(sketchState *s, unsigned char byte, sketchOp *op) {
+    int opcode = byte >> 6, operand = byte & 0x3f;
+    if (opcode == DX) s->tx += (operand < 32) ? operand : operand - 64;
+    else if (opcode == DY) {
+        s->ty += (operand < 32) ? operand : operand - 64;
+        bool drawing = s->tool == LINE || s->tool == BLOCK;
+        if (drawing) {
+            *op = (sketchOp) {(s->tool == LINE) ? OP_LINE : OP_BLOCK, s->x, s->y, s->tx, s->ty};
+        }
+        s->x = s->tx; s->y = s->ty;
+        return drawing;
+    }
+    else if (opcode == DATA) s->data = (s->data << 6) + operand;
+    // every tool command uses up the data before it
+    else {
+        unsigned int data = s->data;
+        s->data = 0;
+        if (operand == NONE || operand == LINE || operand == BLOCK) s->tool = operand;
+        else if (operand == TARGETX) s->tx = data;
+        else if (operand == TARGETY) s->ty = data;
+        else if (operand == COLOUR) {
+            s->coloured = true;
+            s->rgba = data;
+            *op = (sketchOp) {OP_COLOUR, .value = data};
+            return true;
+        }
+        else if (operand == SHOW || operand == PAUSE) {
+            *op = (sketchOp) {(operand == SHOW) ? OP_SHOW : OP_PAUSE, .value = data};
+            return true;
+        }
+        else if (operand == NEXTFRAME) {
+            *s = (sketchState) {0, 0, 0, 0, LINE, 0, s->coloured, s->rgba};
+            *op = (sketchOp) {OP_NEXTFRAME};
+            return true;
+        }
+    }
+    return false;
+}
+
+// decodes the rest of a sketch read from IN into a table of ops, with each
+// op's end counted from where IN was
+opTable decodeOps(FILE *in) {
+    opTable t = {malloc(64 * sizeof(sketchOp)), 0, 64};
+    sketchState s = newSketchState();
+    uint64_t offset = 0;
+    for (int ch = fgetc(in); ch != EOF; ch = fgetc(in)) {
+        offset++;
+        if (t.count == t.capacity) {
+            t.capacity *= 2;
+            t.ops = realloc(t.ops, t.capacity * sizeof(sketchOp));
+        }
+        if (!decodeByte(&s, ch, &t.ops[t.count])) continue;
+        t.ops[t.count++].end = offset;
+    }
+    return t;
+}
+
+// frees the ops of a table
+void freeOps(opTable t) {
+    free(t.ops);
+}
+
+// finds the first op that ends after an offset in the sketch, which is the
+// first of a frame starting there, or the number of ops if there is none
+int opAt(opTable t, uint64_t offset) {
+    int low = 0, high = t.count;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (t.ops[middle].end <= offset) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// plays one op through a backend, skipping any the backend leaves out
+static inline void dispatch(sketchOp *op, sketchBackend *b) {
+    switch (op->kind) {
+    case OP_LINE:
+        if (b->line != NULL) b->line(b->target, op->x, op->y, op->tx, op->ty);
+        break;
+    case OP_BLOCK:
+        if (b->block != NULL) b->block(b->target, op->x, op->y, op->tx - op->x, op->ty - op->y);
+        break;
+    case OP_COLOUR:
+        if (b->colour != NULL) b->colour(b->target, op->value);
+        break;
+    case OP_SHOW:
+        if (b->show != NULL) b->show(b->target);
+        break;
+    case OP_PAUSE:
+        if (b->pause != NULL) b->pause(b->target, op->value);
+        break;
+    case OP_NEXTFRAME:
+        if (b->nextFrame != NULL) b->nextFrame(b->target);
+        break;
+    }
+}
+
+// plays one op through a backend
+void playOp(sketchOp *op, sketchBackend *b) {
+    dispatch(op, b);
+}
+
+// plays the ops from FIRST up to LAST through a backend, in order
+void playOps(opTable t, int first, int last, sketchBackend *b) {
+    for (int i=first; i<last; i++) dispatch(&t.ops[i], b);
+}
+
+// plays the ops from FIRST through a backend up to the end of the frame,
+// its NEXTFRAME included, returning the op after it, or the number of ops
+// if the frame has none
+int playFrame(opTable t, int first, sketchBackend *b) {
+    int i = first;
+    while (i < t.count && t.ops[i].kind != OP_NEXTFRAME) dispatch(&t.ops[i++], b);
+    if (i == t.count) return i;
+    dispatch(&t.ops[i], b);
+    return i + 1;
+}
+
+static void countLine(void *counts, int x0, int y0, int x1, int y1) {
+    ((opCounts *) counts)->ops[OP_LINE]++;
+}
+
+static void countBlock(void *counts, int x, int y, int w, int h) {
+    ((opCounts *) counts)->ops[OP_BLOCK]++;
+}
+
+static void countColour(void *counts, unsigned int rgba) {
+    ((opCounts *) counts)->ops[OP_COLOUR]++;
+}
+
+static void countShow(void *counts) {
+    ((opCounts *) counts)->ops[OP_SHOW]++;
+}
+
+static void countPause(void *counts, int ms) {
+    ((opCounts *) counts)->ops[OP_PAUSE]++;
+}
+
+static void countNextFrame(void *counts) {
+    ((opCounts *) counts)->ops[OP_NEXTFRAME]++;
+}
+
+// a backend that draws nothing, only counting the ops played into COUNTS
+sketchBackend countingBackend(opCounts *counts) {
+    return (sketchBackend) {counts, countLine, countBlock, countColour, countShow, countPause,
+                            countNextFrame};
+}
@@ -0,0 +1,94 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+// The one reading of the .sk format, shared by the viewer, the converter's
+// decoder and the tools that read sketches back. Bytes are decoded into ops,
+// each a call the sketch makes: a line or a block with both its ends worked
+// out, a colour, a show, a pause or the end of a frame. DATA, DX and the
+// tool changes only change the drawing state, so they are folded into the
+// ops that use it. A whole sketch can be decoded once into a table of ops,
+// then played through a backend as often as needed, without going back to
+// its bytes. A backend is a table of functions that draw the ops: on a
+// display, on a board of greys, or nowhere at all, only counting them.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum { OP_LINE, OP_BLOCK, OP_COLOUR, OP_SHOW, OP_PAUSE, OP_NEXTFRAME, OP_KINDS }; // kinds of op
+
+// one call a sketch makes
+typedef struct sketchOp {
+    unsigned char kind;
+    int x, y, tx, ty; // where a line or block is drawn from and to
+    unsigned int value; // the colour set, or the length of a pause
+    uint64_t end; // offset of the byte after the op's command, set by decodeOps
+} sketchOp;
+
+// the drawing state kept between bytes, as the viewer keeps it. all of it
+// starts afresh every frame apart from the colour
+typedef struct sketchState {
+    int x, y, tx, ty;
+    int tool;
+    unsigned int data;
+    bool coloured; // false until a colour is set
+    unsigned int rgba;
+} sketchState;
+
+// every op of a sketch, in order
+typedef struct opTable {
+    sketchOp *ops;
+    int count, capacity;
+} opTable;
+
+// what ops are played through. each function is given TARGET first, and
+// any of them can be NULL to leave those ops out. blocks are given as the
+// viewer's are, from a corner by a width and height that can be negative
+typedef struct sketchBackend {
+    void *target;
+    void (*line)(void *target, int x0, int y0, int x1, int y1);
+    void (*block)(void *target, int x, int y, int w, int h);
+    void (*colour)(void *target, unsigned int rgba);
+    void (*show)(void *target);
+    void (*pause)(void *target, int ms);
+    void (*nextFrame)(void *target);
+} sketchBackend;
+
+// the number of each kind of op played through a counting backend
+typedef struct opCounts {
+    long ops[OP_KINDS];
+} opCounts;
+
+// the state a sketch starts in, with the LINE tool and no colour set
+sketchState newSketchState(void);
+
+// decodes one byte of a sketch, returning true and filling in OP if the
+// byte makes a call. a NEXTFRAME starts the state afresh for the next frame
+bool decodeByte(sketchState *s, unsigned char byte, sketchOp *op);
+
+// decodes the rest of a sketch read from IN into a table of ops, with each
+// op's end counted from where IN was
+opTable decodeOps(FILE *in);
+
+// frees the ops of a table
+void freeOps(opTable t);
+
+// finds the first op that ends after an offset in the sketch, which is the
+// first of a frame starting there, or the number of ops if there is none
+int opAt(opTable t, uint64_t offset);
+
+// plays one op through a backend
+void playOp(sketchOp *op, sketchBackend *b);
+
+// plays the ops from FIRST up to LAST through a backend, in order
+void playOps(opTable t, int first, int last, sketchBackend *b);
+
+// plays the ops from FIRST through a backend up to the end of the frame,
+// its NEXTFRAME included, returning the op after it, or the number of ops
+// if the frame has none
+int playFrame(opTable t, int first, sketchBackend *b);
+
+// a backend that draws nothing, only counting the ops played into COUNTS
+sketchBackend countingBackend(opCounts *counts);
+
+#endif
@@ -0,0 +1,127 @@
+#define _POSIX_C_SOURCE 200809L // for open_memstream and fmemopen
+#include "libsketch.h"
+#include "converter.h"
+#include "quantise.h"
+
+#define MAX_SIDE 32768 // largest width or height, keeping pixel counts in an int
+
+static_assert((int) SK_RLE == RLE && (int) SK_BOX == BOX && (int) SK_STRIPES == STRIPES
+              && (int) SK_EXHAUSTIVE == EXHAUSTIVE && (int) SK_LARGEST == LARGEST,
+              "library algorithms match the converter's");
+
+// everything a conversion changes, kept apart from any other conversion
+struct skContext {
+    board b; // reused while images stay the same size
+};
+
+// allocates a context, or returns NULL if out of memory
+skContext *sk_newContext(void) {
+    return calloc(1, sizeof(skContext));
+}
+
+// releases a context and everything kept in it
+void sk_freeContext(skContext *ctx) {
+    if (ctx == NULL) return;
+    if (ctx->b.pixels != NULL) freeBoard(ctx->b);
+    free(ctx);
+}
+
+// the options the converter uses: the BOX algorithm, using lines, with no
+// time limit and every grey kept
+skOptions sk_defaultOptions(void) {
+    return (skOptions) {SK_BOX, true, 0, 0, false};
+}
+
+// checks a size and a stride describe an image that can be converted
+static bool validSize(int width, int height, int stride) {
+    return width > 0 && height > 0 && width <= MAX_SIDE && height <= MAX_SIDE
+        && stride >= width;
+}
+
+// makes the context's board the given size, keeping it if it already is.
+// the board has no pixels if out of memory
+static board contextBoard(skContext *ctx, int width, int height) {
+    if (ctx->b.pixels != NULL && (ctx->b.width != width || ctx->b.height != height)) {
+        freeBoard(ctx->b);
+        ctx->b.pixels = NULL;
+    }
+    if (ctx->b.pixels == NULL) ctx->b = newBoard(width, height);
+    return ctx->b;
+}
+
+// encodes WIDTH x HEIGHT greyscale pixels, with rows STRIDE bytes apart, as
+// .sk data in OUT. OPTIONS may be NULL to use the default options
+skResult sk_encode(skContext *ctx, const uint8_t *pixels, int width, int height,
+                   int stride, const skOptions *options, skBuffer *out) {
+    if (ctx == NULL || pixels == NULL || out == NULL) return SK_INVALID_ARGUMENT;
+    if (!validSize(width, height, stride)) return SK_INVALID_ARGUMENT;
+    skOptions o = (options == NULL) ? sk_defaultOptions() : *options;
+    if (o.method < SK_RLE || o.method > SK_LARGEST) return SK_INVALID_ARGUMENT;
+    if (o.levels < 0 || o.levels > GREYSCALE_COLOURS) return SK_INVALID_ARGUMENT;
+
+    board b = contextBoard(ctx, width, height);
+    if (b.pixels == NULL) return SK_OUT_OF_MEMORY;
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) b.pixels[i][j] = pixels[(size_t) i * stride + j];
+    }
+    if (o.levels > 0) quantise(b, o.levels, o.dithering);
+
+    char *data;
+    size_t length;
+    FILE *sketch = open_memstream(&data, &length);
+    if (sketch == NULL) return SK_OUT_OF_MEMORY;
+    setDeadline(o.deadlineMs);
+    writeSketch(sketch, b, o.method, o.usingLines);
+    setDeadline(0);
+    if (fclose(sketch) != 0) {
+        free(data);
+        return SK_OUT_OF_MEMORY;
+    }
+    *out = (skBuffer) {(uint8_t *) data, length};
+    return SK_OK;
+}
+
+// decodes LENGTH bytes of .sk data onto WIDTH x HEIGHT greyscale pixels,
+// with rows STRIDE bytes apart, starting from a white image
+skResult sk_decode(skContext *ctx, const uint8_t *data, size_t length,
+                   uint8_t *pixels, int width, int height, int stride) {
+    if (ctx == NULL || pixels == NULL || (data == NULL && length > 0)) {
+        return SK_INVALID_ARGUMENT;
+    }
+    if (!validSize(width, height, stride)) return SK_INVALID_ARGUMENT;
+
+    board b = contextBoard(ctx, width, height);
+    if (b.pixels == NULL) return SK_OUT_OF_MEMORY;
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) b.pixels[i][j] = 0xff;
+    }
+    if (length > 0) {
+        FILE *sketch = fmemopen((void *) data, length, "rb");
+        if (sketch == NULL) return SK_OUT_OF_MEMORY;
+        bool drawn = convertSKToBoard(sketch, b);
+        fclose(sketch);
+        if (!drawn) return SK_UNSUPPORTED;
+    }
+    for (int i=0; i<height; i++) {
+        for (int j=0; j<width; j++) pixels[(size_t) i * stride + j] = b.pixels[i][j];
+    }
+    return SK_OK;
+}
+
+// releases the data written by sk_encode
+void sk_freeBuffer(skBuffer *buffer) {
+    if (buffer == NULL) return;
+    free(buffer->data);
+    *buffer = (skBuffer) {NULL, 0};
+}
+
+// describes a result in words
+const char *sk_resultMessage(skResult result) {
+    switch (result) {
+        case SK_OK: return "ok";
+        case SK_INVALID_ARGUMENT: return "invalid argument";
+        case SK_OUT_OF_MEMORY: return "out of memory";
+        case SK_UNSUPPORTED: return "diagonal lines are not supported";
+    }
+    return "unknown result";
+}
@@ -0,0 +1,69 @@
+#ifndef LIBSKETCH_H
+#define LIBSKETCH_H
+
+// The converter as a library, encoding greyscale pixels to .sk data and
+// decoding it back again in memory. Everything a conversion changes is kept
+// in a context, so any number of threads can convert at once as long as
+// each uses its own context. Nothing is printed and nothing exits; every
+// function that can fail returns an skResult instead. SK_OUT_OF_MEMORY covers
+// the image and the .sk data, whose size the caller chooses; the encoder's
+// own working memory is not checked, so running out of it part way through
+// an encode is not recovered from.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum skResult {
+    SK_OK = 0,
+    SK_INVALID_ARGUMENT, // a missing pointer, or a size, method or level out of range
+    SK_OUT_OF_MEMORY,
+    SK_UNSUPPORTED // the .sk data draws a diagonal line, which can't be decoded
+} skResult;
+
+enum { SK_RLE, SK_BOX, SK_STRIPES, SK_EXHAUSTIVE, SK_LARGEST }; // algorithms
+
+typedef struct skOptions {
+    int method; // SK_RLE, SK_BOX, SK_STRIPES, SK_EXHAUSTIVE or SK_LARGEST
+    bool usingLines; // draw single pixel wide boxes as lines, saving a byte each
+    long deadlineMs; // if not 0, stop refining after this long and finish fast
+    int levels; // if not 0, reduce the image to this many greys first, losing detail
+    bool dithering; // spread the error from reducing greys onto neighbouring pixels
+} skOptions;
+
+// .sk data written by sk_encode, to be released with sk_freeBuffer
+typedef struct skBuffer {
+    uint8_t *data;
+    size_t length;
+} skBuffer;
+
+typedef struct skContext skContext;
+
+// allocates a context, or returns NULL if out of memory
+skContext *sk_newContext(void);
+
+// releases a context and everything kept in it
+void sk_freeContext(skContext *ctx);
+
+// the options the converter uses: the BOX algorithm, using lines
+skOptions sk_defaultOptions(void);
+
+// encodes WIDTH x HEIGHT greyscale pixels, with rows STRIDE bytes apart, as
+// .sk data in OUT. OPTIONS may be NULL to use the default options. returns
+// SK_OUT_OF_MEMORY if the image or the .sk data can't be allocated
+skResult sk_encode(skContext *ctx, const uint8_t *pixels, int width, int height,
+                   int stride, const skOptions *options, skBuffer *out);
+
+// decodes LENGTH bytes of .sk data onto WIDTH x HEIGHT greyscale pixels,
+// with rows STRIDE bytes apart, starting from a white image. returns
+// SK_OUT_OF_MEMORY if the image can't be allocated
+skResult sk_decode(skContext *ctx, const uint8_t *data, size_t length,
+                   uint8_t *pixels, int width, int height, int stride);
+
+// releases the data written by sk_encode
+void sk_freeBuffer(skBuffer *buffer);
+
+// describes a result in words
+const char *sk_resultMessage(skResult result);
+
+#endif
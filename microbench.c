@@ -0,0 +1,368 @@
+// Microbenchmarks of the converter's and viewer's hot functions, one at a
+// time, on boards and sketches read from .pgm and .sk fixtures. Each is run
+// for a while to warm up, then timed in many samples on a single CPU, and
+// the spread of the time per operation is printed as a JSON array.
+//
+// Use ./microbench [--only function] [fixture.pgm | fixture.sk]...
+// with fractal.pgm and fractal.sk as the fixtures if none are given.
+#define _GNU_SOURCE // for sched_setaffinity and sched_getcpu
+#include "converter.h"
+#include "interpreter.h"
+#include "microbench.h"
+#include <sched.h>
+#include <time.h>
+
+#define WARM_UP_SECONDS 0.2 // each function is run this long before timing
+#define SAMPLE_SECONDS 0.002 // each sample repeats a function at least this long
+#define SAMPLES 101
+#define OPERATIONS 256 // moves or colours written by each run of a writer
+
+typedef void kernel(void *data);
+
+// a board with some of it already drawn, and where the next box starts
+typedef struct boardFixture {
+    board b;
+    position start;
+    unsigned char grey;
+} boardFixture;
+
+// a run of writer calls on made-up values
+typedef struct writerFixture {
+    FILE *sink;
+    int values[OPERATIONS];
+    position targets[OPERATIONS];
+} writerFixture;
+
+// a box to mark on a board
+typedef struct boxFixture {
+    board b;
+    position start, end;
+    unsigned char grey;
+} boxFixture;
+
+// the bytes of a .sk file, and the ops they decode to
+typedef struct sketchFixture {
+    unsigned char *commands;
+    long length;
+    board b;
+    opTable ops;
+} sketchFixture;
+
+static char *only = NULL; // the one function to time, if given
+static bool first = true;
+
+// seconds since some fixed point in time, never slewed to match a clock
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int compareDoubles(const void *p, const void *q) {
+    double a = *(const double *) p, b = *(const double *) q;
+    return (a > b) - (a < b);
+}
+
+// times a function that does OPERATIONS operations each run, printing the
+// spread of nanoseconds taken per operation
+static void measure(char function[], char fixture[], char variant[], kernel *k, void *data,
+                    long operations, char unit[]) {
+    if (only != NULL && strcmp(only, function) != 0) return;
+    double start = now();
+    while (now() - start < WARM_UP_SECONDS) k(data);
+
+    // enough repeats in a sample that the clock's resolution doesn't matter
+    long repeats = 1;
+    for (;;) {
+        start = now();
+        for (long r=0; r<repeats; r++) k(data);
+        if (now() - start >= SAMPLE_SECONDS) break;
+        repeats *= 2;
+    }
+    double samples[SAMPLES];
+    for (int s=0; s<SAMPLES; s++) {
+        start = now();
+        for (long r=0; r<repeats; r++) k(data);
+        samples[s] = (now() - start) * 1e9 / repeats / operations;
+    }
+    qsort(samples, SAMPLES, sizeof(double), compareDoubles);
+
+    if (!first) printf(",\n");
+    first = false;
+    printf("  {\"function\": \"%s\", \"fixture\": \"%s\", \"variant\": \"%s\", \"per\": \"%s\", "
+           "\"ns_min\": %.2f, \"ns_p50\": %.2f, \"ns_p90\": %.2f, \"ns_p99\": %.2f, "
+           "\"repeats\": %ld}",
+           function, fixture, variant, unit, samples[0], samples[SAMPLES / 2],
+           samples[SAMPLES * 9 / 10], samples[SAMPLES * 99 / 100], repeats);
+}
+
+static void runFindBoxEnd(void *data) {
+    boardFixture *f = data;
+    findBoxEnd(f->start, f->b, f->grey);
+}
+
+static void runFindPixel(void *data) {
+    boardFixture *f = data;
+    findPixel(f->grey, f->b);
+}
+
+static void runMove(void *data) {
+    writerFixture *f = data;
+    for (int i=0; i<OPERATIONS; i++) move(f->sink, f->values[i], (i & 1) ? DY : DX);
+}
+
+static void runSet(void *data) {
+    writerFixture *f = data;
+    for (int i=0; i<OPERATIONS; i++) set(f->sink, f->values[i] & 0xfff, (i & 1) ? TARGETY : TARGETX);
+}
+
+static void runChangePosition(void *data) {
+    writerFixture *f = data;
+    position current = {0, 0};
+    for (int i=0; i<OPERATIONS; i++) changePosition(f->sink, &current, f->targets[i], i & 1);
+}
+
+static void runWriteColour(void *data) {
+    writerFixture *f = data;
+    for (int i=0; i<OPERATIONS; i++) writeColour(f->sink, greyscaleToRGBA(i));
+}
+
+// once the box is marked, every later run finds it the same way again
+static void runUpdateBoxBoard(void *data) {
+    boxFixture *f = data;
+    updateBoxBoard(f->grey, f->start, f->end, f->b);
+}
+
+static void runFinalise(void *data) {
+    boardFixture *f = data;
+    finalise(f->b);
+}
+
+static void runConvertSKToBoard(void *data) {
+    sketchFixture *f = data;
+    FILE *in = fmemopen(f->commands, f->length, "rb");
+    convertSKToBoard(in, f->b);
+    fclose(in);
+}
+
+static void runObey(void *data) {
+    sketchFixture *f = data;
+    obeyAll(f->commands, f->length);
+}
+
+static void runDecodeOps(void *data) {
+    sketchFixture *f = data;
+    FILE *in = fmemopen(f->commands, f->length, "rb");
+    freeOps(decodeOps(in));
+    fclose(in);
+}
+
+// the cost of dispatching ops once decoded, with nothing drawn
+static void runPlayOps(void *data) {
+    sketchFixture *f = data;
+    opCounts counts = {{0}};
+    sketchBackend b = countingBackend(&counts);
+    playOps(f->ops, 0, f->ops.count, &b);
+}
+
+static void runInterpretFirstFrame(void *data) {
+    interpretFirstFrame(data);
+}
+
+static void runCompiledFirstFrame(void *data) {
+    compiledFirstFrame();
+}
+
+static void runCopyCompiledImage(void *data) {
+    memcpy(data, compiledSketchImage,
+           (size_t) compiledSketchWidth * compiledSketchHeight * sizeof(uint32_t));
+}
+
+// compares grey values by how many pixels have them, most first
+static long histogram[256];
+static int compareCounts(const void *p, const void *q) {
+    long a = histogram[*(const unsigned char *) p], b = histogram[*(const unsigned char *) q];
+    return (a < b) - (a > b);
+}
+
+// fixes the pixels of the most common greys, as the BOX algorithm would
+// have drawn them first, until at least a fraction of the board is fixed,
+// returning the grey that would be drawn next
+static unsigned char fixBoard(board b, double fraction) {
+    memset(histogram, 0, sizeof(histogram));
+    for (int i=0; i<b.height; i++) {
+        for (int j=0; j<b.width; j++) histogram[b.pixels[i][j]]++;
+    }
+    unsigned char greys[256];
+    for (int g=0; g<256; g++) greys[g] = g;
+    qsort(greys, 256, 1, compareCounts);
+    long fixed = 0, wanted = fraction * b.width * b.height;
+    int g = 0;
+    while (fixed < wanted && g < 255 && histogram[greys[g+1]] > 0) fixed += histogram[greys[g++]];
+    bool drawn[256] = {false};
+    for (int k=0; k<g; k++) drawn[greys[k]] = true;
+    for (int i=0; i<b.height; i++) {
+        for (int j=0; j<b.width; j++) {
+            if (drawn[b.pixels[i][j]]) b.pixels[i][j] = FIXED;
+        }
+    }
+    return greys[g];
+}
+
+// reads a .pgm fixture, returning an empty board if it can't be read
+static board readFixture(char filename[]) {
+    FILE *in = fopen(filename, "rb");
+    int width, height;
+    if (in == NULL || !readPGMHeader(in, &width, &height)) {
+        if (in != NULL) fclose(in);
+        return (board) {0, 0, NULL};
+    }
+    board b = initialiseBoard(in, width, height);
+    fclose(in);
+    return b;
+}
+
+// copies a board, pixel for pixel
+static board copyBoard(board from) {
+    board b = newBoard(from.width, from.height);
+    for (int i=0; i<b.height; i++) memcpy(b.pixels[i], from.pixels[i], b.width * sizeof(int));
+    return b;
+}
+
+// times every function run on boards, with none, half and nearly all of
+// the board drawn, and boxes starting at the first, middle and last pixel
+// of the next grey to be drawn
+static void benchmarkImage(char filename[]) {
+    board original = readFixture(filename);
+    if (original.pixels == NULL) {
+        fprintf(stderr, "Error: %s is not a valid .pgm file\n", filename);
+        return;
+    }
+    double fractions[] = {0, 0.5, 0.9};
+    char *levels[] = {"0% fixed", "50% fixed", "90% fixed"};
+    for (int l=0; l<3; l++) {
+        board b = copyBoard(original);
+        unsigned char grey = fixBoard(b, fractions[l]);
+        // every pixel of the next grey in the order findPixel finds them
+        position *found = malloc(sizeof(position) * b.width * b.height);
+        int count = 0;
+        for (int i=0; i<b.width; i++) {
+            for (int j=0; j<b.height; j++) {
+                if (b.pixels[j][i] == grey) found[count++] = (position) {i, j};
+            }
+        }
+        char *places[] = {"first", "middle", "last"};
+        position starts[] = {found[0], found[count / 2], found[count - 1]};
+        for (int s=0; s<3; s++) {
+            char variant[64];
+            sprintf(variant, "%s, %s pixel", levels[l], places[s]);
+            boardFixture f = {b, starts[s], grey};
+            measure("findBoxEnd", filename, variant, runFindBoxEnd, &f, 1, "call");
+        }
+        boardFixture f = {b, found[0], grey};
+        measure("findPixel", filename, levels[l], runFindPixel, &f, 1, "call");
+        measure("finalise", filename, levels[l], runFinalise, &f, 1, "call");
+        free(found);
+        freeBoard(b);
+    }
+
+    board b = copyBoard(original);
+    position middle = {b.width / 2 - 8, b.height / 2 - 8};
+    boxFixture small = {b, middle, {middle.x + 16, middle.y + 16}, b.pixels[middle.y][middle.x]};
+    measure("updateBoxBoard", filename, "16x16 box", runUpdateBoxBoard, &small, 1, "call");
+    boxFixture whole = {b, {0, 0}, {b.width, b.height}, b.pixels[0][0]};
+    measure("updateBoxBoard", filename, "whole board", runUpdateBoxBoard, &whole, 1, "call");
+    freeBoard(b);
+    freeBoard(original);
+}
+
+// times every function run on a sketch's commands
+static void benchmarkSketch(char filename[]) {
+    FILE *in = fopen(filename, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Error: %s could not be opened\n", filename);
+        return;
+    }
+    fseek(in, 0, SEEK_END);
+    long length = ftell(in);
+    rewind(in);
+    unsigned char *commands = malloc(length + 1);
+    length = fread(commands, 1, length, in);
+    fclose(in);
+    if (length == 0) {
+        free(commands);
+        return;
+    }
+    sketchFixture f = {commands, length, newBoard(WIDTH, HEIGHT)};
+    FILE *sketch = fmemopen(commands, length, "rb");
+    f.ops = decodeOps(sketch);
+    fclose(sketch);
+    measure("convertSKToBoard", filename, "whole file", runConvertSKToBoard, &f, length, "byte");
+    measure("obey", filename, "whole file", runObey, &f, length, "byte");
+    measure("decodeOps", filename, "whole file", runDecodeOps, &f, length, "byte");
+    measure("playOps", filename, "counting backend", runPlayOps, &f, f.ops.count, "op");
+    freeOps(f.ops);
+    freeBoard(f.b);
+    free(commands);
+}
+
+// times how long the sketch compiled in by sk2c takes to draw its first
+// frame from nothing, as a program showing it starts up: read and decoded by
+// the interpreter, drawn by its compiled calls, and copied from its
+// rasterised frame if it has one
+static void benchmarkStartup(void) {
+    char *filename = (char *) compiledSketchFile;
+    measure("startup", filename, "interpreter", runInterpretFirstFrame, filename, 1, "frame");
+    measure("startup", filename, "sk2c calls", runCompiledFirstFrame, NULL, 1, "frame");
+    if (compiledSketchImage == NULL) return;
+    uint32_t *framebuffer = malloc((size_t) compiledSketchWidth * compiledSketchHeight * sizeof(uint32_t));
+    measure("startup", filename, "sk2c image", runCopyCompiledImage, framebuffer, 1, "frame");
+    free(framebuffer);
+}
+
+// times the writers on made-up moves, positions and colours
+static void benchmarkWriters(void) {
+    writerFixture f;
+    f.sink = fopen("/dev/null", "wb");
+    unsigned int seed = 2023;
+    for (int i=0; i<OPERATIONS; i++) {
+        seed = seed * 1103515245 + 12345;
+        f.values[i] = (int) (seed >> 16) % 401 - 200;
+        f.targets[i] = (position) {(seed >> 8) % WIDTH, (seed >> 20) % HEIGHT};
+    }
+    measure("move", "made up", "-200 to 200 pixels", runMove, &f, OPERATIONS, "call");
+    measure("set", "made up", "0 to 4095", runSet, &f, OPERATIONS, "call");
+    measure("changePosition", "made up", "anywhere on 200x200", runChangePosition, &f,
+            OPERATIONS, "call");
+    measure("writeColour", "made up", "every grey", runWriteColour, &f, OPERATIONS, "call");
+    fclose(f.sink);
+}
+
+int main(int n, char *args[n]) {
+    int i = 1;
+    if (n > 2 && strcmp(args[1], "--only") == 0) {
+        only = args[2];
+        i = 3;
+    }
+    // stay on one CPU, so every sample runs at the same clock speed and cache
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(sched_getcpu(), &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+
+    setbuf(stdout, NULL);
+    printf("[\n");
+    benchmarkWriters();
+    benchmarkStartup();
+    if (i == n) {
+        benchmarkImage("fractal.pgm");
+        benchmarkSketch("fractal.sk");
+    }
+    for (; i<n; i++) {
+        if (parseFiletype(args[i]) == PGM) benchmarkImage(args[i]);
+        else if (parseFiletype(args[i]) == SK) benchmarkSketch(args[i]);
+        else fprintf(stderr, "Error: %s is not a .pgm nor .sk file\n", args[i]);
+    }
+    printf("\n]\n");
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+// The viewer's side of the microbenchmark, kept apart as sketch.h and
+// converter.h can't both be included in one file.
+
+#include <stdint.h>
+
+// the sketch compiled into the microbenchmark by sk2c, fractal.sk unless
+// the Makefile is told otherwise
+extern const char compiledSketchFile[];
+extern const int compiledSketchWidth, compiledSketchHeight;
+extern const uint32_t *const compiledSketchImage; // NULL if it animates
+
+// runs LENGTH bytes of .sk commands through the viewer's obey, onto a
+// display that draws nothing, starting afresh at every frame as the viewer
+// does
+void obeyAll(unsigned char *commands, long length);
+
+// draws the first frame of a sketch as the viewer does when it starts,
+// opening, reading and decoding the file first
+void interpretFirstFrame(char filename[]);
+
+// draws the first frame of the compiled sketch, with nothing to decode
+void compiledFirstFrame(void);
+
+#endif
@@ -0,0 +1,59 @@
+// A display that draws nothing, so the viewer's obey can be timed on its own.
+#include "displayfull.h"
+#include "envelope.h"
+#include "interpreter.h"
+#include "sketch.h"
+#include "microbench.h"
+
+// counts the calls made, so none of them can be left out
+struct display { long calls; };
+static display nothing = {0};
+
+display *newDisplay(char *name, int width, int height) { return &nothing; }
+void freeDisplay(display *d) {}
+int getWidth(display *d) { return 200; }
+int getHeight(display *d) { return 200; }
+char *getName(display *d) { return ""; }
+void pause(display *d, int ms) { d->calls++; }
+void show(display *d) { d->calls++; }
+void line(display *d, int x0, int y0, int x1, int y1) { d->calls++; }
+void block(display *d, int x, int y, int w, int h) { d->calls++; }
+void colour(display *d, int rgba) { d->calls++; }
+void run(display *d, void *data, bool action(display *, const char, void *)) {}
+
+// runs LENGTH bytes of .sk commands through the viewer's obey, onto a
+// display that draws nothing, starting afresh at every frame as the viewer
+// does
+void obeyAll(unsigned char *commands, long length) {
+  state s = {0, 0, 0, 0, LINE, 0, 0, false};
+  for (long i=0; i<length; i++) {
+    obey(&nothing, &s, commands[i]);
+    if (s.end) s = (state) {0, 0, 0, 0, LINE, 0, 0, false};
+  }
+}
+
+static void drawLine(void *d, int x0, int y0, int x1, int y1) { line(d, x0, y0, x1, y1); }
+static void drawBlock(void *d, int x, int y, int w, int h) { block(d, x, y, w, h); }
+static void drawColour(void *d, unsigned int rgba) { colour(d, rgba); }
+static void drawShow(void *d) { show(d); }
+static void drawPause(void *d, int ms) { pause(d, ms); }
+
+// draws the first frame of a sketch as the viewer does when it starts,
+// opening, reading and decoding the file first
+void interpretFirstFrame(char filename[]) {
+  FILE *in = openSK(filename);
+  if (in == NULL) return;
+  opTable t = decodeOps(in);
+  fclose(in);
+  sketchBackend b = {&nothing, drawLine, drawBlock, drawColour, drawShow, drawPause, NULL};
+  playFrame(t, 0, &b);
+  show(&nothing);
+  freeOps(t);
+}
+
+void compiledSketchFrame(display *d, int frame);
+
+// draws the first frame of the compiled sketch, with nothing to decode
+void compiledFirstFrame(void) {
+  compiledSketchFrame(&nothing, 0);
+}
@@ -0,0 +1,326 @@
+#define _POSIX_C_SOURCE 200809L // for open_memstream
+#include "overdraw.h"
+#include "interpreter.h"
+#include <limits.h>
+
+const bool REMOVING_OVERDRAW = true;
+
+// drawing state the viewer is left in by the commands written so far
+typedef struct pen {
+    position pos;
+    bool located; // false after NEXTFRAME, as the viewer resets its state
+    int tool; // -1 if unknown
+    bool coloured;
+    unsigned int rgba;
+} pen;
+
+// adds a command to the end of a list of commands, growing it if needed
+static void addCommand(drawCommand **d, int *count, int *capacity, drawCommand c) {
+    if (*count == *capacity) {
+        *capacity *= 2;
+        *d = realloc(*d, *capacity * sizeof(drawCommand));
+    }
+    (*d)[*count] = c;
+    *count += 1;
+}
+
+// reads every draw and frame command from a .sk file, setting COUNT to the
+// number read
+drawCommand *readDrawCommands(FILE *in, int *count) {
+    int capacity = 64;
+    drawCommand *d = malloc(capacity * sizeof(drawCommand));
+    *count = 0;
+
+    // the command each kind of op is read back as
+    static const unsigned char tools[OP_KINDS] = {
+        [OP_LINE] = LINE, [OP_BLOCK] = BLOCK, [OP_COLOUR] = COLOUR,
+        [OP_SHOW] = SHOW, [OP_PAUSE] = PAUSE, [OP_NEXTFRAME] = NEXTFRAME
+    };
+    // follows the viewer's state exactly, as the interpreter is the viewer's
+    sketchState s = newSketchState();
+    sketchOp op;
+    for (int ch = fgetc(in); ch != EOF; ch = fgetc(in)) {
+        // colours are kept with the draws they are drawn in
+        if (!decodeByte(&s, ch, &op) || op.kind == OP_COLOUR) continue;
+        bool drawing = op.kind == OP_LINE || op.kind == OP_BLOCK;
+        drawCommand c = {tools[op.kind], s.coloured, drawing ? s.rgba : op.value,
+                         op.x, op.y, op.tx, op.ty};
+        addCommand(&d, count, &capacity, c);
+    }
+    if (s.coloured) addCommand(&d, count, &capacity, (drawCommand) {COLOUR, true, s.rgba});
+    return d;
+}
+
+// finds the pixels a draw covers as [left, right) x [top, bottom), clipped
+// to the board. diagonal lines and inside-out blocks are not worked out,
+// returning false, so they are always kept as they are
+bool drawnArea(drawCommand *c, int width, int height,
+               int *left, int *top, int *right, int *bottom) {
+    if (c->tool == LINE) {
+        if (c->x != c->tx && c->y != c->ty) return false;
+        *left = (c->x < c->tx) ? c->x : c->tx;
+        *right = ((c->x < c->tx) ? c->tx : c->x) + 1;
+        *top = (c->y < c->ty) ? c->y : c->ty;
+        *bottom = ((c->y < c->ty) ? c->ty : c->y) + 1;
+    }
+    else {
+        if (c->tx < c->x || c->ty < c->y) return false;
+        *left = c->x; *top = c->y;
+        *right = c->tx; *bottom = c->ty;
+    }
+    // pixels off the board are never seen
+    if (*left < 0) *left = 0;
+    if (*top < 0) *top = 0;
+    if (*right > width) *right = width;
+    if (*bottom > height) *bottom = height;
+    return true;
+}
+
+// walks the commands backwards with a coverage mask of a board of the given
+// size, marking draws that are fully painted over before the next SHOW as not
+// visible, and shrinking the rest to the pixels that are
+void findOverdraw(drawCommand *d, int count, int width, int height) {
+    bool *covered = calloc((size_t) width * height, sizeof(bool));
+    for (int i=count-1; i>=0; i--) {
+        drawCommand *c = &d[i];
+        // everything drawn before a frame is shown is seen, whatever comes after
+        if (c->tool == SHOW || c->tool == NEXTFRAME) {
+            memset(covered, 0, (size_t) width * height * sizeof(bool));
+        }
+        if (c->tool != LINE && c->tool != BLOCK) continue;
+        c->visible = true;
+        c->vx = c->x; c->vy = c->y;
+        c->vtx = c->tx; c->vty = c->ty;
+        int left, top, right, bottom;
+        if (!drawnArea(c, width, height, &left, &top, &right, &bottom)) continue;
+
+        // bounding box of every pixel not painted over by a later draw
+        int vLeft = width, vTop = height, vRight = 0, vBottom = 0;
+        for (int j=top; j<bottom; j++) {
+            for (int k=left; k<right; k++) {
+                if (covered[(size_t) j * width + k]) continue;
+                covered[(size_t) j * width + k] = true;
+                if (k < vLeft) vLeft = k;
+                if (k >= vRight) vRight = k + 1;
+                if (j < vTop) vTop = j;
+                if (j >= vBottom) vBottom = j + 1;
+            }
+        }
+        c->visible = vLeft < vRight;
+        if (!c->visible) continue;
+
+        if (c->tool == BLOCK) {
+            c->vx = vLeft; c->vy = vTop;
+            c->vtx = vRight; c->vty = vBottom;
+        }
+        // lines keep their direction, so one can still carry on from another
+        else {
+            c->vx = (c->x <= c->tx) ? vLeft : vRight - 1;
+            c->vtx = (c->x <= c->tx) ? vRight - 1 : vLeft;
+            c->vy = (c->y <= c->ty) ? vTop : vBottom - 1;
+            c->vty = (c->y <= c->ty) ? vBottom - 1 : vTop;
+        }
+    }
+    free(covered);
+}
+
+// writes DATA commands for a value, using as few commands as possible
+static void writeData(FILE *out, unsigned int value) {
+    int digits = 0;
+    for (unsigned int v=value; v != 0; v >>= SKETCH_DATA_BITS) digits++;
+    for (int i=digits-1; i>=0; i--) {
+        unsigned char operand = (value >> i * SKETCH_DATA_BITS) & SKETCH_DATA_MAX;
+        fputc((DATA << SKETCH_DATA_BITS) + operand, out);
+    }
+}
+
+// writes to .sk file commands for a single draw, the shrunk version if
+// SHRUNK, updating the pen to where the viewer will be left
+static void writeDraw(FILE *out, pen *p, drawCommand *c, bool shrunk) {
+    position start = shrunk ? (position) {c->vx, c->vy} : (position) {c->x, c->y};
+    position end = shrunk ? (position) {c->vtx, c->vty} : (position) {c->tx, c->ty};
+
+    if (c->coloured && (!p->coloured || p->rgba != c->rgba)) {
+        writeColour(out, c->rgba);
+        p->coloured = true;
+        p->rgba = c->rgba;
+    }
+    // set tool to NONE and move if you need to move
+    if (!p->located || p->pos.x != start.x || p->pos.y != start.y) {
+        if (p->tool != NONE) fputc((TOOL << SKETCH_DATA_BITS) + NONE, out);
+        p->tool = NONE;
+        if (p->located) changePosition(out, &p->pos, start, false);
+        else {
+            set(out, start.x, TARGETX);
+            set(out, start.y, TARGETY);
+            p->pos = start;
+            p->located = true;
+        }
+    }
+    if (p->tool != c->tool) fputc((TOOL << SKETCH_DATA_BITS) + c->tool, out);
+    p->tool = c->tool;
+    changePosition(out, &p->pos, end, true);
+}
+
+// writes to .sk file a frame command or the final colour, updating the pen
+static void writeFrameCommand(FILE *out, pen *p, drawCommand *c) {
+    if (c->tool == COLOUR) {
+        if (!p->coloured || p->rgba != c->rgba) writeColour(out, c->rgba);
+        p->coloured = true;
+        p->rgba = c->rgba;
+        return;
+    }
+    if (c->tool == PAUSE) writeData(out, c->rgba);
+    fputc((TOOL << SKETCH_DATA_BITS) + c->tool, out);
+    // the converter carries its state on past NEXTFRAME but the viewer
+    // doesn't, so the next draw has to set its position outright
+    if (c->tool == NEXTFRAME) {
+        p->located = false;
+        p->tool = -1;
+    }
+}
+
+// counts the bytes taken to write a draw from a given pen state
+static long drawBytes(FILE *scratch, pen p, drawCommand *c, bool shrunk) {
+    rewind(scratch);
+    writeDraw(scratch, &p, c, shrunk);
+    return ftell(scratch);
+}
+
+// writes to .sk file the visible draws and frame commands, shrinking draws
+// only where the shrunk version takes fewer bytes overall
+void writeDrawCommands(FILE *out, drawCommand *d, int count) {
+    char *scratchBuffer;
+    size_t scratchLength;
+    FILE *scratch = open_memstream(&scratchBuffer, &scratchLength);
+    pen start = {{0, 0}, true, LINE, false, 0};
+
+    // where a draw ends changes what the next one costs, so for both
+    // versions of each draw, keep the cheapest way of writing everything up
+    // to it, and which version of the draw before it that came from
+    long cost[2] = {0, LONG_MAX};
+    pen pens[2] = {start, start};
+    int (*from)[2] = malloc(count * sizeof(*from));
+    for (int i=0; i<count; i++) {
+        drawCommand *c = &d[i];
+        if (c->tool != LINE && c->tool != BLOCK) {
+            writeFrameCommand(scratch, &pens[0], c);
+            writeFrameCommand(scratch, &pens[1], c);
+            continue;
+        }
+        if (!c->visible) continue;
+
+        bool shrinkable = c->vx != c->x || c->vy != c->y || c->vtx != c->tx || c->vty != c->ty;
+        long nextCost[2] = {LONG_MAX, LONG_MAX};
+        pen nextPens[2] = {start, start};
+        for (int v=0; v <= shrinkable; v++) {
+            for (int u=0; u<2; u++) {
+                if (cost[u] == LONG_MAX) continue;
+                long bytes = cost[u] + drawBytes(scratch, pens[u], c, v);
+                if (bytes < nextCost[v]) {
+                    nextCost[v] = bytes;
+                    nextPens[v] = pens[u];
+                    from[i][v] = u;
+                }
+            }
+            writeDraw(scratch, &nextPens[v], c, v);
+        }
+        cost[0] = nextCost[0]; cost[1] = nextCost[1];
+        pens[0] = nextPens[0]; pens[1] = nextPens[1];
+    }
+
+    // work back through the draws to find which version of each to write
+    bool *shrunk = malloc(count * sizeof(bool));
+    int v = (cost[1] < cost[0]) ? 1 : 0;
+    for (int i=count-1; i>=0; i--) {
+        if ((d[i].tool == LINE || d[i].tool == BLOCK) && d[i].visible) {
+            shrunk[i] = v;
+            v = from[i][v];
+        }
+    }
+
+    pen p = start;
+    for (int i=0; i<count; i++) {
+        if (d[i].tool != LINE && d[i].tool != BLOCK) writeFrameCommand(out, &p, &d[i]);
+        else if (d[i].visible) writeDraw(out, &p, &d[i], shrunk[i]);
+    }
+    free(shrunk);
+    free(from);
+    fclose(scratch);
+    free(scratchBuffer);
+}
+
+// checks every draw can be written back, as positions can only be set to
+// values that are not negative
+static bool writable(drawCommand *d, int count) {
+    for (int i=0; i<count; i++) {
+        if (d[i].tool != LINE && d[i].tool != BLOCK) continue;
+        int coords[4] = {d[i].x, d[i].y, d[i].tx, d[i].ty};
+        for (int j=0; j<4; j++) {
+            if (coords[j] < 0) return false;
+        }
+    }
+    return true;
+}
+
+// writes to .sk file the commands of an old .sk file then the ADDED ones,
+// leaving out old draws after its last SHOW or NEXTFRAME that lie wholly in
+// the TILE squares marked REDRAWN, as the added draws paint over them.
+// returns false without writing anything if a draw can't be written back
+bool spliceDraws(FILE *out, drawCommand *old, int oldCount, drawCommand *added, int addedCount,
+                 bool redrawn[], int tile, int width, int height) {
+    // the old file's final colour is set again by the added draws
+    if (oldCount > 0 && old[oldCount-1].tool == COLOUR) oldCount--;
+    int count = oldCount + addedCount;
+    drawCommand *d = malloc((count + 1) * sizeof(drawCommand));
+    memcpy(d, old, oldCount * sizeof(drawCommand));
+    memcpy(d + oldCount, added, addedCount * sizeof(drawCommand));
+    if (!writable(d, count)) {
+        free(d);
+        return false;
+    }
+
+    int across = (width + tile - 1) / tile;
+    bool shown = false; // set once a SHOW or NEXTFRAME comes later on
+    for (int i=count-1; i>=0; i--) {
+        drawCommand *c = &d[i];
+        if (c->tool == SHOW || c->tool == NEXTFRAME) shown = true;
+        if (c->tool != LINE && c->tool != BLOCK) continue;
+        c->visible = true;
+        c->vx = c->x; c->vy = c->y;
+        c->vtx = c->tx; c->vty = c->ty;
+        int left, top, right, bottom;
+        if (i >= oldCount || shown || !drawnArea(c, width, height, &left, &top, &right, &bottom)) {
+            continue;
+        }
+        bool covered = true;
+        for (int j=top / tile; j * tile < bottom && covered; j++) {
+            for (int k=left / tile; k * tile < right && covered; k++) {
+                covered = redrawn[j * across + k];
+            }
+        }
+        c->visible = !covered;
+    }
+    writeDrawCommands(out, d, count);
+    free(d);
+    return true;
+}
+
+// rewrites a .sk file drawing on a board of the given size without draws
+// that are never seen, shrinking draws that are partly painted over when
+// that saves bytes
+void removeOverdraw(FILE *in, FILE *out, int width, int height) {
+    int count;
+    drawCommand *d = readDrawCommands(in, &count);
+    if (writable(d, count)) {
+        findOverdraw(d, count, width, height);
+        writeDrawCommands(out, d, count);
+    }
+    // otherwise copy the file across unchanged
+    else {
+        rewind(in);
+        int ch = fgetc(in);
+        while (ch != EOF) {fputc(ch, out); ch = fgetc(in);}
+    }
+    free(d);
+}
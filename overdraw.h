@@ -0,0 +1,52 @@
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include "converter.h"
+
+extern const bool REMOVING_OVERDRAW;
+
+// a single command read back from a .sk file, either a LINE or BLOCK draw,
+// one of the SHOW, PAUSE and NEXTFRAME commands that sit between them, or
+// a final COLOUR for the colour the file leaves set when it ends
+typedef struct drawCommand {
+    unsigned char tool;
+    bool coloured; // false if drawn before any COLOUR command
+    unsigned int rgba; // drawing colour, or length of a PAUSE
+    int x, y, tx, ty; // position and target position when drawn
+    // set by findOverdraw
+    bool visible; // false if every pixel drawn is painted over later on
+    int vx, vy, vtx, vty; // smallest draw still covering every visible pixel
+} drawCommand;
+
+// reads every draw and frame command from a .sk file, setting COUNT to the
+// number read
+drawCommand *readDrawCommands(FILE *in, int *count);
+
+// finds the pixels a draw covers as [left, right) x [top, bottom), clipped
+// to the board. diagonal lines and inside-out blocks are not worked out,
+// returning false
+bool drawnArea(drawCommand *c, int width, int height,
+               int *left, int *top, int *right, int *bottom);
+
+// walks the commands backwards with a coverage mask of a board of the given
+// size, marking draws that are fully painted over before the next SHOW as not
+// visible, and shrinking the rest to the pixels that are
+void findOverdraw(drawCommand *d, int count, int width, int height);
+
+// writes to .sk file the visible draws and frame commands, shrinking draws
+// only where the shrunk version takes fewer bytes overall
+void writeDrawCommands(FILE *out, drawCommand *d, int count);
+
+// writes to .sk file the commands of an old .sk file then the ADDED ones,
+// leaving out old draws after its last SHOW or NEXTFRAME that lie wholly in
+// the TILE squares marked REDRAWN, as the added draws paint over them.
+// returns false without writing anything if a draw can't be written back
+bool spliceDraws(FILE *out, drawCommand *old, int oldCount, drawCommand *added, int addedCount,
+                 bool redrawn[], int tile, int width, int height);
+
+// rewrites a .sk file drawing on a board of the given size without draws
+// that are never seen, shrinking draws that are partly painted over when
+// that saves bytes
+void removeOverdraw(FILE *in, FILE *out, int width, int height);
+
+#endif
@@ -0,0 +1,108 @@
+#include "quantise.h"
+
+#define MAX_ITERATIONS 64 // k-means stops here even if levels are still moving
+
+// finds up to LEVELS greys that best stand in for every pixel of a board,
+// with k-means over its histogram starting from greys that split its pixels
+// evenly. returns how many were found, fewer if the board has fewer greys
+int findPalette(board b, int levels, unsigned char palette[]) {
+    long histogram[256] = {0};
+    for (int i=0; i<b.height; i++) {
+        for (int j=0; j<b.width; j++) histogram[b.pixels[i][j]]++;
+    }
+
+    // start each level at the grey where the next even share of pixels starts
+    long total = (long) b.width * b.height, seen = 0;
+    int count = 0;
+    for (int g=0; g<256 && count < levels; g++) {
+        if (histogram[g] == 0) continue;
+        if (seen >= total * count / levels) palette[count++] = g;
+        seen += histogram[g];
+    }
+
+    // move each level to the mean of the greys nearest to it until none move
+    bool moved = true;
+    for (int iteration=0; iteration<MAX_ITERATIONS && moved; iteration++) {
+        double sum[256] = {0};
+        long pixels[256] = {0};
+        for (int g=0; g<256; g++) {
+            if (histogram[g] == 0) continue;
+            int k = 0;
+            while (k+1 < count && abs(palette[k+1] - g) < abs(palette[k] - g)) k++;
+            sum[k] += (double) g * histogram[g];
+            pixels[k] += histogram[g];
+        }
+        moved = false;
+        for (int k=0; k<count; k++) {
+            if (pixels[k] == 0) continue;
+            unsigned char mean = lround(sum[k] / pixels[k]);
+            if (mean != palette[k]) moved = true;
+            palette[k] = mean;
+        }
+    }
+    return count;
+}
+
+// finds the grey in a palette of COUNT greys nearest to a value
+unsigned char nearestLevel(unsigned char palette[], int count, double value) {
+    int nearest = 0;
+    for (int k=1; k<count; k++) {
+        if (fabs(palette[k] - value) < fabs(palette[nearest] - value)) nearest = k;
+    }
+    return palette[nearest];
+}
+
+// reduces a board to at most LEVELS greys. if DITHERING, the error made at
+// each pixel is spread onto the pixels right of and below it
+void quantise(board b, int levels, bool dithering) {
+    unsigned char palette[256];
+    int count = findPalette(b, levels, palette);
+
+    if (!dithering) {
+        unsigned char nearest[256];
+        for (int g=0; g<256; g++) nearest[g] = nearestLevel(palette, count, g);
+        for (int i=0; i<b.height; i++) {
+            for (int j=0; j<b.width; j++) b.pixels[i][j] = nearest[b.pixels[i][j]];
+        }
+        return;
+    }
+
+    // Floyd-Steinberg, keeping the error carried onto this row and the next
+    // with a spare entry either side so the edges need no special case
+    double *error = calloc(b.width + 2, sizeof(double));
+    double *nextError = calloc(b.width + 2, sizeof(double));
+    for (int i=0; i<b.height; i++) {
+        for (int j=0; j<b.width; j++) {
+            double value = b.pixels[i][j] + error[j+1];
+            if (value < 0) value = 0;
+            if (value > 255) value = 255;
+            b.pixels[i][j] = nearestLevel(palette, count, value);
+            double e = value - b.pixels[i][j];
+            error[j+2] += e * 7 / 16;
+            nextError[j] += e * 3 / 16;
+            nextError[j+1] += e * 5 / 16;
+            nextError[j+2] += e * 1 / 16;
+        }
+        double *swap = error;
+        error = nextError;
+        nextError = swap;
+        memset(nextError, 0, (b.width + 2) * sizeof(double));
+    }
+    free(error);
+    free(nextError);
+}
+
+// peak signal to noise ratio of a board against the original in dB, or
+// INFINITY if they are the same
+double psnr(board original, board b) {
+    double squares = 0;
+    for (int i=0; i<b.height; i++) {
+        for (int j=0; j<b.width; j++) {
+            double difference = original.pixels[i][j] - b.pixels[i][j];
+            squares += difference * difference;
+        }
+    }
+    if (squares == 0) return INFINITY;
+    double meanSquare = squares / ((double) b.width * b.height);
+    return 10 * log10(255.0 * 255.0 / meanSquare);
+}
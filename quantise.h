@@ -0,0 +1,23 @@
+#ifndef QUANTISE_H
+#define QUANTISE_H
+
+#include "converter.h"
+#include <math.h>
+
+// finds up to LEVELS greys that best stand in for every pixel of a board,
+// with k-means over its histogram starting from greys that split its pixels
+// evenly. returns how many were found, fewer if the board has fewer greys
+int findPalette(board b, int levels, unsigned char palette[]);
+
+// finds the grey in a palette of COUNT greys nearest to a value
+unsigned char nearestLevel(unsigned char palette[], int count, double value);
+
+// reduces a board to at most LEVELS greys. if DITHERING, the error made at
+// each pixel is spread onto the pixels right of and below it
+void quantise(board b, int levels, bool dithering);
+
+// peak signal to noise ratio of a board against the original in dB, or
+// INFINITY if they are the same
+double psnr(board original, board b);
+
+#endif
@@ -0,0 +1,91 @@
+#define _POSIX_C_SOURCE 200809L // for fseeko
+#include "seekindex.h"
+#include "interpreter.h"
+#include <string.h>
+#include <sys/types.h>
+
+static const char MAGIC[4] = {'S', 'K', 'I', '1'};
+#define RECORD_BYTES (8 + 4 + 1 + 4) // every entry takes the same space
+
+// names the seek index of a .sk file by adding an i to the end of its name.
+// INDEXFILE must have room for two more characters than SKFILE
+void seekIndexName(char skFile[], char indexFile[]) {
+    strcpy(indexFile, skFile);
+    strcat(indexFile, "i");
+}
+
+// writes the lowest BYTES bytes of a value, lowest first
+static void writeBytes(FILE *out, uint64_t value, int bytes) {
+    for (int i=0; i<bytes; i++) fputc((value >> (8 * i)) & 0xff, out);
+}
+
+// reads a value written by writeBytes
+static uint64_t readBytes(unsigned char *in, int bytes) {
+    uint64_t value = 0;
+    for (int i=bytes-1; i>=0; i--) value = (value << 8) | in[i];
+    return value;
+}
+
+// writes a frame's entry, taking RECORD_BYTES bytes
+static void writeEntry(FILE *out, seekEntry e) {
+    writeBytes(out, e.offset, 8);
+    writeBytes(out, e.rgba, 4);
+    writeBytes(out, e.coloured, 1);
+    writeBytes(out, e.keyframe, 4);
+}
+
+// reads a .sk file once from start to end, writing a seek index of its
+// frames. a frame covers the canvas if it draws a block over all of WIDTH x
+// HEIGHT. returns the number of frames
+long writeSeekIndex(FILE *sk, FILE *out, int width, int height) {
+    fwrite(MAGIC, 1, sizeof(MAGIC), out);
+    // follows the viewer's state, which starts afresh every frame apart
+    // from the colour
+    sketchState s = newSketchState();
+    sketchOp op;
+    seekEntry frame = {0, 0, false, 0};
+    uint32_t keyframe = 0;
+    bool covering = false;
+    long frames = 0;
+    uint64_t offset = 0;
+    // each frame's entry is written once its end is reached, as only then
+    // is it known whether it covers the canvas
+    for (int ch = fgetc(sk); ch != EOF; ch = fgetc(sk)) {
+        offset++;
+        if (!decodeByte(&s, ch, &op)) continue;
+        if (op.kind == OP_BLOCK && op.x <= 0 && op.y <= 0 && op.tx >= width && op.ty >= height) {
+            covering = true;
+        }
+        else if (op.kind == OP_NEXTFRAME) {
+            if (covering || frames == 0) keyframe = frames;
+            frame.keyframe = keyframe;
+            writeEntry(out, frame);
+            frames++;
+            frame = (seekEntry) {offset, s.rgba, s.coloured, 0};
+            covering = false;
+        }
+    }
+    if (covering || frames == 0) keyframe = frames;
+    frame.keyframe = keyframe;
+    writeEntry(out, frame);
+    return frames + 1;
+}
+
+// reads the entry for a frame, counting from 0, from a seek index without
+// reading any other entries, returning false if it has no such frame
+bool readSeekEntry(FILE *index, long frame, seekEntry *e) {
+    char magic[sizeof(MAGIC)];
+    rewind(index);
+    if (frame < 0 || fread(magic, 1, sizeof(MAGIC), index) != sizeof(MAGIC)) return false;
+    if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+    if (fseeko(index, (off_t) sizeof(MAGIC) + (off_t) frame * RECORD_BYTES, SEEK_SET) != 0) {
+        return false;
+    }
+    unsigned char record[RECORD_BYTES];
+    if (fread(record, 1, RECORD_BYTES, index) != (size_t) RECORD_BYTES) return false;
+    e->offset = readBytes(record, 8);
+    e->rgba = readBytes(record + 8, 4);
+    e->coloured = record[12];
+    e->keyframe = readBytes(record + 13, 4);
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+// A seek index (.ski) sits beside an animated .sk file and records where each
+// frame starts, with the drawing state carried into it, so playback or
+// rendering can start at any frame without interpreting every byte before it.
+// Frames that paint over the whole canvas are noted, so a frame drawn on top
+// of the ones before it can be rebuilt from the latest of those instead.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// where a frame starts in a .sk file, and what is needed to start there
+typedef struct seekEntry {
+    uint64_t offset; // byte the frame's first command is at
+    uint32_t rgba; // colour already set when the frame starts
+    bool coloured; // false if no colour has been set yet
+    uint32_t keyframe; // latest frame up to this one that covers the canvas
+} seekEntry;
+
+// names the seek index of a .sk file by adding an i to the end of its name.
+// INDEXFILE must have room for two more characters than SKFILE
+void seekIndexName(char skFile[], char indexFile[]);
+
+// reads a .sk file once from start to end, writing a seek index of its
+// frames. a frame covers the canvas if it draws a block over all of WIDTH x
+// HEIGHT. returns the number of frames
+long writeSeekIndex(FILE *sk, FILE *out, int width, int height);
+
+// reads the entry for a frame, counting from 0, from a seek index without
+// reading any other entries, returning false if it has no such frame
+bool readSeekEntry(FILE *index, long frame, seekEntry *e);
+
+#endif
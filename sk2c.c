@@ -0,0 +1,267 @@
+// Compiles a .sk file into a C source file that draws it, so a program that
+// always shows the same sketch can be built with it and never read or decode
+// the sketch at runtime. Each frame becomes a function of display calls with
+// every position worked out, and colours set only where a draw needs them.
+// A sketch that settles on one frame, with no SHOW, PAUSE or NEXTFRAME, is
+// also rasterised, into a table of the frame's RGBA pixels that can be
+// copied straight into a framebuffer.
+//
+// The file written defines, for a sketch named NAME:
+//   const char NAMEFile[]        the .sk file it was compiled from
+//   const int NAMEFrames         the number of frames the viewer shows
+//   void NAMEFrame(display *d, int frame)
+//                                draws a frame as the viewer does, show included
+//   bool NAMEAction(display *d, const char key, void *data)
+//                                an action for run playing the frames in turn,
+//                                with data pointing to the next frame's number
+//   const int NAMEWidth, NAMEHeight
+//   const uint32_t *const NAMEImage
+//                                the rasterised frame, or NULL if it animates
+//
+// Use ./sk2c [--size WIDTHxHEIGHT] [--name NAME] file.sk [file.c]
+// with the name taken from the file's and the C written to file.sk.c if not
+// given.
+#include "converter.h"
+#include "envelope.h"
+#include "interpreter.h"
+#include <ctype.h>
+#include <stdint.h>
+
+#define BLACK 0x000000ff // the display is cleared to this
+#define WHITE 0xffffffff // and this is the colour it starts drawing with
+#define PIXELS_PER_LINE 8
+
+// an RGBA framebuffer drawn on as the display draws, to rasterise a sketch
+typedef struct canvas {
+    uint32_t *pixels;
+    int width, height;
+    uint32_t rgba;
+} canvas;
+
+static void plot(canvas *c, int x, int y) {
+    if (x >= 0 && x < c->width && y >= 0 && y < c->height) c->pixels[y * c->width + x] = c->rgba;
+}
+
+// lines are drawn with Bresenham's algorithm, both ends included, as the
+// display draws them
+static void canvasLine(void *target, int x0, int y0, int x1, int y1) {
+    canvas *c = target;
+    if ((x0 < 0 && x1 < 0) || (y0 < 0 && y1 < 0)) return;
+    if ((x0 >= c->width && x1 >= c->width) || (y0 >= c->height && y1 >= c->height)) return;
+    int dx = abs(x1 - x0), dy = -abs(y1 - y0);
+    int sx = (x0 < x1) ? 1 : -1, sy = (y0 < y1) ? 1 : -1;
+    int error = dx + dy;
+    while (true) {
+        plot(c, x0, y0);
+        if (x0 == x1 && y0 == y1) break;
+        int twice = 2 * error;
+        if (twice >= dy) { error += dy; x0 += sx; }
+        if (twice <= dx) { error += dx; y0 += sy; }
+    }
+}
+
+// a block of negative size covers the same pixels as one the right way round
+static void canvasBlock(void *target, int x, int y, int w, int h) {
+    canvas *c = target;
+    if (w < 0) { x += w; w = -w; }
+    if (h < 0) { y += h; h = -h; }
+    int left = (x < 0) ? 0 : x, top = (y < 0) ? 0 : y;
+    int right = (x + w > c->width) ? c->width : x + w;
+    int bottom = (y + h > c->height) ? c->height : y + h;
+    for (int j=top; j<bottom; j++) {
+        for (int i=left; i<right; i++) c->pixels[j * c->width + i] = c->rgba;
+    }
+}
+
+static void canvasColour(void *target, unsigned int rgba) {
+    ((canvas *) target)->rgba = rgba;
+}
+
+// rasterises a sketch that has a single frame and never shows it part way,
+// filling in PIXELS with the frame the viewer settles on. the viewer draws
+// that frame over and over on top of itself, starting with the colour the
+// last pass left, so it must come out the same the second time. returns
+// false if the sketch animates
+static bool rasterise(opTable t, uint32_t *pixels, int width, int height) {
+    for (int i=0; i<t.count; i++) {
+        if (t.ops[i].kind == OP_SHOW || t.ops[i].kind == OP_PAUSE) return false;
+        if (t.ops[i].kind == OP_NEXTFRAME) return false;
+    }
+    size_t size = (size_t) width * height;
+    canvas c = {pixels, width, height, WHITE};
+    for (size_t i=0; i<size; i++) pixels[i] = BLACK;
+    sketchBackend b = {&c, canvasLine, canvasBlock, canvasColour, NULL, NULL, NULL};
+    playOps(t, 0, t.count, &b);
+    uint32_t *first = malloc(size * sizeof(uint32_t));
+    memcpy(first, pixels, size * sizeof(uint32_t));
+    playOps(t, 0, t.count, &b);
+    bool settled = memcmp(first, pixels, size * sizeof(uint32_t)) == 0;
+    free(first);
+    return settled;
+}
+
+// writes the calls of one frame, from FIRST up to its NEXTFRAME or the end,
+// returning the op after it. a colour is only set before the draw that uses
+// it, and not at all if it is already the colour, but is always left set at
+// the end of the frame, as the next one starts with it
+static int compileFrame(FILE *out, opTable t, int first, int frame) {
+    fprintf(out, "static void frame%d(display *d) {\n", frame);
+    bool known = false, pending = false;
+    unsigned int current = 0, wanted = 0;
+    int i = first;
+    for (; i<t.count && t.ops[i].kind != OP_NEXTFRAME; i++) {
+        sketchOp *op = &t.ops[i];
+        if (op->kind == OP_COLOUR) {
+            wanted = op->value;
+            pending = true;
+            continue;
+        }
+        bool drawing = op->kind == OP_LINE || op->kind == OP_BLOCK;
+        if (drawing && pending && (!known || wanted != current)) {
+            fprintf(out, "    colour(d, 0x%08x);\n", wanted);
+            known = true;
+            current = wanted;
+        }
+        if (drawing) pending = false;
+        if (op->kind == OP_LINE) {
+            fprintf(out, "    line(d, %d, %d, %d, %d);\n", op->x, op->y, op->tx, op->ty);
+        }
+        else if (op->kind == OP_BLOCK) {
+            fprintf(out, "    block(d, %d, %d, %d, %d);\n", op->x, op->y, op->tx - op->x, op->ty - op->y);
+        }
+        else if (op->kind == OP_SHOW) fprintf(out, "    show(d);\n");
+        else if (op->kind == OP_PAUSE) fprintf(out, "    pause(d, %u);\n", op->value);
+    }
+    if (pending && (!known || wanted != current)) fprintf(out, "    colour(d, 0x%08x);\n", wanted);
+    fprintf(out, "    show(d);\n}\n\n");
+    return (i < t.count) ? i + 1 : i;
+}
+
+// writes a string as a C string literal
+static void writeString(FILE *out, char s[]) {
+    fputc('"', out);
+    for (size_t i=0; s[i] != '\0'; i++) {
+        if (s[i] == '"' || s[i] == '\\') fputc('\\', out);
+        fputc(s[i], out);
+    }
+    fputc('"', out);
+}
+
+// writes a sketch's ops as C drawing them, on a canvas of the given size
+static void compileSketch(FILE *out, opTable t, char filename[], char name[], int width, int height) {
+    int frames = 1;
+    for (int i=0; i<t.count; i++) frames += t.ops[i].kind == OP_NEXTFRAME;
+
+    fprintf(out, "// %s compiled by sk2c into the calls it makes on a display, with\n", filename);
+    fprintf(out, "// nothing left to decode at runtime. Regenerate it rather than editing it.\n");
+    fprintf(out, "#include \"displayfull.h\"\n#include <stddef.h>\n#include <stdint.h>\n\n");
+    fprintf(out, "const char %sFile[] = ", name);
+    writeString(out, filename);
+    fprintf(out, ";\n");
+    fprintf(out, "const int %sFrames = %d;\n\n", name, frames);
+
+    // every frame ends at a NEXTFRAME, and the last at the end of the file
+    for (int f=0, next=0; f<frames; f++) next = compileFrame(out, t, next, f);
+    fprintf(out, "static void (*const frames[%d])(display *) = {", frames);
+    for (int f=0; f<frames; f++) fprintf(out, (f == 0) ? "frame%d" : ", frame%d", f);
+    fprintf(out, "};\n\n");
+    fprintf(out, "void %sFrame(display *d, int frame) {\n    frames[frame](d);\n}\n\n", name);
+    fprintf(out, "bool %sAction(display *d, const char pressedKey, void *data) {\n", name);
+    fprintf(out, "    if (data == NULL) return (pressedKey == 27);\n");
+    fprintf(out, "    int *frame = data;\n");
+    fprintf(out, "    %sFrame(d, *frame);\n", name);
+    fprintf(out, "    *frame = (*frame + 1) %% %sFrames;\n", name);
+    fprintf(out, "    return (pressedKey == 27);\n}\n\n");
+
+    fprintf(out, "const int %sWidth = %d, %sHeight = %d;\n", name, width, name, height);
+    uint32_t *pixels = malloc((size_t) width * height * sizeof(uint32_t));
+    if (!rasterise(t, pixels, width, height)) {
+        fprintf(out, "const uint32_t *const %sImage = NULL;\n", name);
+        free(pixels);
+        return;
+    }
+    fprintf(out, "static const uint32_t image[%ld] = {", (long) width * height);
+    for (long i=0; i < (long) width * height; i++) {
+        if (i % PIXELS_PER_LINE == 0) fprintf(out, "\n   ");
+        fprintf(out, " 0x%08x,", pixels[i]);
+    }
+    fprintf(out, "\n};\nconst uint32_t *const %sImage = image;\n", name);
+    free(pixels);
+}
+
+// names a sketch after its file, as a C identifier: path/to/sketch-1.sk is
+// sketch_1. NAME must have room for as many characters as FILENAME
+static void nameSketch(char filename[], char name[]) {
+    char *base = strrchr(filename, '/');
+    base = (base == NULL) ? filename : base + 1;
+    size_t length = strlen(base) - strlen(".sk"), n = 0;
+    if (!isalpha((unsigned char) base[0]) && base[0] != '_') name[n++] = '_';
+    for (size_t i=0; i<length; i++) name[n++] = isalnum((unsigned char) base[i]) ? base[i] : '_';
+    name[n] = '\0';
+}
+
+// a name is used as it is given, so must already be a C identifier
+static bool validName(char name[]) {
+    if (!isalpha((unsigned char) name[0]) && name[0] != '_') return false;
+    for (size_t i=1; name[i] != '\0'; i++) {
+        if (!isalnum((unsigned char) name[i]) && name[i] != '_') return false;
+    }
+    return true;
+}
+
+int main(int n, char *args[n]) {
+    int width = WIDTH, height = HEIGHT;
+    char *name = NULL;
+    bool validOptions = true;
+    int i = 1;
+    for (; i < n && validOptions && strncmp(args[i], "--", 2) == 0; i++) {
+        if (strcmp(args[i], "--size") == 0 && i+1 < n) {
+            validOptions = sscanf(args[++i], "%dx%d", &width, &height) == 2
+                && width > 0 && height > 0;
+        }
+        else if (strcmp(args[i], "--name") == 0 && i+1 < n) {
+            name = args[++i];
+            validOptions = validName(name);
+        }
+        else validOptions = false;
+    }
+    if (!validOptions || (n - i != 1 && n - i != 2) || parseFiletype(args[i]) != SK) {
+        printf("Use ./sk2c [--size WIDTHxHEIGHT] [--name NAME] file.sk [file.c]\n");
+        return 1;
+    }
+    char *filename = args[i];
+    FILE *in = openSK(filename);
+    if (in == NULL) {
+        printf("No sketch file %s\n", filename);
+        return 1;
+    }
+    opTable t = decodeOps(in);
+    bool damaged = ferror(in);
+    fclose(in);
+    if (damaged) {
+        printf("Sketch file %s is cut short or damaged\n", filename);
+        freeOps(t);
+        return 1;
+    }
+
+    // the C goes beside the sketch unless named, file.sk to file.sk.c
+    char sketchName[strlen(filename) + 2];
+    if (name == NULL) {
+        nameSketch(filename, sketchName);
+        name = sketchName;
+    }
+    char cFile[strlen(filename) + 3];
+    sprintf(cFile, "%s.c", filename);
+    char *fileout = (n - i == 2) ? args[i+1] : cFile;
+    FILE *out = fopen(fileout, "w");
+    if (out == NULL) {
+        printf("Could not write %s\n", fileout);
+        freeOps(t);
+        return 1;
+    }
+    compileSketch(out, t, filename, name, width, height);
+    fclose(out);
+    freeOps(t);
+    printf("File %s has been written.\n", fileout);
+    return 0;
+}
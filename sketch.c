@@ -1,9 +1,14 @@
 // Basic program skeleton for a Sketch File (.sk) Viewer
 #include "displayfull.h"
+#include "envelope.h"
+#include "interpreter.h"
 #include "sketch.h"
+#include "seekindex.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 // typedef struct state { int x, y, tx, ty; unsigned char tool; 
 // unsigned int start, data; bool end;} state;
@@ -31,31 +36,84 @@ int getOperand(byte b) {
   return (b < 32) ? b : b - 64; 
 }
 
-int unsign(int x) {return (x < 0) ? x + 64 : x;}
+// The display functions, as a backend the interpreter can play ops through.
+static void displayLine(void *d, int x0, int y0, int x1, int y1) { line(d, x0, y0, x1, y1); }
+static void displayBlock(void *d, int x, int y, int w, int h) { block(d, x, y, w, h); }
+static void displayColour(void *d, unsigned int rgba) { colour(d, rgba); }
+static void displayShow(void *d) { show(d); }
+static void displayPause(void *d, int ms) { pause(d, ms); }
 
-// Execute the next byte of the command sequence.
+static sketchBackend displayBackend(display *d) {
+  return (sketchBackend) {d, displayLine, displayBlock, displayColour, displayShow, displayPause, NULL};
+}
+
+// Execute the next byte of the command sequence. The byte is decoded by the
+// interpreter, which keeps the same state, so it is read exactly as a whole
+// sketch is.
 void obey(display *d, state *s, byte op) {
-  int inst = getOpcode(op);
-  int operand = getOperand(op);
-
-  if (inst == DX) s->tx += operand;
-  else if (inst == DY) {
-    s->ty += operand;
-    if (s->tool == LINE) line(d, s->x, s->y, s->tx, s->ty);
-    else if (s->tool == BLOCK) block(d, s->x, s->y, s->tx - s->x, s->ty - s->y);
-    s->x = s->tx; s->y = s->ty;
+  sketchState core = {s->x, s->y, s->tx, s->ty, s->tool, s->data, false, 0};
+  sketchOp call;
+  if (!decodeByte(&core, op, &call)) {
+    *s = (state) {core.x, core.y, core.tx, core.ty, core.tool, s->start, core.data, s->end};
   }
-  else if (inst == TOOL) {
-    if (operand == NONE || operand == LINE | operand == BLOCK) s->tool = operand;
-    else if (operand == COLOUR) colour(d, s->data);
-    else if (operand == TARGETX) s->tx = s->data;
-    else if (operand == TARGETY) s->ty = s->data;
-    else if (operand == SHOW) show(d);
-    else if (operand == PAUSE) pause(d, s->data);
-    else if (operand == NEXTFRAME) s->end = true;
+  // NEXTFRAME only ends the frame here, and processSketch starts the next
+  else if (call.kind == OP_NEXTFRAME) {
+    s->end = true;
     s->data = 0;
   }
-  else if (inst == DATA) {s->data <<= 6; s->data += unsign(operand);}
+  else {
+    *s = (state) {core.x, core.y, core.tx, core.ty, core.tool, s->start, core.data, s->end};
+    sketchBackend b = displayBackend(d);
+    playOp(&call, &b);
+  }
+}
+
+// The sketch being viewed, kept open until the viewer is done with it so
+// each frame carries on reading where the last one stopped.
+static FILE *loaded = NULL;
+static char *loadedName = NULL;
+
+// Find the sketch file open at byte START, opening it if it isn't the one
+// loaded. Returns NULL if it can't be opened.
+static FILE *load(char *filename, uint64_t start) {
+  if (loadedName == NULL || strcmp(loadedName, filename) != 0) {
+    beginSpan("file load");
+    if (loaded != NULL) fclose(loaded);
+    loaded = openSK(filename);
+    loadedName = filename;
+    endSpan();
+  }
+  if (loaded != NULL && (uint64_t) ftell(loaded) != start) fseek(loaded, start, SEEK_SET);
+  return loaded;
+}
+
+// Close the sketch that was viewed.
+static void unload(void) {
+  if (loaded != NULL) fclose(loaded);
+  loaded = NULL;
+  loadedName = NULL;
+}
+
+// Play the ops of the loaded sketch from byte *AT, decoding each byte as it
+// is read, until byte LAST or the end of a frame, whichever comes first.
+// Only the op being played is ever held, so a sketch of any length starts
+// at once. *AT is left after the last byte read, and ENDED set if the frame
+// ended. Returns false, saying why, if the file is cut short or damaged.
+static bool playFrom(FILE *in, uint64_t *at, uint64_t last, sketchBackend *b, bool *ended) {
+  sketchState core = newSketchState();
+  sketchOp op;
+  *ended = false;
+  int ch;
+  while (!*ended && *at < last && in != NULL && (ch = fgetc(in)) != EOF) {
+    (*at)++;
+    if (decodeByte(&core, ch, &op)) {
+      playOp(&op, b);
+      *ended = op.kind == OP_NEXTFRAME;
+    }
+  }
+  if (in == NULL || !ferror(in)) return true;
+  printf("Error: %s is cut short or damaged\n", loadedName);
+  return false;
 }
 
 // Draw a frame of the sketch file. For basic and intermediate sketch files
@@ -69,41 +127,84 @@ bool processSketch(display *d, const char pressedKey, void *data) {
     //      THE 'START' FIELD AFTER CLOSING THE FILE
   if (data == NULL) return (pressedKey == 27);
   state *s = (state*) data;
-  char *filename = getName(d);
-  FILE *in = fopen(filename, "rb");
+  FILE *in = load(getName(d), s->start);
 
-  byte ch = fgetc(in);
-  for (int i=0; i<s->start; i++) {ch = fgetc(in);}
+  // the frame starts at byte s->start of the file, and the next one after
+  // its NEXTFRAME, or back at the start once there are no more
+  beginSpan("play frame");
+  sketchBackend b = displayBackend(d);
+  uint64_t at = s->start;
+  bool ended;
+  bool played = playFrom(in, &at, UINT64_MAX, &b, &ended);
+  endSpan();
+  if (!played) return true;
 
-  while (!feof(in) && !s->end) {
-    obey(d, s, ch);
-    s->start++;
-    ch = fgetc(in);
-  }
-
-  fclose(in); show(d);
-  if (!s->end) s->start = 0;
+  show(d);
+  s->start = ended ? at : 0;
   *s = (state) {0, 0, 0, 0, LINE, s->start, 0, false};
   return (pressedKey == 27);
 }
 
-// View a sketch file in a 200x200 pixel window given the filename
-void view(char *filename) {
+// Start playback at a frame, found in the seek index beside the sketch file.
+// What was on the window is drawn again, without showing or pausing, from the
+// latest frame up to it that covers the whole window. Returns false if the
+// frame isn't in the index, or there is no index.
+static bool seekFrame(display *d, state *s, char *filename, long frame) {
+  char *indexName = malloc(strlen(filename) + 2);
+  seekIndexName(filename, indexName);
+  FILE *index = fopen(indexName, "rb");
+  free(indexName);
+  seekEntry e, start;
+  bool found = index != NULL && readSeekEntry(index, frame, &e) &&
+    readSeekEntry(index, e.keyframe, &start);
+  if (index != NULL) fclose(index);
+  if (!found) return false;
+
+  FILE *in = load(filename, start.offset);
+  if (start.coloured) colour(d, start.rgba);
+  sketchBackend b = displayBackend(d);
+  b.show = NULL;
+  b.pause = NULL;
+  uint64_t at = start.offset;
+  bool ended = true;
+  while (ended && at < e.offset) {
+    if (!playFrom(in, &at, e.offset, &b, &ended)) return false;
+  }
+  *s = (state) {0, 0, 0, 0, LINE, e.offset, 0, false};
+  return true;
+}
+
+// View a sketch file in a 200x200 pixel window given the filename, starting
+// at FRAME. Set SKETCH_TRACE to a filename in the environment to write a
+// trace of playback.
+static void viewFrom(char *filename, long frame) {
+  startTrace(getenv("SKETCH_TRACE"));
   display *d = newDisplay(filename, 200, 200);
   state *s = newState();
-  run(d, s, processSketch);
+  if (frame == 0 || seekFrame(d, s, filename, frame)) run(d, s, processSketch);
+  else printf("Frame %ld is not in the seek index of %s\n", frame, filename);
+  unload();
   freeState(s);
   freeDisplay(d);
+  endTrace();
+}
+
+// View a sketch file in a 200x200 pixel window given the filename. Set
+// SKETCH_TRACE to a filename in the environment to write a trace of playback.
+void view(char *filename) {
+  viewFrom(filename, 0);
 }
 
 // Include a main function only if we are not testing (make sketch),
 // otherwise use the main function of the test.c file (make test).
 #ifndef TESTING
 int main(int n, char *args[n]) {
-  if (n != 2) { // return usage hint if not exactly one argument
-    printf("Use ./sketch file\n");
+  if (n != 2 && n != 3) { // return usage hint if not one or two arguments
+    printf("Use ./sketch file [frame]\n");
     exit(1);
-  } else view(args[1]); // otherwise view sketch file in argument
+  }
+  else if (n == 3) viewFrom(args[1], atol(args[2])); // view from a frame, with an index
+  else view(args[1]); // otherwise view sketch file in argument
   return 0;
 }
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
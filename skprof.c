@@ -0,0 +1,157 @@
+// Profiles the commands of a .sk file: how its bytes split between DX/DY
+// moves, TARGETX/TARGETY sets, colour changes and tool changes, and how many
+// draws and pixels each frame takes to render. It also writes an overdraw
+// heatmap, a .pgm whose every pixel is the number of times it was painted,
+// so files from different encoder settings can be compared before choosing
+// which optimisations to turn on.
+//
+// Use ./skprof [--size WIDTHxHEIGHT] [--heatmap heatmap.pgm] file.sk
+// with the heatmap written beside the file as file.heat.pgm if not given.
+#include "converter.h"
+#include "envelope.h"
+#include "overdraw.h"
+#include "stats.h"
+
+// the work done rendering one frame, which ends at each NEXTFRAME
+typedef struct frameProfile {
+    long draws;
+    long pixels; // pixels filled, counting each time one is painted again
+    long unmeasured; // diagonal lines and inside-out blocks, whose pixels aren't counted
+} frameProfile;
+
+// adds a draw's pixels to the heatmap, returning how many it fills, or -1
+// if its pixels can't be worked out
+static long paint(drawCommand *c, unsigned int *heat, int width, int height) {
+    int left, top, right, bottom;
+    if (!drawnArea(c, width, height, &left, &top, &right, &bottom)) return -1;
+    long filled = 0;
+    for (int y=top; y<bottom; y++) {
+        for (int x=left; x<right; x++) {
+            heat[(size_t) y * width + x]++;
+            filled++;
+        }
+    }
+    return filled;
+}
+
+// writes a heatmap as a binary .pgm, with the most painted pixel as its
+// maximum value, using two bytes a pixel once that is above 255. counts
+// above 65535, the most a .pgm can hold, are written as 65535
+static bool writeHeatmap(char filename[], unsigned int *heat, int width, int height,
+                         unsigned int most) {
+    FILE *out = fopen(filename, "wb");
+    if (out == NULL) return false;
+    if (most == 0) most = 1;
+    if (most > 65535) most = 65535;
+    fprintf(out, "P5 %d %d %u\n", width, height, most);
+    for (size_t i=0; i < (size_t) width * height; i++) {
+        unsigned int count = (heat[i] > most) ? most : heat[i];
+        if (most > 255) fputc(count >> 8, out);
+        fputc(count & 0xff, out);
+    }
+    fclose(out);
+    return true;
+}
+
+// profiles the draws of a .sk file on a canvas of the given size, printing
+// the draws and pixels of each frame and filling in the heatmap
+static void profileFrames(FILE *in, unsigned int *heat, int width, int height) {
+    int count;
+    drawCommand *d = readDrawCommands(in, &count);
+    int frames = 1;
+    for (int i=0; i<count; i++) frames += d[i].tool == NEXTFRAME;
+    frameProfile *f = calloc(frames, sizeof(frameProfile));
+
+    int frame = 0;
+    for (int i=0; i<count; i++) {
+        if (d[i].tool == NEXTFRAME) frame++;
+        if (d[i].tool != LINE && d[i].tool != BLOCK) continue;
+        f[frame].draws++;
+        long filled = paint(&d[i], heat, width, height);
+        if (filled < 0) f[frame].unmeasured++;
+        else f[frame].pixels += filled;
+    }
+
+    long draws = 0, pixels = 0, unmeasured = 0;
+    printf("Frames: %d\n", frames);
+    printf("  %6s %8s %10s %8s\n", "frame", "draws", "pixels", "canvases");
+    for (int i=0; i<frames; i++) {
+        printf("  %6d %8ld %10ld %8.2f\n", i, f[i].draws, f[i].pixels,
+               (double) f[i].pixels / ((long) width * height));
+        draws += f[i].draws;
+        pixels += f[i].pixels;
+        unmeasured += f[i].unmeasured;
+    }
+    printf("Draws: %ld, pixels filled: %ld\n", draws, pixels);
+    if (unmeasured > 0) {
+        printf("  %ld diagonal lines or inside-out blocks not counted in pixels\n", unmeasured);
+    }
+    free(f);
+    free(d);
+}
+
+int main(int n, char *args[n]) {
+    int width = WIDTH, height = HEIGHT;
+    char *heatmap = NULL;
+    bool validOptions = true;
+    int i = 1;
+    for (; i < n-1 && validOptions; i++) {
+        if (strcmp(args[i], "--size") == 0 && i+1 < n-1) {
+            validOptions = sscanf(args[++i], "%dx%d", &width, &height) == 2
+                && width > 0 && height > 0;
+        }
+        else if (strcmp(args[i], "--heatmap") == 0 && i+1 < n-1) heatmap = args[++i];
+        else validOptions = false;
+    }
+    if (!validOptions || i != n-1 || parseFiletype(args[n-1]) != SK) {
+        printf("Use ./skprof [--size WIDTHxHEIGHT] [--heatmap heatmap.pgm] file.sk\n");
+        return 1;
+    }
+    char *filename = args[n-1];
+    FILE *in = openSK(filename);
+    if (in == NULL) {
+        printf("No sketch file %s\n", filename);
+        return 1;
+    }
+
+    // the heatmap goes beside the file unless named, file.sk to file.heat.pgm
+    char heatFile[strlen(filename) + strlen(".heat.pgm") + 1];
+    if (heatmap == NULL) {
+        size_t stem = strlen(filename) - strlen(".sk");
+        snprintf(heatFile, sizeof(heatFile), "%.*s.heat.pgm", (int) stem, filename);
+        heatmap = heatFile;
+    }
+
+    resetStats();
+    countCommandBytes(in);
+    if (ferror(in)) {
+        printf("Sketch file %s is cut short or damaged\n", filename);
+        fclose(in);
+        return 1;
+    }
+    printf("Profile of %s on a %dx%d canvas\n", filename, width, height);
+    printCommandBytes(stdout);
+
+    rewind(in);
+    unsigned int *heat = calloc((size_t) width * height, sizeof(unsigned int));
+    profileFrames(in, heat, width, height);
+    fclose(in);
+
+    unsigned int most = 0;
+    long painted = 0, overdrawn = 0; // pixels painted at least once, and more than once
+    for (size_t j=0; j < (size_t) width * height; j++) {
+        if (heat[j] > most) most = heat[j];
+        painted += heat[j] > 0;
+        overdrawn += heat[j] > 1;
+    }
+    printf("Pixels painted: %ld, painted more than once: %ld, most paints of a pixel: %u\n",
+           painted, overdrawn, most);
+    bool written = writeHeatmap(heatmap, heat, width, height, most);
+    free(heat);
+    if (!written) {
+        printf("Could not write heatmap %s\n", heatmap);
+        return 1;
+    }
+    printf("Heatmap %s has been written.\n", heatmap);
+    return 0;
+}
@@ -0,0 +1,372 @@
+// A long-running conversion server, so a pipeline can convert many images
+// without starting a converter process for each one. Jobs are read as frames
+// from stdin, or from every connection to a Unix socket given with --socket,
+// and run on a pool of worker threads that each keep their own libsketch
+// context and buffers warm between jobs. Replies are written as frames in the
+// order jobs finish, tagged with the id of their job.
+//
+// Every request frame starts with an 18 byte header, all numbers big-endian:
+//   type (1 byte): 'E' to encode, 'D' to decode, 'S' for server statistics
+//   id (4 bytes): any number, sent back with the reply
+//   width, height (4 bytes each): size of the image
+//   method (1 byte): SK_RLE, SK_BOX, SK_STRIPES, SK_EXHAUSTIVE or SK_LARGEST, when encoding
+//   length (4 bytes): number of bytes of payload that follow
+// followed by the payload: width x height greyscale pixels to encode, or .sk
+// data to decode. Every reply frame starts with a 9 byte header:
+//   result (1 byte): an skResult, SK_OK if the job succeeded
+//   id (4 bytes), length (4 bytes)
+// followed by the .sk data, the decoded pixels, or the statistics as JSON.
+#define _POSIX_C_SOURCE 200809L
+#include "libsketch.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define REQUEST_HEADER_BYTES 18
+#define REPLY_HEADER_BYTES 9
+#define MAX_PAYLOAD (256 << 20) // larger frames are taken to be corrupt
+#define LATENCY_SAMPLES 4096 // percentiles are over this many most recent jobs
+
+// one client's stream of requests and replies
+typedef struct connection {
+    int in, out;
+    mtx_t writing; // replies from different workers must not interleave
+    bool closed; // set once a reply can't be written, as the client has gone
+    int references; // the thread reading requests, and each unfinished job
+} connection;
+
+typedef struct job {
+    connection *from;
+    unsigned char type, method;
+    unsigned int id, width, height, length;
+    unsigned char *payload;
+    double queued; // when the job was read, in seconds
+    struct job *next;
+} job;
+
+// jobs waiting for a worker, and everything reported by a statistics request
+static struct server {
+    mtx_t lock;
+    cnd_t waiting;
+    job *first, *last;
+    int depth, maxDepth;
+    bool closing; // set once there can be no more jobs
+    int workers;
+    long deadlineMs; // time limit for every encode, or 0 for none
+    long jobs, failures;
+    double latencies[LATENCY_SAMPLES]; // in microseconds, as a ring
+} server;
+
+// seconds since some fixed point in time
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// reads exactly N bytes, returning false at the end of the stream
+static bool readAll(int fd, void *buffer, size_t n) {
+    unsigned char *p = buffer;
+    while (n > 0) {
+        ssize_t got = read(fd, p, n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= got;
+    }
+    return true;
+}
+
+// writes exactly N bytes, returning false if the stream has been closed,
+// which with SIGPIPE ignored shows up as EPIPE
+static bool writeAll(int fd, const void *buffer, size_t n) {
+    const unsigned char *p = buffer;
+    while (n > 0) {
+        ssize_t put = write(fd, p, n);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        p += put;
+        n -= put;
+    }
+    return true;
+}
+
+static unsigned int readNumber(unsigned char *p) {
+    return (unsigned int) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void writeNumber(unsigned char *p, unsigned int n) {
+    p[0] = n >> 24; p[1] = n >> 16; p[2] = n >> 8; p[3] = n;
+}
+
+// lets go of a connection, closing it once nothing is using it
+static void release(connection *c) {
+    mtx_lock(&server.lock);
+    bool last = --c->references == 0;
+    mtx_unlock(&server.lock);
+    if (!last) return;
+    close(c->in);
+    if (c->out != c->in) close(c->out);
+    mtx_destroy(&c->writing);
+    free(c);
+}
+
+// sends a reply frame back down a connection, unless the client has closed
+// it, when the reply and every later one is dropped
+static void reply(connection *c, unsigned char result, unsigned int id,
+                  const void *payload, size_t length) {
+    unsigned char header[REPLY_HEADER_BYTES];
+    header[0] = result;
+    writeNumber(&header[1], id);
+    writeNumber(&header[5], length);
+    mtx_lock(&c->writing);
+    if (!c->closed) {
+        c->closed = !writeAll(c->out, header, REPLY_HEADER_BYTES)
+            || !writeAll(c->out, payload, length);
+    }
+    mtx_unlock(&c->writing);
+}
+
+static int compareDoubles(const void *p, const void *q) {
+    double x = *(const double *) p, y = *(const double *) q;
+    return (x > y) - (x < y);
+}
+
+// replies with the queue depth, worker count and job latency percentiles
+static void replyStatistics(connection *c, unsigned int id) {
+    double sorted[LATENCY_SAMPLES];
+    mtx_lock(&server.lock);
+    long jobs = server.jobs, failures = server.failures;
+    int depth = server.depth, maxDepth = server.maxDepth;
+    int samples = (jobs < LATENCY_SAMPLES) ? jobs : LATENCY_SAMPLES;
+    memcpy(sorted, server.latencies, samples * sizeof(double));
+    mtx_unlock(&server.lock);
+
+    qsort(sorted, samples, sizeof(double), compareDoubles);
+    double percentiles[4] = {50, 90, 99, 100};
+    double values[4] = {0};
+    for (int i=0; i<4 && samples > 0; i++) {
+        int index = (int) (percentiles[i] / 100 * (samples - 1) + 0.5);
+        values[i] = sorted[index];
+    }
+    char json[512];
+    int length = snprintf(json, sizeof(json),
+        "{\"workers\": %d, \"jobs\": %ld, \"failures\": %ld, \"queue_depth\": %d, "
+        "\"max_queue_depth\": %d, \"latency_us\": {\"p50\": %.1f, \"p90\": %.1f, "
+        "\"p99\": %.1f, \"max\": %.1f}}",
+        server.workers, jobs, failures, depth, maxDepth,
+        values[0], values[1], values[2], values[3]);
+    reply(c, SK_OK, id, json, length);
+}
+
+// a worker's context and buffers, kept from one job to the next
+typedef struct worker {
+    skContext *ctx;
+    unsigned char *pixels;
+    size_t capacity;
+} worker;
+
+// runs one job, replying with the result
+static void runJob(worker *w, job *j) {
+    skResult result = SK_INVALID_ARGUMENT;
+    skBuffer sketch = {NULL, 0};
+    const void *payload = NULL;
+    size_t length = 0;
+    size_t pixels = (size_t) j->width * j->height;
+
+    if (j->type == 'E' && j->length == pixels) {
+        // the deadline counts from when the job arrived, including time queued
+        long deadline = 0;
+        if (server.deadlineMs > 0) {
+            deadline = server.deadlineMs - (long) ((now() - j->queued) * 1e3);
+            if (deadline < 1) deadline = 1; // already late, so finish as fast as possible
+        }
+        skOptions options = {j->method, true, deadline};
+        result = sk_encode(w->ctx, j->payload, j->width, j->height, j->width, &options, &sketch);
+        payload = sketch.data;
+        length = sketch.length;
+    }
+    else if (j->type == 'D' && pixels <= MAX_PAYLOAD) {
+        if (pixels > w->capacity) {
+            free(w->pixels);
+            w->pixels = malloc(pixels);
+            w->capacity = (w->pixels == NULL) ? 0 : pixels;
+        }
+        if (w->pixels == NULL) result = SK_OUT_OF_MEMORY;
+        else {
+            result = sk_decode(w->ctx, j->payload, j->length, w->pixels,
+                               j->width, j->height, j->width);
+            payload = w->pixels;
+            length = pixels;
+        }
+    }
+    if (result != SK_OK) length = 0;
+
+    // counted before replying, so a client sees its own jobs in the statistics
+    double latency = (now() - j->queued) * 1e6;
+    mtx_lock(&server.lock);
+    server.latencies[server.jobs % LATENCY_SAMPLES] = latency;
+    server.jobs++;
+    if (result != SK_OK) server.failures++;
+    mtx_unlock(&server.lock);
+
+    reply(j->from, result, j->id, payload, length);
+    sk_freeBuffer(&sketch);
+}
+
+// takes jobs off the queue until the server closes
+static int work(void *unused) {
+    (void) unused;
+    worker w = {sk_newContext(), NULL, 0};
+    while (true) {
+        mtx_lock(&server.lock);
+        while (server.first == NULL && !server.closing) cnd_wait(&server.waiting, &server.lock);
+        job *j = server.first;
+        if (j != NULL) {
+            server.first = j->next;
+            if (server.first == NULL) server.last = NULL;
+            server.depth--;
+        }
+        mtx_unlock(&server.lock);
+        if (j == NULL) break;
+
+        runJob(&w, j);
+        release(j->from);
+        free(j->payload);
+        free(j);
+    }
+    sk_freeContext(w.ctx);
+    free(w.pixels);
+    return 0;
+}
+
+// adds a job to the end of the queue
+static void enqueue(job *j) {
+    mtx_lock(&server.lock);
+    j->from->references++;
+    if (server.last == NULL) server.first = j;
+    else server.last->next = j;
+    server.last = j;
+    server.depth++;
+    if (server.depth > server.maxDepth) server.maxDepth = server.depth;
+    cnd_signal(&server.waiting);
+    mtx_unlock(&server.lock);
+}
+
+// reads request frames from a connection until it closes, queueing each job.
+// a frame there is no memory for is dropped and the connection closed
+static int serve(void *data) {
+    connection *c = data;
+    unsigned char header[REQUEST_HEADER_BYTES];
+    while (readAll(c->in, header, REQUEST_HEADER_BYTES)) {
+        job *j = calloc(1, sizeof(job));
+        if (j == NULL) break;
+        *j = (job) {c, header[0], header[13], readNumber(&header[1]),
+                    readNumber(&header[5]), readNumber(&header[9]), readNumber(&header[14])};
+        if (j->length > MAX_PAYLOAD) {
+            free(j);
+            break;
+        }
+        j->payload = malloc(j->length + 1);
+        if (j->payload == NULL || !readAll(c->in, j->payload, j->length)) {
+            free(j->payload);
+            free(j);
+            break;
+        }
+        j->queued = now();
+        if (j->type == 'S') {
+            replyStatistics(c, j->id);
+            free(j->payload);
+            free(j);
+        }
+        else enqueue(j);
+    }
+    release(c);
+    return 0;
+}
+
+// starts serving a new connection on its own thread
+static connection *newConnection(int in, int out) {
+    connection *c = malloc(sizeof(connection));
+    *c = (connection) {in, out};
+    mtx_init(&c->writing, mtx_plain);
+    c->references = 1;
+    return c;
+}
+
+// accepts connections to a Unix socket forever, serving each on a thread
+static int listenOn(char path[]) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (fd < 0 || strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: cannot make a socket at %s\n", path);
+        return 1;
+    }
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(fd, 64) != 0) {
+        fprintf(stderr, "Error: cannot listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    while (true) {
+        int client = accept(fd, NULL, NULL);
+        if (client < 0) continue;
+        thrd_t reader;
+        if (thrd_create(&reader, serve, newConnection(client, client)) == thrd_success) {
+            thrd_detach(reader);
+        }
+    }
+}
+
+int main(int n, char *args[n]) {
+    char *socketPath = NULL;
+    server.workers = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i=1; i<n; i++) {
+        if (strcmp(args[i], "--socket") == 0 && i+1 < n) socketPath = args[++i];
+        else if (strcmp(args[i], "--workers") == 0 && i+1 < n) server.workers = atoi(args[++i]);
+        else if (strcmp(args[i], "--deadline-ms") == 0 && i+1 < n) {
+            server.deadlineMs = atol(args[++i]);
+        }
+        else {
+            printf("Use ./skserver [--socket path] [--workers n] [--deadline-ms ms]\n");
+            return 1;
+        }
+    }
+    if (server.workers < 1) server.workers = 1;
+    // a client that goes before its reply is written must not end the server
+    signal(SIGPIPE, SIG_IGN);
+
+    mtx_init(&server.lock, mtx_plain);
+    cnd_init(&server.waiting);
+    // only the workers that start are counted, and joined at the end
+    thrd_t *workers = malloc(server.workers * sizeof(thrd_t));
+    int started = 0;
+    for (int i=0; workers != NULL && i<server.workers; i++) {
+        if (thrd_create(&workers[started], work, NULL) == thrd_success) started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "Error: no worker threads could be started\n");
+        free(workers);
+        return 1;
+    }
+    server.workers = started;
+
+    if (socketPath != NULL) return listenOn(socketPath);
+
+    // with no socket, serve stdin then finish every job left before exiting
+    serve(newConnection(STDIN_FILENO, STDOUT_FILENO));
+    mtx_lock(&server.lock);
+    server.closing = true;
+    cnd_broadcast(&server.waiting);
+    mtx_unlock(&server.lock);
+    for (int i=0; i<started; i++) thrd_join(workers[i], NULL);
+    free(workers);
+    return 0;
+}
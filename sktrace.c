@@ -0,0 +1,230 @@
+// Records every drawing call the viewer makes while playing a sketch file
+// once through, as compact binary records, to write a golden trace or to
+// check the calls against one. A golden trace holds the number of calls and
+// a rolling hash of them ahead of the calls themselves, so a matching
+// sketch is checked from the header alone, and only a mismatch is read
+// through to report the first call that differs.
+//
+// Use ./sktrace record trace.skt file.sk, or ./sktrace check trace.skt file.sk
+#include "displayfull.h"
+#include "sketch.h"
+#include <stdint.h>
+
+#define MAX_ARGS 4
+
+// the display functions that are recorded, and the end of each processSketch
+enum { CALL_LINE, CALL_BLOCK, CALL_COLOUR, CALL_SHOW, CALL_PAUSE, CALL_RETURN };
+static const int ARGS[] = {4, 4, 1, 0, 1, 0};
+static const char MAGIC[4] = {'S', 'K', 'T', '1'};
+#define HEADER_BYTES (4 + 8 + 8) // magic, number of calls and hash
+
+typedef struct call { int kind; int64_t args[MAX_ARGS]; } call;
+
+// a display that draws nothing and keeps the calls made to it
+struct display {
+  char *name;
+  int width, height;
+};
+
+// the calls recorded so far, encoded, and the hash of them
+static uint8_t *calls = NULL;
+static size_t length = 0, capacity = 0;
+static uint64_t count = 0, hash = 0xcbf29ce484222325; // FNV-1a offset basis
+
+// Add a byte to the recorded calls, carrying the hash on over it.
+static void addByte(uint8_t b) {
+  if (length == capacity) {
+    capacity = (capacity == 0) ? 4096 : capacity * 2;
+    calls = realloc(calls, capacity);
+  }
+  calls[length++] = b;
+  hash = (hash ^ b) * 0x100000001b3; // FNV-1a prime
+}
+
+// Add an argument as a zigzag varint, so small values of either sign take
+// a single byte.
+static void addArg(int64_t value) {
+  uint64_t v = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+  while (v >= 0x80) {
+    addByte((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  addByte(v);
+}
+
+// Add a call with its arguments to the recorded calls.
+static void record(int kind, int64_t a, int64_t b, int64_t c, int64_t d) {
+  int64_t args[MAX_ARGS] = {a, b, c, d};
+  addByte(kind);
+  for (int i=0; i<ARGS[kind]; i++) addArg(args[i]);
+  count++;
+}
+
+// Read the next call from encoded calls, returning false at the end.
+static bool readCall(uint8_t *in, size_t inLength, size_t *at, call *c) {
+  if (*at >= inLength) return false;
+  c->kind = in[(*at)++];
+  if (c->kind > CALL_RETURN) return false;
+  for (int i=0; i<ARGS[c->kind]; i++) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (*at < inLength && (in[*at] & 0x80)) {
+      v |= (uint64_t) (in[(*at)++] & 0x7f) << shift;
+      shift += 7;
+    }
+    if (*at >= inLength) return false;
+    v |= (uint64_t) in[(*at)++] << shift;
+    c->args[i] = (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+  }
+  return true;
+}
+
+// Write a call the way test.c spells it.
+static void printCall(call *c) {
+  int64_t *a = c->args;
+  if (c->kind == CALL_LINE || c->kind == CALL_BLOCK) {
+    printf("%s(d,%ld,%ld,%ld,%ld)", (c->kind == CALL_LINE) ? "line" : "block",
+           (long) a[0], (long) a[1], (long) a[2], (long) a[3]);
+  }
+  else if (c->kind == CALL_COLOUR) printf("colour(d,0x%08x)", (unsigned int) a[0]);
+  else if (c->kind == CALL_SHOW) printf("show(d)");
+  else if (c->kind == CALL_PAUSE) printf("pause(d,%ld)", (long) a[0]);
+  else printf("processSketchReturn");
+}
+
+display *newDisplay(char *name, int width, int height) {
+  display *d = malloc(sizeof(display));
+  *d = (display) {name, width, height};
+  return d;
+}
+
+void freeDisplay(display *d) {
+  free(d);
+}
+
+int getWidth(display *d) {
+  return d->width;
+}
+
+int getHeight(display *d) {
+  return d->height;
+}
+
+char *getName(display *d) {
+  return d->name;
+}
+
+void line(display *d, int x0, int y0, int x1, int y1) {
+  record(CALL_LINE, x0, y0, x1, y1);
+}
+
+void block(display *d, int x, int y, int w, int h) {
+  record(CALL_BLOCK, x, y, w, h);
+}
+
+void colour(display *d, int rgba) {
+  record(CALL_COLOUR, (unsigned int) rgba, 0, 0, 0);
+}
+
+void show(display *d) {
+  record(CALL_SHOW, 0, 0, 0, 0);
+}
+
+void pause(display *d, int ms) {
+  record(CALL_PAUSE, ms, 0, 0, 0);
+}
+
+// Play the sketch once through, frame by frame, until it starts again.
+void run(display *d, void *data, bool action(display *, const char, void*)) {
+  state *s = data;
+  bool quit = false;
+  do {
+    quit = action(d, 0, data);
+    record(CALL_RETURN, 0, 0, 0, 0);
+  } while (!quit && s->start != 0);
+}
+
+// Write the recorded calls as a golden trace.
+static bool writeTrace(char *filename) {
+  FILE *out = fopen(filename, "wb");
+  if (out == NULL) return false;
+  fwrite(MAGIC, 1, sizeof(MAGIC), out);
+  for (int i=0; i<8; i++) fputc((count >> (8 * i)) & 0xff, out);
+  for (int i=0; i<8; i++) fputc((hash >> (8 * i)) & 0xff, out);
+  fwrite(calls, 1, length, out);
+  fclose(out);
+  return true;
+}
+
+// Check the recorded calls against a golden trace, printing the first call
+// that differs if they don't match.
+static bool checkTrace(char *filename) {
+  FILE *in = fopen(filename, "rb");
+  if (in == NULL) {
+    printf("No trace %s\n", filename);
+    return false;
+  }
+  uint8_t header[HEADER_BYTES];
+  bool valid = fread(header, 1, HEADER_BYTES, in) == (size_t) HEADER_BYTES &&
+    memcmp(header, MAGIC, sizeof(MAGIC)) == 0;
+  uint64_t goldenCount = 0, goldenHash = 0;
+  for (int i=7; i>=0 && valid; i--) {
+    goldenCount = (goldenCount << 8) | header[sizeof(MAGIC) + i];
+    goldenHash = (goldenHash << 8) | header[sizeof(MAGIC) + 8 + i];
+  }
+  if (!valid) {
+    printf("%s is not a trace\n", filename);
+    fclose(in);
+    return false;
+  }
+  if (goldenCount == count && goldenHash == hash) {
+    fclose(in);
+    return true;
+  }
+
+  // only now read the golden calls, to find where they part
+  fseek(in, 0, SEEK_END);
+  size_t goldenLength = ftell(in) - HEADER_BYTES;
+  uint8_t *golden = malloc(goldenLength + 1);
+  fseek(in, HEADER_BYTES, SEEK_SET);
+  goldenLength = fread(golden, 1, goldenLength, in);
+  fclose(in);
+  size_t at = 0, goldenAt = 0;
+  call found, expected;
+  for (uint64_t n=1; ; n++) {
+    bool more = readCall(calls, length, &at, &found);
+    bool goldenMore = readCall(golden, goldenLength, &goldenAt, &expected);
+    if (!more && !goldenMore) break;
+    bool same = more && goldenMore && found.kind == expected.kind;
+    for (int i=0; same && i<ARGS[found.kind]; i++) same = found.args[i] == expected.args[i];
+    if (same) continue;
+    printf("Call %lu differs: found ", (unsigned long) n);
+    if (more) printCall(&found); else printf("nothing");
+    printf(" but expected ");
+    if (goldenMore) printCall(&expected); else printf("nothing");
+    printf("\n");
+    break;
+  }
+  free(golden);
+  return false;
+}
+
+int main(int n, char *args[n]) {
+  bool recording = n == 4 && strcmp(args[1], "record") == 0;
+  bool checking = n == 4 && strcmp(args[1], "check") == 0;
+  if (!recording && !checking) {
+    printf("Use ./sktrace record trace.skt file.sk, or ./sktrace check trace.skt file.sk\n");
+    return 1;
+  }
+  FILE *sketch = fopen(args[3], "rb");
+  if (sketch == NULL) {
+    printf("No sketch file %s\n", args[3]);
+    return 1;
+  }
+  fclose(sketch);
+  view(args[3]);
+  bool ok = recording ? writeTrace(args[2]) : checkTrace(args[2]);
+  if (ok) printf("%s %s: %lu calls\n", recording ? "Recorded" : "Trace OK", args[3], (unsigned long) count);
+  free(calls);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#define _POSIX_C_SOURCE 200809L // for getrusage
+#include "stats.h"
+#include <sys/resource.h>
+
+_Thread_local converterStats stats;
+
+// sets every counter back to zero
+void resetStats(void) {memset(&stats, 0, sizeof(stats));}
+
+// adds every byte of a .sk file to the count for its category: DX/DY moves,
+// TARGETX/TARGETY sets, colour changes or other tool changes. DATA commands
+// count towards the TOOL command that uses them
+void countCommandBytes(FILE *in) {
+    long data = 0; // DATA commands not yet used by a TOOL command
+    int ch = fgetc(in);
+    while (ch != EOF) {
+        unsigned char opcode = ch >> 6;
+        unsigned char operand = ch & 0x3f;
+        if (opcode == DX || opcode == DY) stats.bytes[MOVE_BYTES]++;
+        else if (opcode == DATA) data++;
+        else {
+            int category = TOOL_BYTES;
+            if (operand == COLOUR) category = COLOUR_BYTES;
+            else if (operand == TARGETX || operand == TARGETY) category = SET_BYTES;
+            stats.bytes[category] += data + 1;
+            data = 0;
+        }
+        ch = fgetc(in);
+    }
+    // DATA left over at the end of the file does nothing
+    stats.bytes[TOOL_BYTES] += data;
+}
+
+// finds the most memory the process has used so far, in kilobytes
+long peakMemory(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// prints every counter in a readable form
+void printStats(FILE *out) {
+#ifdef NO_STATS
+    fprintf(out, "Search counters were compiled out (NO_STATS)\n");
+#else
+    fprintf(out, "findBoxEnd cells visited: %ld\n", stats.boxEndCells);
+    fprintf(out, "findPixel calls: %ld, cells scanned: %ld\n",
+            stats.findPixelCalls, stats.findPixelCells);
+    fprintf(out, "finalise passes: %ld\n", stats.finalisePasses);
+    fprintf(out, "Draws per grey value, or place in a palette:");
+    int printed = 0;
+    for (int i=0; i<256; i++) {
+        if (stats.draws[i] == 0) continue;
+        if (printed % 8 == 0) fprintf(out, "\n ");
+        fprintf(out, " %3d: %-5ld", i, stats.draws[i]);
+        printed++;
+    }
+    fprintf(out, "\n");
+#endif
+    printCommandBytes(out);
+    fprintf(out, "Peak memory: %ld KB\n", peakMemory());
+}
+
+// prints the bytes counted in each category, and their share of the total
+void printCommandBytes(FILE *out) {
+    char *names[BYTE_CATEGORIES] = {"DX/DY moves", "TARGETX/TARGETY sets",
+                                    "colour changes", "tool changes"};
+    long total = 0;
+    for (int i=0; i<BYTE_CATEGORIES; i++) total += stats.bytes[i];
+    fprintf(out, "Bytes written: %ld\n", total);
+    for (int i=0; i<BYTE_CATEGORIES; i++) {
+        fprintf(out, "  %-21s %8ld (%.1f%%)\n", names[i], stats.bytes[i],
+                total ? 100.0 * stats.bytes[i] / total : 0.0);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "converter.h"
+
+// counters for the converter's hot paths, printed by ./converter --stats.
+// building with -DNO_STATS compiles every COUNT away to nothing
+#ifdef NO_STATS
+#define COUNT(counter, n) ((void) 0)
+#else
+#define COUNT(counter, n) (stats.counter += (n))
+#endif
+
+// counts a box or line drawn of a value on the board. only the first 256 of
+// a colour image's palette are counted
+#define COUNT_DRAW(value) ((value) < 256 ? (void) COUNT(draws[value], 1) : (void) 0)
+
+enum { MOVE_BYTES, SET_BYTES, COLOUR_BYTES, TOOL_BYTES, BYTE_CATEGORIES }; // .sk byte categories
+
+typedef struct converterStats {
+    long boxEndCells; // board cells read by findBoxEnd
+    long findPixelCalls;
+    long findPixelCells; // board cells read by findPixel
+    long draws[256]; // boxes and lines drawn of each grey value, or place in a palette
+    long finalisePasses;
+    long bytes[BYTE_CATEGORIES]; // set by countCommandBytes
+} converterStats;
+
+extern _Thread_local converterStats stats; // counted separately by each thread
+
+// sets every counter back to zero
+void resetStats(void);
+
+// adds every byte of a .sk file to the count for its category: DX/DY moves,
+// TARGETX/TARGETY sets, colour changes or other tool changes. DATA commands
+// count towards the TOOL command that uses them
+void countCommandBytes(FILE *in);
+
+// finds the most memory the process has used so far, in kilobytes
+long peakMemory(void);
+
+// prints every counter in a readable form
+void printStats(FILE *out);
+
+// prints the bytes counted in each category, and their share of the total
+void printCommandBytes(FILE *out);
+
+#endif
@@ -0,0 +1,85 @@
+#define _POSIX_C_SOURCE 200809L // for clock_gettime, getpid and flockfile
+#include "trace.h"
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+// each thread writes its own trace unless it follows another's, and then
+// writes each event whole so events from different threads don't mix
+static _Thread_local FILE *trace = NULL;
+static _Thread_local int pid, tid = 1;
+
+// microseconds since some fixed point in time
+static double microseconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+// starts writing a trace to the given file, or does nothing if FILENAME is
+// NULL or cannot be written to
+void startTrace(char filename[]) {
+    if (filename == NULL || trace != NULL) return;
+    trace = fopen(filename, "w");
+    if (trace == NULL) return;
+    pid = getpid();
+    fprintf(trace, "[\n");
+}
+
+// writes the start of an event, leaving the object open for any arguments
+static void writeEvent(char phase, char name[]) {
+    fprintf(trace, "{\"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d",
+            phase, microseconds(), pid, tid);
+    if (name != NULL) fprintf(trace, ", \"name\": \"%s\"", name);
+}
+
+// marks the start of a span, which lasts until the matching endSpan
+void beginSpan(char name[]) {
+    if (trace == NULL) return;
+    flockfile(trace);
+    writeEvent('B', name);
+    fprintf(trace, "},\n");
+    funlockfile(trace);
+}
+
+// marks the start of a span labelled with a named value, such as the grey
+// value being drawn
+void beginValueSpan(char name[], char key[], long value) {
+    if (trace == NULL) return;
+    flockfile(trace);
+    writeEvent('B', name);
+    fprintf(trace, ", \"args\": {\"%s\": %ld}},\n", key, value);
+    funlockfile(trace);
+}
+
+// marks the end of the most recently begun span
+void endSpan(void) {
+    if (trace == NULL) return;
+    flockfile(trace);
+    writeEvent('E', NULL);
+    fprintf(trace, "},\n");
+    funlockfile(trace);
+}
+
+// the trace this thread is writing, or NULL if none
+FILE *currentTrace(void) {
+    return trace;
+}
+
+// makes this thread record its spans in another thread's trace as thread
+// number THREAD, until that thread ends the trace
+void followTrace(FILE *file, int thread) {
+    trace = file;
+    pid = getpid();
+    tid = thread;
+}
+
+// finishes the trace file and closes it
+void endTrace(void) {
+    if (trace == NULL) return;
+    // an instant event to end on, so no event needs to go without a comma
+    writeEvent('i', "end");
+    fprintf(trace, ", \"s\": \"p\"}\n]\n");
+    fclose(trace);
+    trace = NULL;
+}
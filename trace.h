@@ -0,0 +1,36 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Records spans of time to a Chrome trace-event JSON file, which can be
+// opened in chrome://tracing or ui.perfetto.dev to see where a conversion or
+// playback spent its time. Until a trace is started every function does
+// nothing, so spans can be left in place at little cost. A trace only records
+// spans from the thread that started it, and any thread told to follow it.
+
+#include <stdio.h>
+
+// starts writing a trace to the given file, or does nothing if FILENAME is
+// NULL or cannot be written to
+void startTrace(char filename[]);
+
+// marks the start of a span, which lasts until the matching endSpan
+void beginSpan(char name[]);
+
+// marks the start of a span labelled with a named value, such as the grey
+// value being drawn
+void beginValueSpan(char name[], char key[], long value);
+
+// marks the end of the most recently begun span
+void endSpan(void);
+
+// the trace this thread is writing, or NULL if none
+FILE *currentTrace(void);
+
+// makes this thread record its spans in another thread's trace as thread
+// number THREAD, until that thread ends the trace
+void followTrace(FILE *file, int thread);
+
+// finishes the trace file and closes it
+void endTrace(void);
+
+#endif